@@ -11,6 +11,9 @@
 
 #include <iostream>
 #include <deque>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include <string>
 #include <cstdlib>
@@ -23,6 +26,37 @@
 #include <sys/ioctl.h>
 #include <termios.h>
 #include <sys/select.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <dirent.h>
+#include <linux/perf_event.h>
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define VSNAKE_HAVE_URING 1
+#endif
+#endif
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__BMI2__)
+#include <immintrin.h>
+#endif
 
 // ─── ANSI Constants ─────────────────────────────────────────
 #define RESET        "\033[0m"
@@ -33,7 +67,12 @@
 #define GREEN        "\033[32m"
 #define YELLOW       "\033[33m"
 #define CYAN         "\033[36m"
+#define BLUE         "\033[34m"
+#define MAGENTA      "\033[35m"
 #define BRIGHT_GREEN "\033[92m"
+#define BRIGHT_YELLOW "\033[93m"
+#define BRIGHT_BLUE  "\033[94m"
+#define BRIGHT_MAGENTA "\033[95m"
 #define BRIGHT_CYAN  "\033[96m"
 #define BRIGHT_WHITE "\033[97m"
 #define ERASE_LINE   "\033[K"
@@ -52,6 +91,7 @@ static const int APPLE_MAX_TRIES  = 1000;
 
 // ─── Timing ─────────────────────────────────────────────────
 static const int   RENDER_TICK_US    = 30000;
+static const int   RENDER_KEYFRAME   = 1000;     // frames between full redraws (diffRender)
 static const int   BASE_MOVE_US      = 120000;
 static const int   MIN_MOVE_US       = 60000;
 static const int   SPEED_SCORE_STEP  = 50;
@@ -82,6 +122,14 @@ struct Point {
     bool operator==(const Point& o) const { return x == o.x && y == o.y; }
 };
 
+static inline Point stepPoint(Point p, Direction d) {
+    switch (d) {
+        case UP: p.y--; break; case DOWN: p.y++; break;
+        case LEFT: p.x--; break; case RIGHT: p.x++; break;
+    }
+    return p;
+}
+
 struct ScoreEntry {
     std::string timestamp;
     int score;
@@ -90,13 +138,181 @@ struct ScoreEntry {
 // ─── App State Machine ─────────────────────────────────────
 enum AppState {
     STATE_MENU, STATE_PLAYING, STATE_GAMEOVER,
-    STATE_RESIZED, STATE_TOO_SMALL, STATE_LEADERBOARD, STATE_EXIT
+    STATE_RESIZED, STATE_TOO_SMALL, STATE_LEADERBOARD,
+    STATE_MULTI_SETUP, STATE_MULTI_PLAYING, STATE_MULTI_GAMEOVER,
+    STATE_EXIT
+};
+
+// ─── PRNG ───────────────────────────────────────────────────
+// Small seedable generator (xorshift64*); every game owns one so
+// a seed plus the input sequence reproduces the whole game.
+struct Rng {
+    uint64_t s;
+    void seed(uint64_t v) { s = v ? v : 0x9E3779B97F4A7C15ULL; }
+    uint32_t next() {
+        s ^= s >> 12; s ^= s << 25; s ^= s >> 27;
+        return (uint32_t)((s * 0x2545F4914F6CDD1DULL) >> 32);
+    }
+    int below(int n) { return (int)(next() % (uint32_t)n); }
+};
+
+// splitmix64 finalizer: hashing coordinates, keys and seeds
+static inline uint64_t mix64(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+// ─── Level ──────────────────────────────────────────────────
+// A compiled obstacle level (see LEVELS).  The masks point into a
+// read-only shared mapping and use the occupancy bitmap layout, bit
+// y*width+x, so collision is one OR of two words.
+struct LevelPortal { uint32_t from, to; };
+
+struct Level {
+    int                 width, height;
+    Point               start;              // head; the body trails to the left
+    const uint64_t     *wall, *spawn, *portal;
+    const uint64_t     *noFood;             // wall | portal
+    const LevelPortal  *portals;            // both directions listed
+    const uint8_t      *portalAt;           // per cell: 1 + its portals[] entry, 0 if none
+    int                 numPortals;
+    uint32_t            spawnCells;
+    std::string         path;
+};
+
+// ─── Terminal Capabilities ──────────────────────────────────
+// What the terminal accepts beyond the baseline ANSI set the renderer
+// always uses (see TERMINAL CAPABILITIES).  Remote sessions keep the
+// baseline since their terminal is never asked.
+struct TermCaps {
+    bool rep       = false;     // REP, CSI n b: repeat the last glyph
+    bool ech       = false;     // ECH, CSI n X: erase n cells in place
+    bool cuf       = true;      // CUF, CSI n C: cursor right n
+    bool sync      = false;     // DEC mode 2026: synchronized output
+    bool truecolor = false;     // SGR 38;2;r;g;b
+};
+
+static const TermCaps BASELINE_CAPS;
+static TermCaps       g_termCaps;
+
+// ===== BUFFER ARENA ========================================
+//
+// Per-session backing store for the engine buffers of a GameState
+// (cell grid, bitmaps, food list).  Buffers are bumped out of one
+// mapping and freeing them is a no-op; the arena is rewound when a
+// fresh GameState, or a bigger board, asks for buffers again.  A
+// restart therefore lands on memory that is already faulted in and
+// mapped, instead of a malloc/munmap round trip through the page
+// tables per game.
+//
+//   HUGE_NONE   4K pages (MADV_NOHUGEPAGE)
+//   HUGE_THP    transparent huge pages (MADV_HUGEPAGE, 2M aligned)
+//   HUGE_TLB    MAP_HUGETLB from the reserved pool; THP if the pool
+//               is empty or absent
+//
+// One live GameState per arena.  Requests past the end go to the
+// heap, and are told apart by address when freed.
+//
+
+enum HugeMode { HUGE_NONE, HUGE_THP, HUGE_TLB };
+static const char* HUGE_MODE_NAME[] = { "4k", "thp", "hugetlb" };
+static const size_t HUGE_PAGE_BYTES = 2u << 20;
+
+struct BufferArena {
+    uint8_t      *base = nullptr;
+    size_t        size = 0, used = 0, peak = 0;
+    HugeMode      mode = HUGE_NONE;
+    unsigned long rewinds = 0;
+
+    BufferArena() = default;
+    BufferArena(const BufferArena&) = delete;
+    BufferArena &operator=(const BufferArena&) = delete;
+    ~BufferArena() { if (base) munmap(base, size); }
+};
+
+// Maps at least bytes; mode is what was actually obtained
+bool initBufferArena(BufferArena &a, size_t bytes, HugeMode mode) {
+    if (a.base) { munmap(a.base, a.size); a.base = nullptr; }
+    size_t page = mode == HUGE_NONE ? 4096 : HUGE_PAGE_BYTES;
+    size_t size = (std::max(bytes, (size_t)1) + page - 1) & ~(page - 1);
+    void *m = MAP_FAILED;
+    if (mode == HUGE_TLB) {
+        m = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (m == MAP_FAILED) mode = HUGE_THP;
+    }
+    if (m == MAP_FAILED && mode == HUGE_NONE) {
+        m = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (m == MAP_FAILED) return false;
+        madvise(m, size, MADV_NOHUGEPAGE);
+    }
+    if (m == MAP_FAILED) {
+        // over-map so the base can sit on a huge page boundary
+        size_t span = size + HUGE_PAGE_BYTES;
+        uint8_t *raw = (uint8_t*)mmap(nullptr, span, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (raw == MAP_FAILED) return false;
+        uint8_t *al = (uint8_t*)(((uintptr_t)raw + HUGE_PAGE_BYTES - 1) & ~(uintptr_t)(HUGE_PAGE_BYTES - 1));
+        if (al > raw) munmap(raw, al - raw);
+        munmap(al + size, raw + span - (al + size));
+        m = al;
+        madvise(m, size, MADV_HUGEPAGE);
+    }
+    a.base = (uint8_t*)m; a.size = size; a.used = 0; a.peak = 0; a.mode = mode;
+    return true;
+}
+
+static void* bufferAlloc(BufferArena &a, size_t n, size_t align) {
+    size_t at = (a.used + align - 1) & ~(align - 1);
+    if (!a.base || at + n > a.size) return nullptr;
+    a.used = at + n;
+    a.peak = std::max(a.peak, a.used);
+    return a.base + at;
+}
+
+static inline bool bufferOwns(const BufferArena &a, const void *p) {
+    return (const uint8_t*)p >= a.base && (const uint8_t*)p < a.base + a.size;
+}
+
+static void rewindBufferArena(BufferArena &a) { a.used = 0; a.rewinds++; }
+
+// std allocator over an arena (or the heap when it has none)
+template <typename T>
+struct ArenaAllocator {
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+    BufferArena *arena = nullptr;
+
+    ArenaAllocator() = default;
+    explicit ArenaAllocator(BufferArena *a) : arena(a) {}
+    template <typename U> ArenaAllocator(const ArenaAllocator<U> &o) : arena(o.arena) {}
+
+    T* allocate(size_t n) {
+        if (arena)
+            if (void *p = bufferAlloc(*arena, n * sizeof(T), std::max(alignof(T), (size_t)64))) return (T*)p;
+        return (T*)::operator new(n * sizeof(T));
+    }
+    void deallocate(T *p, size_t) {
+        if (!arena || !bufferOwns(*arena, p)) ::operator delete(p);
+    }
+    template <typename U> bool operator==(const ArenaAllocator<U> &o) const { return arena == o.arena; }
+    template <typename U> bool operator!=(const ArenaAllocator<U> &o) const { return arena != o.arena; }
 };
 
+template <typename T> using ArenaVec = std::vector<T, ArenaAllocator<T>>;
+
+// Arena bytes for one GameState's buffers (the shown grid included)
+static size_t gameArenaBytes(int w, int h, int foodTarget) {
+    size_t cells = (size_t)w * h, words = (cells + 63) / 64 + 1;
+    return 2 * cells + 3 * words * sizeof(uint64_t) + (size_t)foodTarget * sizeof(uint32_t) + 6 * 64;
+}
+
 // ─── Game State ─────────────────────────────────────────────
+struct Ghost;
+
 struct GameState {
     std::deque<Point> snake;
-    Point             apple;
     Direction         dir, nextDir;
     int               score;
     int               boardWidth, boardHeight;
@@ -110,15 +326,96 @@ struct GameState {
     long long         moveAccumulator;
     unsigned long     frameCount;
     int               appleFlashTimer, scoreFlashTimer, prevScore;
-    std::vector<char> grid;
+    bool              holdAnim = false;     // redraw for a key without stepping the animation
+    ArenaVec<char>     grid;
+    ArenaVec<uint64_t> occ;         // body occupancy, bit y*boardWidth+x
+    ArenaVec<uint64_t> foodMap;     // food cells, same layout (see FOOD)
+    ArenaVec<uint64_t> goldMap;     // the FOOD_GOLD subset of foodMap
+    ArenaVec<uint32_t> food;        // food cells in spawn order, may hold eaten ones
+    int               foodCount;    // live items on the board
+    int               foodTarget = 1;   // items kept on the board; 1 = classic
     std::string       renderBuf;
+    bool              diffRender = false;   // after a full frame, send changed cells only
+    bool              shownValid = false;   // shownGrid/shownScore match the terminal
+    bool              shownPaused = false;  // the pause overlay is up
+    ArenaVec<char>    shownGrid;            // diffRender only
+    std::string       shownScore;
+    Rng               rng;
+    const Level      *level = nullptr;  // obstacle level, shared; null = open board
+    BufferArena      *arena = nullptr;  // backs the buffers above; null = heap
+    const TermCaps   *caps = &BASELINE_CAPS;  // encodings the renderer may use
+    const Ghost      *ghost = nullptr;  // replay raced alongside (see GHOST RACING)
+    bool              silent = false;   // no sound (attract-mode demo)
+
+    // Before the first initGame; the arena must outlive the state
+    void attachArena(BufferArena *a) {
+        arena = a;
+        grid = ArenaVec<char>(ArenaAllocator<char>(a));
+        occ = ArenaVec<uint64_t>(ArenaAllocator<uint64_t>(a));
+        foodMap = ArenaVec<uint64_t>(ArenaAllocator<uint64_t>(a));
+        goldMap = ArenaVec<uint64_t>(ArenaAllocator<uint64_t>(a));
+        food = ArenaVec<uint32_t>(ArenaAllocator<uint32_t>(a));
+        shownGrid = ArenaVec<char>(ArenaAllocator<char>(a));
+    }
 
     void allocateBuffers() {
-        grid.resize(boardWidth * boardHeight);
-        renderBuf.reserve((boardWidth * 2 + 80) * (boardHeight + 8));
+        size_t cells = (size_t)boardWidth * boardHeight;
+        // one spare word so 16-bit reads at the last cell never run off
+        size_t words = (cells + 63) / 64 + 1;
+        if (arena && (grid.capacity() < cells || occ.capacity() < words ||
+                      food.capacity() < (size_t)foodTarget || (diffRender && shownGrid.capacity() < cells))) {
+            // fresh state or a bigger board: nothing in the arena is live
+            attachArena(arena);
+            rewindBufferArena(*arena);
+        }
+        grid.resize(cells);
+        occ.assign(words, 0);
+        foodMap.assign(words, 0);
+        goldMap.assign(words, 0);
+        food.clear();
+        food.reserve(foodTarget);
+        if (diffRender) shownGrid.resize(cells);
+        else            renderBuf.reserve((boardWidth * 2 + 80) * (boardHeight + 8));
+        shownValid = false;
     }
 };
 
+// ─── Occupancy Bitmap ───────────────────────────────────────
+static inline int  occIndex(const GameState &g, Point p) { return p.y * g.boardWidth + p.x; }
+static inline bool occTest(const GameState &g, Point p) {
+    int i = occIndex(g, p);
+    return (g.occ[i >> 6] >> (i & 63)) & 1;
+}
+static inline void occSet(GameState &g, Point p) {
+    int i = occIndex(g, p);
+    g.occ[i >> 6] |= 1ULL << (i & 63);
+}
+static inline void occClear(GameState &g, Point p) {
+    int i = occIndex(g, p);
+    g.occ[i >> 6] &= ~(1ULL << (i & 63));
+}
+
+template <typename V> static inline bool bitTest(const V &m, int i) { return (m[i >> 6] >> (i & 63)) & 1; }
+template <typename V> static inline void bitSet(V &m, int i)        { m[i >> 6] |= 1ULL << (i & 63); }
+template <typename V> static inline void bitClear(V &m, int i)      { m[i >> 6] &= ~(1ULL << (i & 63)); }
+
+// Blocked by the body or a level wall
+static inline bool blockedTest(const GameState &g, Point p) {
+    int i = occIndex(g, p);
+    uint64_t w = g.occ[i >> 6] | (g.level ? g.level->wall[i >> 6] : 0);
+    return (w >> (i & 63)) & 1;
+}
+
+// Where a head entering p comes out (p itself unless p is a portal)
+static inline Point portalExit(const GameState &g, Point p) {
+    const Level *lv = g.level;
+    if (!lv) return p;
+    int k = lv->portalAt[occIndex(g, p)];
+    if (!k) return p;
+    uint32_t to = lv->portals[k - 1].to;
+    return { (int)(to % lv->width), (int)(to / lv->width) };
+}
+
 // ─── Terminal ───────────────────────────────────────────────
 static struct termios origTermios;
 static bool rawModeEnabled = false;
@@ -167,6 +464,138 @@ void performCleanup() {
 }
 void atexitCleanup() { performCleanup(); }
 
+// ===== METRICS =============================================
+//
+// Optional fleet metrics for hosted deployments:
+//
+//   vsnake --serve ADDR --metrics /var/lib/node_exporter/vsnake.prom
+//   vsnake --serve ADDR --metrics-socket /run/vsnake-metrics.sock
+//
+// Every thread that records gets its own cache-line-aligned
+// MetricShard.  Only that thread writes it, with relaxed loads and
+// stores, so the hot path takes no locks and never bounces a line.
+// The exporter (see Metrics Exporter) sums the shards every
+// --metrics-interval seconds and renders Prometheus text.  It writes
+// the textfile atomically through a rename, or hands the latest
+// snapshot to whoever connects to the socket (plain text, or an HTTP
+// reply for "curl --unix-socket").  Encode-time quantiles are
+// estimated from the histogram delta over the last interval.
+//
+
+static const int METRIC_LATE_SLACK_US  = 1000;     // epoll's timer granularity
+static const int METRIC_ENCODE_BUCKETS = 10;
+static const int METRIC_ENCODE_LE_US[METRIC_ENCODE_BUCKETS - 1] = {
+    10, 25, 50, 100, 250, 500, 1000, 2500, 5000         // last bucket: +Inf
+};
+
+enum MetricCounter {
+    MC_FRAMES, MC_ENCODE_US, MC_BYTES_OUT, MC_TICKS, MC_LATE_US, MC_LATE_TICKS,
+    MC_AUDIO_STARTS, MC_AUDIO_FAILURES, MC_SCORE_WRITES,
+    MC_TURNS_SHOWN, MC_TURN_SHOWN_US, MC_TURNS_MOVED, MC_TURN_MOVED_US,
+    MC_COUNT
+};
+
+struct alignas(64) MetricShard {
+    std::atomic<uint64_t> c[MC_COUNT];
+    std::atomic<uint64_t> encode[METRIC_ENCODE_BUCKETS];
+    MetricShard() {
+        for (auto &v : c) v.store(0, std::memory_order_relaxed);
+        for (auto &v : encode) v.store(0, std::memory_order_relaxed);
+    }
+};
+
+static bool                                      g_metricsOn = false;   // set before any thread starts
+static std::atomic<int>                          g_metricSessions{0};
+static std::mutex                                g_metricShardMu;
+static std::vector<std::unique_ptr<MetricShard>> g_metricShards;        // never freed: counters outlive threads
+static thread_local MetricShard                 *t_metricShard = nullptr;
+
+// This thread's shard; the registration lock is taken once per thread
+static MetricShard &metricShard() {
+    if (!t_metricShard) {
+        std::lock_guard<std::mutex> lk(g_metricShardMu);
+        g_metricShards.emplace_back(new MetricShard());
+        t_metricShard = g_metricShards.back().get();
+    }
+    return *t_metricShard;
+}
+
+// Single writer per shard: a plain load/store, no locked add
+static inline void metricBump(std::atomic<uint64_t> &v, uint64_t n) {
+    v.store(v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+static inline void metricAdd(MetricCounter k, uint64_t n = 1) {
+    if (g_metricsOn) metricBump(metricShard().c[k], n);
+}
+
+static inline void metricEncode(long long us) {
+    if (!g_metricsOn) return;
+    MetricShard &m = metricShard();
+    int b = 0;
+    while (b < METRIC_ENCODE_BUCKETS - 1 && us > METRIC_ENCODE_LE_US[b]) b++;
+    metricBump(m.encode[b], 1);
+    metricBump(m.c[MC_FRAMES], 1);
+    metricBump(m.c[MC_ENCODE_US], (uint64_t)std::max(0LL, us));
+}
+
+// Loop thread, once per scheduled tick; lateUs past its deadline
+static inline void metricTick(long long lateUs) {
+    if (!g_metricsOn) return;
+    MetricShard &m = metricShard();
+    metricBump(m.c[MC_TICKS], 1);
+    if (lateUs <= 0) return;
+    metricBump(m.c[MC_LATE_US], (uint64_t)lateUs);
+    if (lateUs > METRIC_LATE_SLACK_US) metricBump(m.c[MC_LATE_TICKS], 1);
+}
+
+// Local play: a turn key was read at keyAt.  Once when the frame
+// showing it is written, then again when the tick that moves the
+// snake that way has been drawn; the gap is what the head glyph
+// saves.  Turns queued behind another one in the same tick are not
+// timed (the key was not seen as a turn when it arrived).
+struct TurnTimer {
+    long long keyAt = 0;
+    Direction dir   = RIGHT;
+    bool      shown = false;
+};
+
+static void metricTurnPressed(TurnTimer &t, Direction d, long long keyAt) {
+    t.keyAt = keyAt; t.dir = d; t.shown = false;
+}
+
+// After each frame is written
+static void metricTurnFrame(TurnTimer &t, Direction moved) {
+    if (!g_metricsOn || !t.keyAt) return;
+    long long us = std::max(0LL, nowMicros() - t.keyAt);
+    MetricShard &m = metricShard();
+    if (!t.shown) {
+        metricBump(m.c[MC_TURNS_SHOWN], 1);
+        metricBump(m.c[MC_TURN_SHOWN_US], (uint64_t)us);
+        t.shown = true;
+    }
+    if (moved == t.dir) {
+        metricBump(m.c[MC_TURNS_MOVED], 1);
+        metricBump(m.c[MC_TURN_MOVED_US], (uint64_t)us);
+        t.keyAt = 0;
+    }
+}
+
+struct MetricTotals {
+    uint64_t c[MC_COUNT] = {};
+    uint64_t encode[METRIC_ENCODE_BUCKETS] = {};
+};
+
+static MetricTotals sumMetricShards() {
+    MetricTotals t;
+    std::lock_guard<std::mutex> lk(g_metricShardMu);
+    for (auto &m : g_metricShards) {
+        for (int i = 0; i < MC_COUNT; i++) t.c[i] += m->c[i].load(std::memory_order_relaxed);
+        for (int i = 0; i < METRIC_ENCODE_BUCKETS; i++) t.encode[i] += m->encode[i].load(std::memory_order_relaxed);
+    }
+    return t;
+}
+
 // ===== SOUND SYSTEM ========================================
 //
 // Generates WAV audio in-memory and pipes it to aplay/paplay
@@ -234,10 +663,11 @@ static void playWAVAsync(const std::vector<uint8_t>& wav) {
     if (wav.empty()) return;
 
     int pfd[2];
-    if (pipe(pfd) != 0) return;
+    if (pipe(pfd) != 0) { metricAdd(MC_AUDIO_FAILURES); return; }
 
     pid_t pid = fork();
-    if (pid < 0) { close(pfd[0]); close(pfd[1]); return; }
+    if (pid < 0) { close(pfd[0]); close(pfd[1]); metricAdd(MC_AUDIO_FAILURES); return; }
+    metricAdd(MC_AUDIO_STARTS);
 
     if (pid == 0) {
         // ── intermediate child ──
@@ -272,7 +702,7 @@ static void playWAVAsync(const std::vector<uint8_t>& wav) {
     size_t rem = wav.size();
     while (rem > 0) {
         ssize_t n = write(pfd[1], data, rem);
-        if (n <= 0) break;              // EPIPE or error — ignore
+        if (n <= 0) { metricAdd(MC_AUDIO_FAILURES); break; }   // EPIPE or error — count, go on
         data += n;
         rem  -= n;
     }
@@ -327,14 +757,24 @@ inline void soundMenuSelect()  { playWAVAsync(g_wavMenuSelect); }
 inline void soundPauseToggle() { playWAVAsync(g_wavPause); }
 
 // ─── Timestamp ──────────────────────────────────────────────
-std::string getCurrentTimestamp() {
-    time_t now = time(nullptr);
-    struct tm *t = localtime(&now);
+std::string formatTimestamp(time_t when) {
+    struct tm t;
+    localtime_r(&when, &t);
     char buf[64];
-    strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", t);
+    strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &t);
     return std::string(buf);
 }
 
+std::string getCurrentTimestamp() { return formatTimestamp(time(nullptr)); }
+
+static time_t parseTimestamp(const std::string &s) {
+    struct tm t;
+    memset(&t, 0, sizeof(t));
+    if (!strptime(s.c_str(), "%Y-%m-%d %H:%M:%S", &t)) return 0;
+    t.tm_isdst = -1;
+    return mktime(&t);
+}
+
 // ─── XDG Score Path ─────────────────────────────────────────
 static bool ensureDirectoryExists(const std::string &path) {
     struct stat st;
@@ -357,7 +797,8 @@ static bool mkdirRecursive(const std::string &path) {
     return ensureDirectoryExists(path);
 }
 
-static std::string getScoreFilePath() {
+// $XDG_DATA_HOME/vsnake, created on demand; empty if unusable
+static std::string appDataDir() {
     std::string dataDir;
     const char* xdg = getenv("XDG_DATA_HOME");
     if (xdg && xdg[0] != '\0')
@@ -367,20 +808,38 @@ static std::string getScoreFilePath() {
         if (home && home[0] != '\0')
             dataDir = std::string(home) + "/.local/share/" + APP_DIR_NAME;
     }
-    if (!dataDir.empty() && mkdirRecursive(dataDir))
-        return dataDir + "/" + SCORE_FILENAME;
-    return SCORE_FILENAME;
+    return !dataDir.empty() && mkdirRecursive(dataDir) ? dataDir : "";
+}
+
+static std::string getScoreFilePath() {
+    std::string dataDir = appDataDir();
+    return dataDir.empty() ? SCORE_FILENAME : dataDir + "/" + SCORE_FILENAME;
 }
 
 // ─── Leaderboard I/O ───────────────────────────────────────
-void saveScore(int score) {
+// Scores go through the vsnaked daemon when one is listening and
+// straight to the score file otherwise (see LEADERBOARD DAEMON).
+static const int LEADERBOARD_TOP = 10;      // rows on the score screens
+
+bool lbSubmit(int score);
+bool lbQuery(int k, std::vector<ScoreEntry> &out);
+
+static void sortScores(std::vector<ScoreEntry> &scores) {
+    std::sort(scores.begin(), scores.end(),
+              [](const ScoreEntry &a, const ScoreEntry &b) {
+                  if (a.score != b.score) return a.score > b.score;
+                  return a.timestamp > b.timestamp;
+              });
+}
+
+static void appendScoreFile(const std::string &timestamp, int score) {
     std::string path = getScoreFilePath();
     std::ofstream file(path.c_str(), std::ios::app);
     if (file.is_open())
-        file << getCurrentTimestamp() << " | " << score << "\n";
+        file << timestamp << " | " << score << "\n";
 }
 
-std::vector<ScoreEntry> loadScores() {
+static std::vector<ScoreEntry> loadScoreFile() {
     std::string path = getScoreFilePath();
     std::vector<ScoreEntry> scores;
     std::ifstream file(path.c_str());
@@ -396,14 +855,520 @@ std::vector<ScoreEntry> loadScores() {
             }
         }
     }
-    std::sort(scores.begin(), scores.end(),
-              [](const ScoreEntry &a, const ScoreEntry &b) {
-                  if (a.score != b.score) return a.score > b.score;
-                  return a.timestamp > b.timestamp;
-              });
+    sortScores(scores);
     return scores;
 }
 
+void saveScore(int score) {
+    metricAdd(MC_SCORE_WRITES);
+    if (lbSubmit(score)) return;
+    appendScoreFile(getCurrentTimestamp(), score);
+}
+
+// Scores highest first: the daemon's best LEADERBOARD_TOP, or every
+// score in the file when no daemon answers
+std::vector<ScoreEntry> loadScores() {
+    std::vector<ScoreEntry> scores;
+    if (lbQuery(LEADERBOARD_TOP, scores)) return scores;
+    return loadScoreFile();
+}
+
+// ===== LEVELS ==============================================
+//
+//   vsnake --level maze.txt          (also: --serve ADDR --level FILE)
+//
+// Level source is plain text, one row per line, up to
+// BOARD_WIDTH x BOARD_HEIGHT; lines starting with ';' are comments.
+//
+//   #      wall
+//   . or ' ' empty
+//   +      spawn region: apples appear only on '+' cells while any
+//          is free (anywhere free otherwise)
+//   S      snake head at start, moving right; the two cells to its
+//          left must be open (default: board centre)
+//   1-9    portals: exactly two of each digit; entering one exits
+//          through the other, keeping direction
+//
+// A level is parsed once and compiled to a flat file in
+// $XDG_CACHE_HOME/vsnake/levels (LevelFileHeader, then the wall,
+// spawn, portal and no-food masks, the portal pairs and a per-cell
+// byte naming each portal's pair), which is mmapped
+// read-only.  Every GameState on that level -- every session of a
+// --serve process -- points into the one mapping, and other
+// processes share it through the page cache.  The compiled file is
+// rebuilt when the source's size or mtime changes.
+//
+
+static const char LEVEL_MAGIC[8] = { 'V', 'S', 'N', 'L', 'V', 'L', 0, 2 };
+
+struct LevelFileHeader {
+    char     magic[8];
+    uint32_t width, height;
+    int32_t  startX, startY;
+    uint32_t words;                 // per mask
+    uint32_t numPortals;            // LevelPortal entries after the masks
+    uint32_t spawnCells;
+    uint32_t reserved;
+    uint64_t srcSize;
+    int64_t  srcMtime;
+};
+
+static std::string appCacheDir(const char* sub) {
+    const char* xdg = getenv("XDG_CACHE_HOME");
+    if (xdg && xdg[0]) return std::string(xdg) + "/" + APP_DIR_NAME + "/" + sub;
+    const char* home = getenv("HOME");
+    if (home && home[0]) return std::string(home) + "/.cache/" + APP_DIR_NAME + "/" + sub;
+    return "";
+}
+
+static std::string levelCacheDir() { return appCacheDir("levels"); }
+
+// Text -> compiled image; returns false with a message in err
+static bool compileLevel(const std::string &src, const struct stat &st,
+                         std::vector<uint8_t> &image, std::string &err) {
+    std::vector<std::string> rows;
+    std::ifstream in(src.c_str());
+    if (!in.is_open()) { err = "cannot read " + src; return false; }
+    std::string line;
+    while (std::getline(in, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (!line.empty() && line[0] == ';') continue;
+        rows.push_back(line);
+    }
+    while (!rows.empty() && rows.back().find_first_not_of(' ') == std::string::npos) rows.pop_back();
+
+    int h = (int)rows.size(), w = 0;
+    for (auto &r : rows) w = std::max(w, (int)r.size());
+    if (w < 10 || h < 5 || w > BOARD_WIDTH || h > BOARD_HEIGHT) {
+        char m[96];
+        snprintf(m, sizeof(m), "level is %dx%d; must be between 10x5 and %dx%d",
+                 w, h, BOARD_WIDTH, BOARD_HEIGHT);
+        err = m;
+        return false;
+    }
+
+    uint32_t words = (uint32_t)((w * h + 63) / 64 + 1);
+    std::vector<uint64_t> wall(words, 0), spawn(words, 0), portal(words, 0), noFood(words, 0);
+    std::vector<int> ends[10];
+    int sx = -1, sy = -1;
+    uint32_t spawnCells = 0;
+    for (int y = 0; y < h; y++)
+        for (int x = 0; x < w; x++) {
+            char c = x < (int)rows[y].size() ? rows[y][x] : ' ';
+            int i = y * w + x;
+            uint64_t bit = 1ULL << (i & 63);
+            switch (c) {
+                case '#': wall[i >> 6] |= bit; break;
+                case '+': spawn[i >> 6] |= bit; spawnCells++; break;
+                case 'S':
+                    if (sx >= 0) { err = "more than one S"; return false; }
+                    sx = x; sy = y; break;
+                case '.': case ' ': break;
+                default:
+                    if (c >= '1' && c <= '9') { portal[i >> 6] |= bit; ends[c - '0'].push_back(i); break; }
+                    err = std::string("unknown cell '") + c + "' on row " + std::to_string(y + 1);
+                    return false;
+            }
+        }
+
+    std::vector<LevelPortal> pairs;
+    for (int d = 1; d <= 9; d++) {
+        if (ends[d].empty()) continue;
+        if (ends[d].size() != 2) { err = "portal " + std::to_string(d) + " needs exactly two ends"; return false; }
+        pairs.push_back({ (uint32_t)ends[d][0], (uint32_t)ends[d][1] });
+        pairs.push_back({ (uint32_t)ends[d][1], (uint32_t)ends[d][0] });
+    }
+    std::vector<uint8_t> portalAt((size_t)w * h, 0);
+    for (size_t k = 0; k < pairs.size(); k++) portalAt[pairs[k].from] = (uint8_t)(k + 1);
+    for (uint32_t i = 0; i < words; i++) noFood[i] = wall[i] | portal[i];
+
+    auto open = [&](int x, int y) {
+        int i = y * w + x;
+        return x >= 0 && !((wall[i >> 6] | portal[i >> 6]) >> (i & 63) & 1);
+    };
+    if (sx < 0) { sx = w / 2; sy = h / 2; }
+    if (!open(sx, sy) || !open(sx - 1, sy) || !open(sx - 2, sy)) {
+        err = "start needs the head cell and two open cells to its left";
+        return false;
+    }
+
+    LevelFileHeader hd;
+    memset(&hd, 0, sizeof(hd));
+    memcpy(hd.magic, LEVEL_MAGIC, sizeof(hd.magic));
+    hd.width = (uint32_t)w; hd.height = (uint32_t)h;
+    hd.startX = sx; hd.startY = sy;
+    hd.words = words;
+    hd.numPortals = (uint32_t)pairs.size();
+    hd.spawnCells = spawnCells;
+    hd.srcSize = (uint64_t)st.st_size;
+    hd.srcMtime = (int64_t)st.st_mtime;
+
+    size_t maskBytes = words * sizeof(uint64_t);
+    image.resize(sizeof(hd) + 4 * maskBytes + pairs.size() * sizeof(LevelPortal) + portalAt.size());
+    uint8_t *p = image.data();
+    memcpy(p, &hd, sizeof(hd));                 p += sizeof(hd);
+    memcpy(p, wall.data(), maskBytes);          p += maskBytes;
+    memcpy(p, spawn.data(), maskBytes);         p += maskBytes;
+    memcpy(p, portal.data(), maskBytes);        p += maskBytes;
+    memcpy(p, noFood.data(), maskBytes);        p += maskBytes;
+    if (!pairs.empty()) memcpy(p, pairs.data(), pairs.size() * sizeof(LevelPortal));
+    p += pairs.size() * sizeof(LevelPortal);
+    memcpy(p, portalAt.data(), portalAt.size());
+    return true;
+}
+
+// A compiled image is trusted only as far as it is checked here: the
+// board fits the fixed arrays and every index in it stays on the board
+static bool levelImageValid(const uint8_t *base, size_t size) {
+    const LevelFileHeader *hd = (const LevelFileHeader*)base;
+    if (memcmp(hd->magic, LEVEL_MAGIC, sizeof(LEVEL_MAGIC)) != 0) return false;
+    if (hd->width < 10 || hd->height < 5 || hd->width > (uint32_t)BOARD_WIDTH || hd->height > (uint32_t)BOARD_HEIGHT)
+        return false;
+    uint32_t cells = hd->width * hd->height;
+    if (hd->words != (cells + 63) / 64 + 1 || hd->numPortals > 18) return false;
+    if (sizeof(*hd) + 4 * (size_t)hd->words * sizeof(uint64_t) + hd->numPortals * sizeof(LevelPortal) + cells != size)
+        return false;
+    if (hd->startX < 2 || hd->startX >= (int32_t)hd->width || hd->startY < 0 || hd->startY >= (int32_t)hd->height)
+        return false;
+
+    const uint64_t *wall = (const uint64_t*)(base + sizeof(*hd));
+    const uint64_t *portal = wall + 2 * hd->words, *noFood = wall + 3 * hd->words;
+    const LevelPortal *pairs = (const LevelPortal*)(portal + 2 * hd->words);
+    const uint8_t *portalAt = (const uint8_t*)(pairs + hd->numPortals);
+    // as compileLevel requires: the head and the two cells to its left open
+    for (int i = 0; i < 3; i++) {
+        int c = hd->startY * (int)hd->width + hd->startX - i;
+        if (bitTest(wall, c) || bitTest(portal, c)) return false;
+    }
+    for (uint32_t i = 0; i < hd->words; i++)
+        if ((wall[i] | portal[i]) & ~noFood[i]) return false;
+    for (uint32_t k = 0; k < hd->numPortals; k++)
+        if (pairs[k].from >= cells || pairs[k].to >= cells || !bitTest(portal, (int)pairs[k].from)) return false;
+    for (uint32_t i = 0; i < cells; i++)
+        if (portalAt[i] && (portalAt[i] > hd->numPortals || pairs[portalAt[i] - 1].from != i)) return false;
+    return true;
+}
+
+// Maps a compiled image; nullptr unless it is valid and matches st
+static const uint8_t* mapCompiledLevel(const std::string &path, const struct stat &st, size_t &len) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return nullptr;
+    struct stat cs;
+    const uint8_t *base = nullptr;
+    if (fstat(fd, &cs) == 0 && (size_t)cs.st_size >= sizeof(LevelFileHeader)) {
+        void *m = mmap(nullptr, (size_t)cs.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (m != MAP_FAILED) {
+            const LevelFileHeader *hd = (const LevelFileHeader*)m;
+            if (levelImageValid((const uint8_t*)m, (size_t)cs.st_size) &&
+                hd->srcSize == (uint64_t)st.st_size && hd->srcMtime == (int64_t)st.st_mtime) {
+                base = (const uint8_t*)m;
+                len = (size_t)cs.st_size;
+            } else {
+                munmap(m, (size_t)cs.st_size);
+            }
+        }
+    }
+    close(fd);
+    return base;
+}
+
+static const Level *g_playLevel = nullptr;                 // --level
+static int          g_playFood  = 1;                       // --food
+static HugeMode     g_hugeMode  = HUGE_NONE;               // --hugepages
+static bool         g_ghost     = false;                   // --ghost
+static std::string  g_ghostPath;                           // --ghost FILE
+
+static std::mutex g_levelsMu;
+static std::unordered_map<std::string, Level*> g_levels;   // by real path, never unloaded
+
+// Loads (compiling if stale) and returns the shared Level for a
+// source file; nullptr with a message in err on failure
+const Level* openLevel(const std::string &src, std::string &err) {
+    char real[PATH_MAX];
+    if (!realpath(src.c_str(), real)) { err = src + ": " + strerror(errno); return nullptr; }
+    std::lock_guard<std::mutex> lk(g_levelsMu);
+    auto it = g_levels.find(real);
+    if (it != g_levels.end()) return it->second;
+
+    struct stat st;
+    if (stat(real, &st) != 0) { err = src + ": " + strerror(errno); return nullptr; }
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.lvc", (unsigned long long)mix64(std::hash<std::string>()(real)));
+    std::string dir = levelCacheDir();
+    std::string cached = dir.empty() ? "" : dir + "/" + name;
+
+    size_t len = 0;
+    const uint8_t *base = cached.empty() ? nullptr : mapCompiledLevel(cached, st, len);
+    if (!base) {
+        std::vector<uint8_t> image;
+        if (!compileLevel(real, st, image, err)) { err = src + ": " + err; return nullptr; }
+        if (!cached.empty() && mkdirRecursive(dir)) {
+            std::string tmp = cached + "." + std::to_string(getpid());
+            int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            bool ok = fd >= 0 && write(fd, image.data(), image.size()) == (ssize_t)image.size();
+            if (fd >= 0) close(fd);
+            if (ok && rename(tmp.c_str(), cached.c_str()) == 0) base = mapCompiledLevel(cached, st, len);
+            else unlink(tmp.c_str());
+        }
+        if (!base) {                // no cache dir: keep a private copy
+            void *m = mmap(nullptr, image.size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (m == MAP_FAILED) { err = "out of memory"; return nullptr; }
+            memcpy(m, image.data(), image.size());
+            mprotect(m, image.size(), PROT_READ);
+            base = (const uint8_t*)m;
+        }
+    }
+
+    const LevelFileHeader *hd = (const LevelFileHeader*)base;
+    const uint64_t *masks = (const uint64_t*)(base + sizeof(*hd));
+    Level *lv = new Level();
+    lv->width = (int)hd->width; lv->height = (int)hd->height;
+    lv->start = { hd->startX, hd->startY };
+    lv->wall   = masks;
+    lv->spawn  = masks + hd->words;
+    lv->portal = masks + 2 * hd->words;
+    lv->noFood = masks + 3 * hd->words;
+    lv->portals = (const LevelPortal*)(masks + 4 * hd->words);
+    lv->portalAt = (const uint8_t*)(lv->portals + hd->numPortals);
+    lv->numPortals = (int)hd->numPortals;
+    lv->spawnCells = hd->spawnCells;
+    lv->path = real;
+    g_levels.emplace(real, lv);
+    return lv;
+}
+
+// ===== TERMINAL CAPABILITIES ===============================
+//
+// Which cheaper or richer sequences the terminal takes, found once
+// per $TERM and cached in $XDG_CACHE_HOME/vsnake/termcaps/<TERM>:
+//
+//   terminfo   the compiled entry for $TERM (legacy or 32-bit number
+//              format, plus the extended section): rep, ech, cuf,
+//              and the RGB / Tc / Sync extensions
+//   queries    DECRQM ?2026 (synchronized output) followed by DA1.
+//              Every VT-compatible terminal answers DA1, so its reply
+//              ends the wait early; no reply by TERM_PROBE_MS means
+//              "not supported".  A late DA1 still gets another
+//              TERM_PROBE_GRACE_MS, then pending input is flushed so
+//              a reply that trails in cannot reach the game as keys.
+//              A DA1 class of 62+ (VT220) implies ECH.
+//
+// COLORTERM=truecolor|24bit also turns truecolor on, uncached since
+// it can differ between launches under the same $TERM.  --termcaps
+// probes again, rewrites the cache and prints the result.
+//
+
+static const int   TERM_PROBE_MS       = 150;
+static const int   TERM_PROBE_GRACE_MS = 50;
+static const char* TERMCAPS_VERSION    = "vsnake-termcaps 1";
+
+// Caps are the standard terminfo indices (term.h)
+static const int TI_MAX_COLORS = 13;
+static const int TI_ERASE_CHARS = 37, TI_PARM_RIGHT_CURSOR = 112, TI_REPEAT_CHAR = 121;
+
+static const uint8_t* findTerminfo(const std::string &term, std::vector<uint8_t> &data) {
+    std::vector<std::string> dirs;
+    if (const char* t = getenv("TERMINFO")) dirs.push_back(t);
+    if (const char* h = getenv("HOME")) dirs.push_back(std::string(h) + "/.terminfo");
+    if (const char* td = getenv("TERMINFO_DIRS")) {
+        std::stringstream ss(td);
+        std::string d;
+        while (std::getline(ss, d, ':')) if (!d.empty()) dirs.push_back(d);
+    }
+    for (const char* d : { "/etc/terminfo", "/lib/terminfo", "/usr/share/terminfo", "/usr/lib/terminfo" })
+        dirs.push_back(d);
+
+    char hex[8];
+    snprintf(hex, sizeof(hex), "%02x", (unsigned char)term[0]);
+    for (const auto &d : dirs) {
+        for (const std::string &sub : { std::string(1, term[0]), std::string(hex) }) {
+            std::ifstream in((d + "/" + sub + "/" + term).c_str(), std::ios::binary);
+            if (!in) continue;
+            data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+            if (data.size() >= 12) return data.data();
+        }
+    }
+    return nullptr;
+}
+
+static bool parseTerminfo(const std::vector<uint8_t> &d, TermCaps &c) {
+    size_t n = d.size(), at = 0;
+    auto u16 = [&](size_t o) -> int {
+        if (o + 2 > n) return -1;
+        int v = d[o] | (d[o + 1] << 8);
+        return v >= 0x8000 ? v - 0x10000 : v;
+    };
+    int magic = u16(0);
+    if (magic != 0432 && magic != 01036) return false;
+    int numSize = magic == 01036 ? 4 : 2;
+    int namesSz = u16(2), bools = u16(4), nums = u16(6), strs = u16(8), tableSz = u16(10);
+    if (namesSz < 0 || bools < 0 || nums < 0 || strs < 0 || tableSz < 0) return false;
+    at = 12 + namesSz + bools;
+    if (at & 1) at++;
+    size_t numAt = at;
+    at += (size_t)nums * numSize;
+    size_t strAt = at, tableAt = at + (size_t)strs * 2;
+    if (tableAt + tableSz > n) return false;
+
+    auto hasStr = [&](int idx) { return idx < strs && u16(strAt + idx * 2) >= 0; };
+    c.rep = hasStr(TI_REPEAT_CHAR);
+    c.ech = hasStr(TI_ERASE_CHARS);
+    c.cuf = hasStr(TI_PARM_RIGHT_CURSOR);
+    if (TI_MAX_COLORS < nums) {
+        long colors = numSize == 4 ? (long)(int32_t)(d[numAt + 52] | (d[numAt + 53] << 8) | (d[numAt + 54] << 16) |
+                                                     ((uint32_t)d[numAt + 55] << 24))
+                                   : u16(numAt + TI_MAX_COLORS * 2);
+        if (colors >= (1L << 24)) c.truecolor = true;
+    }
+
+    // extended section: names follow the bool, number and string values
+    at = tableAt + tableSz;
+    if (at & 1) at++;
+    int xb = u16(at), xn = u16(at + 2), xs = u16(at + 4), xtSz = u16(at + 8);
+    if (xb < 0 || xn < 0 || xs < 0 || xtSz < 0) return true;
+    size_t xbAt = at + 10;
+    at = xbAt + xb;
+    if (at & 1) at++;
+    at += (size_t)xn * numSize;
+    size_t xsAt = at, xnameAt = xsAt + (size_t)xs * 2;
+    size_t xtAt = xnameAt + (size_t)(xb + xn + xs) * 2;
+    if (xtAt + xtSz > n) return true;
+    size_t namesBase = 0;                       // end of the last string value
+    for (int i = 0; i < xs; i++) {
+        int o = u16(xsAt + i * 2);
+        if (o < 0 || (size_t)o >= (size_t)xtSz) continue;
+        size_t e = o;
+        while (e < (size_t)xtSz && d[xtAt + e]) e++;
+        namesBase = std::max(namesBase, e + 1);
+    }
+    for (int i = 0; i < xb + xn + xs; i++) {
+        int o = u16(xnameAt + i * 2);
+        if (o < 0 || namesBase + o >= (size_t)xtSz) continue;
+        const char* name = (const char*)&d[xtAt + namesBase + o];
+        bool on = i < xb ? d[xbAt + i] == 1 : i >= xb + xn ? u16(xsAt + (i - xb - xn) * 2) >= 0 : false;
+        if (!on) continue;
+        if (strcmp(name, "RGB") == 0 || strcmp(name, "Tc") == 0) c.truecolor = true;
+        if (strcmp(name, "Sync") == 0) c.sync = true;
+    }
+    return true;
+}
+
+// DECRQM ?2026 then DA1, read back until the DA1 reply or the deadline
+static void queryTerminal(TermCaps &c) {
+    if (!isatty(STDIN_FILENO) || !isatty(STDOUT_FILENO)) return;
+    bool wasRaw = rawModeEnabled;
+    if (!wasRaw) enableRawMode();
+    static const char q[] = "\033[?2026$p\033[c";
+    write(STDOUT_FILENO, q, sizeof(q) - 1);
+
+    std::string in;
+    size_t da = std::string::npos;
+    auto readReplies = [&](int ms) {
+        long long deadline = nowMicros() + ms * 1000LL;
+        while (nowMicros() < deadline) {
+            struct pollfd p = { STDIN_FILENO, POLLIN, 0 };
+            int left = (int)((deadline - nowMicros()) / 1000) + 1;
+            if (poll(&p, 1, left) <= 0) break;
+            char b[256];
+            ssize_t r = read(STDIN_FILENO, b, sizeof(b));
+            if (r <= 0) break;
+            in.append(b, r);
+            // DA1: CSI ? Ps ; ... c
+            da = in.find("\033[?");
+            while (da != std::string::npos) {
+                size_t e = in.find_first_not_of("0123456789;", da + 3);
+                if (e != std::string::npos && in[e] == 'c') break;
+                da = in.find("\033[?", da + 3);
+            }
+            if (da != std::string::npos) break;
+        }
+    };
+    readReplies(TERM_PROBE_MS);
+    if (da == std::string::npos) {
+        // A slow terminal's late replies would otherwise be read as
+        // keys: wait a little longer for DA1, then drop what is queued
+        readReplies(TERM_PROBE_GRACE_MS);
+        tcflush(STDIN_FILENO, TCIFLUSH);
+    }
+    if (!wasRaw) disableRawMode();
+
+    // DECRPM: CSI ? 2026 ; Ps $ y, Ps 1 set / 2 reset = recognised
+    size_t rp = in.find("\033[?2026;");
+    if (rp != std::string::npos && rp + 9 < in.size()) {
+        char ps = in[rp + 8];
+        if ((ps == '1' || ps == '2') && in.compare(rp + 9, 2, "$y") == 0) c.sync = true;
+    }
+    if (da != std::string::npos && atoi(in.c_str() + da + 3) >= 62) c.ech = true;
+}
+
+static std::string termCapsPath(const std::string &term) {
+    std::string dir = appCacheDir("termcaps");
+    if (dir.empty()) return "";
+    std::string name;
+    for (char ch : term) name += (isalnum((unsigned char)ch) || ch == '-' || ch == '.' || ch == '+') ? ch : '_';
+    return dir + "/" + name;
+}
+
+static bool loadTermCaps(const std::string &path, TermCaps &c) {
+    std::ifstream in(path.c_str());
+    std::string line;
+    if (!std::getline(in, line) || line != TERMCAPS_VERSION) return false;
+    while (std::getline(in, line)) {
+        size_t eq = line.find('=');
+        if (eq == std::string::npos) continue;
+        std::string k = line.substr(0, eq);
+        bool v = line.compare(eq + 1, std::string::npos, "1") == 0;
+        if (k == "rep") c.rep = v;
+        else if (k == "ech") c.ech = v;
+        else if (k == "cuf") c.cuf = v;
+        else if (k == "sync") c.sync = v;
+        else if (k == "truecolor") c.truecolor = v;
+    }
+    return true;
+}
+
+static void saveTermCaps(const std::string &path, const TermCaps &c) {
+    size_t slash = path.rfind('/');
+    if (slash == std::string::npos || !mkdirRecursive(path.substr(0, slash))) return;
+    std::string tmp = path + "." + std::to_string(getpid());
+    FILE* f = fopen(tmp.c_str(), "w");
+    if (!f) return;
+    fprintf(f, "%s\nrep=%d\nech=%d\ncuf=%d\nsync=%d\ntruecolor=%d\n", TERMCAPS_VERSION,
+            c.rep, c.ech, c.cuf, c.sync, c.truecolor);
+    if (fclose(f) == 0) rename(tmp.c_str(), path.c_str());
+    else unlink(tmp.c_str());
+}
+
+// Cached profile for $TERM, probing (and caching) on a miss
+static TermCaps detectTermCaps(bool reprobe) {
+    TermCaps c;
+    const char* term = getenv("TERM");
+    if (term && term[0] && strcmp(term, "dumb") != 0) {
+        std::string path = termCapsPath(term);
+        if (reprobe || path.empty() || !loadTermCaps(path, c)) {
+            c = TermCaps();
+            std::vector<uint8_t> ti;
+            if (findTerminfo(term, ti)) parseTerminfo(ti, c);
+            queryTerminal(c);
+            if (!path.empty()) saveTermCaps(path, c);
+        }
+    }
+    const char* ct = getenv("COLORTERM");
+    if (ct && (strcmp(ct, "truecolor") == 0 || strcmp(ct, "24bit") == 0)) c.truecolor = true;
+    return c;
+}
+
+// Shortest way to put n copies of ch at the cursor, moving past them
+static void appendRun(std::string &buf, const TermCaps &c, char ch, int n) {
+    if (n <= 0) return;
+    char seq[32];
+    int len = 0;
+    if (c.rep && n > 1)                  len = snprintf(seq, sizeof(seq), "%c\033[%db", ch, n - 1);
+    else if (ch == ' ' && c.ech && c.cuf) len = snprintf(seq, sizeof(seq), "\033[%dX\033[%dC", n, n);
+    if (len > 0 && len < n) buf.append(seq, len);
+    else buf.append(n, ch);
+}
+
 // ─── Movement ───────────────────────────────────────────────
 long long calcBaseInterval(int score) {
     int steps = score / SPEED_SCORE_STEP;
@@ -417,58 +1382,150 @@ long long calcMoveInterval(int score, Direction d) {
     return iv;
 }
 
-// ─── Apple Spawning ─────────────────────────────────────────
-bool spawnApple(GameState &g) {
-    int total = g.boardWidth * g.boardHeight;
-    if ((int)g.snake.size() >= total) return false;
-
-    if ((int)g.snake.size() > total * 3 / 4) {
-        std::vector<char> occ(total, 0);
-        for (auto &s : g.snake) occ[s.y * g.boardWidth + s.x] = 1;
-        std::vector<Point> free;
-        for (int y = 0; y < g.boardHeight; y++)
-            for (int x = 0; x < g.boardWidth; x++)
-                if (!occ[y * g.boardWidth + x]) free.push_back({x, y});
-        if (free.empty()) return false;
-        g.apple = free[rand() % (int)free.size()];
-        g.appleFlashTimer = FLASH_DURATION;
-        return true;
+// ===== FOOD ================================================
+//
+// Any number of food items at once: g.foodTarget of them are kept on
+// the board (1 is the classic single apple).
+//
+//   foodMap   bit per cell, the occupancy layout: eating is one bit
+//             test on the head cell, whatever the item count
+//   goldMap   which of those are FOOD_GOLD
+//   food      compact cell list for the renderer and observations;
+//             eaten entries stay (their foodMap bit is clear) until
+//             the next respawn drops them
+//
+// Eaten items are replaced in batches of foodTarget / FOOD_BATCH_DIV,
+// so the O(items) list compaction is paid once per batch.  A batch is
+// placed in one go: on large boards by bounded random probing (nearly
+// every probe hits on a sparse board), the rest by a single popcount
+// pass that picks distinct free-cell ranks.  Both are uniform over
+// the free cells; small boards skip straight to the pass.
+//
+
+enum FoodKind { FOOD_APPLE, FOOD_GOLD, FOOD_KINDS };
+
+static const int FOOD_SCORE[FOOD_KINDS] = { 10, 50 };
+static const int FOOD_GOLD_ODDS    = 8;     // 1 in N items is gold (foodTarget > 1)
+static const int FOOD_BATCH_DIV    = 32;
+static const int FOOD_SCAN_WORDS   = 256;   // boards up to this many words just scan
+static const int FOOD_SAMPLE_TRIES = 4;     // random probes per item before the scan
+
+static int foodBatch(const GameState &g) { return std::max(1, g.foodTarget / FOOD_BATCH_DIV); }
+
+static void addFood(GameState &g, int cell) {
+    bitSet(g.foodMap, cell);
+    if (g.foodTarget > 1 && g.rng.below(FOOD_GOLD_ODDS) == 0) bitSet(g.goldMap, cell);
+    g.food.push_back((uint32_t)cell);
+    g.foodCount++;
+}
+
+// Removes the item at cell; returns its kind
+static FoodKind eatFood(GameState &g, int cell) {
+    FoodKind k = bitTest(g.goldMap, cell) ? FOOD_GOLD : FOOD_APPLE;
+    bitClear(g.foodMap, cell);
+    bitClear(g.goldMap, cell);
+    g.foodCount--;
+    return k;
+}
+
+// Places up to k items on free cells of a candidate mask (allow, or
+// the whole board; minus body, food and deny); returns how many
+static int placeFood(GameState &g, const uint64_t *allow, const uint64_t *deny, int k) {
+    int total = g.boardWidth * g.boardHeight, words = (total + 63) / 64;
+    auto cand = [&](int w) {
+        uint64_t m = (allow ? allow[w] : ~0ULL) & ~g.occ[w] & ~g.foodMap[w];
+        if (deny) m &= ~deny[w];
+        if (w == words - 1 && (total & 63)) m &= (1ULL << (total & 63)) - 1;
+        return m;
+    };
+    int placed = 0;
+    if (words > FOOD_SCAN_WORDS) {
+        for (int t = k * FOOD_SAMPLE_TRIES; placed < k && t > 0; t--) {
+            int c = g.rng.below(total);
+            if ((cand(c >> 6) >> (c & 63)) & 1) { addFood(g, c); placed++; }
+        }
+        if (placed == k) return placed;
     }
 
-    for (int a = 0; a < APPLE_MAX_TRIES; a++) {
-        Point p = {rand() % g.boardWidth, rand() % g.boardHeight};
-        bool on = false;
-        for (auto &s : g.snake) if (s == p) { on = true; break; }
-        if (!on) { g.apple = p; g.appleFlashTimer = FLASH_DURATION; return true; }
+    int freeCells = 0;
+    for (int w = 0; w < words; w++) freeCells += __builtin_popcountll(cand(w));
+    int need = std::min(k - placed, freeCells);
+    if (need <= 0) return placed;
+
+    // distinct ranks in [0, freeCells), ascending
+    std::vector<int> ranks;
+    if (need == 1) {
+        ranks.push_back(g.rng.below(freeCells));
+    } else if (need * 4 > freeCells) {          // dense: selection sampling
+        for (int r = 0, left = need; left > 0; r++)
+            if (g.rng.below(freeCells - r) < left) { ranks.push_back(r); left--; }
+    } else {
+        while ((int)ranks.size() < need) {
+            while ((int)ranks.size() < need) ranks.push_back(g.rng.below(freeCells));
+            std::sort(ranks.begin(), ranks.end());
+            ranks.erase(std::unique(ranks.begin(), ranks.end()), ranks.end());
+        }
     }
 
-    for (int y = 0; y < g.boardHeight; y++)
-        for (int x = 0; x < g.boardWidth; x++) {
-            Point p = {x, y}; bool on = false;
-            for (auto &s : g.snake) if (s == p) { on = true; break; }
-            if (!on) { g.apple = p; g.appleFlashTimer = FLASH_DURATION; return true; }
+    size_t ri = 0;
+    for (int w = 0, base = 0; w < words && ri < ranks.size(); w++) {
+        uint64_t m = cand(w);
+        int c = __builtin_popcountll(m);
+        for (; ri < ranks.size() && ranks[ri] < base + c; ri++) {
+            uint64_t b = m;
+            for (int r = ranks[ri] - base; r > 0; r--) b &= b - 1;
+            addFood(g, w * 64 + __builtin_ctzll(b));
         }
-    return false;
+        base += c;
+    }
+    return placed + need;
+}
+
+// Tops the board back up to foodTarget, spawn regions first.
+// Returns false once nothing is left to eat (the board is full).
+bool spawnFood(GameState &g) {
+    int want = g.foodTarget - g.foodCount;
+    if (want > 0) {
+        size_t n = 0;
+        for (uint32_t c : g.food) if (bitTest(g.foodMap, (int)c)) g.food[n++] = c;
+        g.food.resize(n);
+
+        const Level *lv = g.level;
+        int placed = 0;
+        if (lv && lv->spawnCells) placed = placeFood(g, lv->spawn, nullptr, want);
+        if (placed < want) placed += placeFood(g, nullptr, lv ? lv->noFood : nullptr, want - placed);
+        if (placed) g.appleFlashTimer = FLASH_DURATION;
+    }
+    return g.foodCount > 0;
 }
 
 // ─── Centering ──────────────────────────────────────────────
 static void calcCenteringOffsets(GameState &g) {
-    int vw = BOARD_WIDTH * 2 + 4;
-    int vh = BOARD_HEIGHT + 5;
+    int vw = g.boardWidth * 2 + 4;
+    int vh = g.boardHeight + 5;
     g.offsetX = std::max(0, (g.termWidth - vw) / 2);
     g.offsetY = std::max(0, (g.termHeight - vh) / 2);
 }
 
 // ─── Init ───────────────────────────────────────────────────
-void initGame(GameState &g) {
-    getTerminalSize(g.termWidth, g.termHeight);
+static void resetGame(GameState &g, uint64_t seed);
+
+// Terminal size passed in so sessions without a tty can share it
+void initGame(GameState &g, uint64_t seed, int termW, int termH) {
+    g.termWidth = termW; g.termHeight = termH;
     g.termTooSmall = (g.termWidth < MIN_TERM_W || g.termHeight < MIN_TERM_H);
-    g.boardWidth = BOARD_WIDTH;
-    g.boardHeight = BOARD_HEIGHT;
+    g.boardWidth  = g.level ? g.level->width  : BOARD_WIDTH;
+    g.boardHeight = g.level ? g.level->height : BOARD_HEIGHT;
     calcCenteringOffsets(g);
+    resetGame(g, seed);
+}
 
+// Everything but the board size and terminal; also used headless on
+// boards of any size
+static void resetGame(GameState &g, uint64_t seed) {
     g.snake.clear();
-    int cx = g.boardWidth / 2, cy = g.boardHeight / 2;
+    int cx = g.level ? g.level->start.x : g.boardWidth / 2;
+    int cy = g.level ? g.level->start.y : g.boardHeight / 2;
     g.snake.push_back({cx, cy});
     g.snake.push_back({cx - 1, cy});
     g.snake.push_back({cx - 2, cy});
@@ -483,10 +1540,23 @@ void initGame(GameState &g) {
     g.moveAccumulator = 0; g.frameCount = 0;
     g.appleFlashTimer = 0; g.scoreFlashTimer = 0; g.prevScore = 0;
 
+    g.rng.seed(seed);
+    g.foodTarget = std::max(1, std::min(g.foodTarget, g.boardWidth * g.boardHeight / 4));
     g.allocateBuffers();
-    spawnApple(g);
+    for (auto &s : g.snake) occSet(g, s);
+    g.foodCount = 0;
+    spawnFood(g);
+}
+
+void initGame(GameState &g, uint64_t seed) {
+    int tw, th; getTerminalSize(tw, th);
+    initGame(g, seed, tw, th);
 }
 
+static uint64_t freshSeed() { return (uint64_t)time(nullptr) ^ ((uint64_t)nowMicros() << 16); }
+
+void initGame(GameState &g) { initGame(g, freshSeed()); }
+
 // ─── Resize Check ───────────────────────────────────────────
 bool checkTerminalResize(GameState &g) {
     int nw, nh; getTerminalSize(nw, nh);
@@ -497,7 +1567,9 @@ bool checkTerminalResize(GameState &g) {
 }
 
 // ─── Direction Change ───────────────────────────────────────
-static void tryChangeDirection(GameState &g, Direction d) {
+// Shared by GameState and multiplayer Snake (same field names).
+template <typename S>
+static void tryChangeDirection(S &g, Direction d) {
     if (!g.dirChangedThisTick) {
         if (!isOpposite(d, g.dir)) {
             g.nextDir = d; g.dirChangedThisTick = true; g.hasQueuedDir = false;
@@ -509,21 +1581,78 @@ static void tryChangeDirection(GameState &g, Direction d) {
     }
 }
 
+// Called after each move: promote a turn that arrived too late for it
+template <typename S>
+static void applyQueuedDirection(S &g) {
+    g.dirChangedThisTick = false;
+    if (g.hasQueuedDir) {
+        if (!isOpposite(g.queuedDir, g.dir) && g.queuedDir != g.dir) {
+            g.nextDir = g.queuedDir;
+            g.dirChangedThisTick = true;
+        }
+        g.hasQueuedDir = false;
+    }
+}
+
 // ─── Input ──────────────────────────────────────────────────
-void readInput(GameState &g) {
-    char c = 0;
-    while (true) {
-        fd_set fds; FD_ZERO(&fds); FD_SET(STDIN_FILENO, &fds);
-        struct timeval tv = {0, 0};
-        if (select(STDIN_FILENO + 1, &fds, nullptr, nullptr, &tv) <= 0) break;
-        if (read(STDIN_FILENO, &c, 1) != 1) break;
+enum ArrowKey { KEY_ARROW_UP = 256, KEY_ARROW_DOWN, KEY_ARROW_LEFT, KEY_ARROW_RIGHT };
+
+static int arrowKey(char final) {
+    switch (final) {
+        case 'A': return KEY_ARROW_UP;   case 'B': return KEY_ARROW_DOWN;
+        case 'D': return KEY_ARROW_LEFT; case 'C': return KEY_ARROW_RIGHT;
+    }
+    return 0;
+}
+
+// Sleeps up to `us`, returning early once a key is waiting
+static void waitForInput(long long us) {
+    fd_set fds; FD_ZERO(&fds); FD_SET(STDIN_FILENO, &fds);
+    struct timeval tv = { (time_t)(us / 1000000), (suseconds_t)(us % 1000000) };
+    select(STDIN_FILENO + 1, &fds, nullptr, nullptr, &tv);
+}
+
+// One waiting byte of stdin, without blocking.  Stdin that selects
+// readable but reads 0 is at EOF or hung up; that exits like SIGINT,
+// since waitForInput would otherwise wake at once forever.
+static bool readKeyByte(char &c) {
+    fd_set fds; FD_ZERO(&fds); FD_SET(STDIN_FILENO, &fds);
+    struct timeval tv = {0, 0};
+    if (select(STDIN_FILENO + 1, &fds, nullptr, nullptr, &tv) <= 0) return false;
+    ssize_t n = read(STDIN_FILENO, &c, 1);
+    if (n == 0) g_interrupted = 1;
+    return n == 1;
+}
+
+// One decoded key (a byte or a KEY_ARROW_*); returns false once the
+// game stops running (quit or restart).  Shared by every
+// single-snake state with the GameState field names.
+template <typename S>
+bool handleGameKey(S &g, int c) {
+    if (c == 'q' || c == 'Q') { g.running = false; return false; }
+    if (c == 'r' || c == 'R') { g.restartRequested = true; g.running = false; return false; }
+    if (c == 'p' || c == 'P') { g.paused = !g.paused; soundPauseToggle(); return true; }
+    if (g.paused) return true;
+    switch (c) {
+        case KEY_ARROW_UP:
+        case 'w': case 'W': case 'k': case 'K': tryChangeDirection(g, UP);    break;
+        case KEY_ARROW_DOWN:
+        case 's': case 'S': case 'j': case 'J': tryChangeDirection(g, DOWN);  break;
+        case KEY_ARROW_LEFT:
+        case 'a': case 'A': case 'h': case 'H': tryChangeDirection(g, LEFT);  break;
+        case KEY_ARROW_RIGHT:
+        case 'd': case 'D': case 'l': case 'L': tryChangeDirection(g, RIGHT); break;
+    }
+    return true;
+}
 
-        if (c == 'q' || c == 'Q') { g.running = false; return; }
-        if (c == 'r' || c == 'R') { g.restartRequested = true; g.running = false; return; }
-        if (c == 'p' || c == 'P') { g.paused = !g.paused; soundPauseToggle(); continue; }
-        if (g.paused) continue;
+template <typename S>
+void readInput(S &g) {
+    char c = 0;
+    while (readKeyByte(c)) {
 
         if (c == '\033') {
+            if (g.paused) continue;
             char seq[2] = {0, 0};
             fd_set f2; struct timeval t2;
             FD_ZERO(&f2); FD_SET(STDIN_FILENO, &f2); t2 = {0, 5000};
@@ -532,22 +1661,10 @@ void readInput(GameState &g) {
             FD_ZERO(&f2); FD_SET(STDIN_FILENO, &f2); t2 = {0, 5000};
             if (select(STDIN_FILENO + 1, &f2, nullptr, nullptr, &t2) > 0)
                 read(STDIN_FILENO, &seq[1], 1);
-            if (seq[0] == '[') {
-                switch (seq[1]) {
-                    case 'A': tryChangeDirection(g, UP);    break;
-                    case 'B': tryChangeDirection(g, DOWN);  break;
-                    case 'D': tryChangeDirection(g, LEFT);  break;
-                    case 'C': tryChangeDirection(g, RIGHT); break;
-                }
-            }
+            if (seq[0] == '[' && arrowKey(seq[1])) handleGameKey(g, arrowKey(seq[1]));
             continue;
         }
-        switch (c) {
-            case 'w': case 'W': case 'k': case 'K': tryChangeDirection(g, UP);    break;
-            case 's': case 'S': case 'j': case 'J': tryChangeDirection(g, DOWN);  break;
-            case 'a': case 'A': case 'h': case 'H': tryChangeDirection(g, LEFT);  break;
-            case 'd': case 'D': case 'l': case 'L': tryChangeDirection(g, RIGHT); break;
-        }
+        if (!handleGameKey(g, (unsigned char)c)) return;
     }
 }
 
@@ -562,137 +1679,768 @@ void updateGame(GameState &g) {
     }
 
     if (nh.x < 0 || nh.x >= g.boardWidth || nh.y < 0 || nh.y >= g.boardHeight) {
-        g.gameOver = true; g.running = false; soundGameOver(); return;
+        g.gameOver = true; g.running = false;
+        if (!g.silent) soundGameOver();
+        return;
     }
-
-    bool growing = (nh == g.apple);
-    int limit = (int)g.snake.size() - (growing ? 0 : 1);
-    for (int i = 0; i < limit; i++) {
-        if (g.snake[i] == nh) {
-            g.gameOver = true; g.running = false; soundGameOver(); return;
-        }
+    nh = portalExit(g, nh);
+
+    // The tail cell is vacated this tick unless we grow, so it is
+    // cleared before the head test and restored if the move is fatal.
+    int cell = occIndex(g, nh);
+    bool growing = bitTest(g.foodMap, cell);
+    if (!growing) occClear(g, g.snake.back());
+    if (blockedTest(g, nh)) {
+        if (!growing) occSet(g, g.snake.back());
+        g.gameOver = true; g.running = false;
+        if (!g.silent) soundGameOver();
+        return;
     }
 
     g.snake.push_front(nh);
+    occSet(g, nh);
     if (growing) {
-        g.score += 10;
-        soundEat();
-        if (!spawnApple(g)) { g.gameWon = true; g.running = false; }
+        g.score += FOOD_SCORE[eatFood(g, cell)];
+        if (!g.silent) soundEat();
+        if (g.foodTarget - g.foodCount >= foodBatch(g) && !spawnFood(g)) {
+            g.gameWon = true; g.running = false;
+        }
     } else {
         g.snake.pop_back();
     }
 }
 
-// ─── Rendering ──────────────────────────────────────────────
-void render(GameState &g) {
-    if (g.score != g.prevScore) {
-        g.scoreFlashTimer = FLASH_DURATION;
-        g.prevScore = g.score;
+// ─── Food Benchmark ─────────────────────────────────────────
+// Headless games on a w x h board at several food densities.  The
+// snake sweeps the board row by row (restarting at the bottom) so it
+// eats at the food density; updateGame is timed separately on plain
+// ticks, eating ticks, and the ticks that trigger a batched respawn.
+// Plain and eating ticks should not move with the item count.
+void runFoodBenchmark(int w, int h, const std::vector<double> &pcts, int ticks) {
+    printf("%6s %9s %9s %9s %9s %9s %8s %10s %8s\n", "food%", "items", "init ms",
+           "ns/tick", "ns/eat", "eats", "batches", "us/batch", "max us");
+    for (double pct : pcts) {
+        BufferArena ar;             // declared first: outlives g's buffers
+        GameState g;
+        g.termWidth = MIN_TERM_W; g.termHeight = MIN_TERM_H;
+        g.boardWidth = w; g.boardHeight = h;
+        g.foodTarget = (int)((double)w * h * pct / 100);
+        if (initBufferArena(ar, gameArenaBytes(w, h, g.foodTarget), g_hugeMode)) g.attachArena(&ar);
+        long long t0 = nowMicros();
+        resetGame(g, 1);
+        long long initUs = nowMicros() - t0;
+
+        long long plainUs = 0, eatUs = 0, batchUs = 0, maxUs = 0;
+        int plain = 0, eats = 0, batches = 0;
+        for (int t = 0; t < ticks; t++) {
+            Point hd = g.snake.front();
+            if (g.dir == DOWN)                                             g.nextDir = hd.x == 0 ? RIGHT : LEFT;
+            else if ((g.dir == RIGHT && hd.x == w - 1) || (g.dir == LEFT && hd.x == 0)) g.nextDir = DOWN;
+            int score = g.score, before = g.foodCount;
+            long long s = nowMicros();
+            updateGame(g);
+            long long us = nowMicros() - s;
+            maxUs = std::max(maxUs, us);
+            if (g.score == score)           { plainUs += us; plain++; }
+            else if (g.foodCount >= before) { batchUs += us; batches++; eats++; }
+            else                            { eatUs += us; eats++; }
+            if (!g.running) resetGame(g, (uint64_t)t);
+        }
+        printf("%6.2f %9d %9.2f %9.1f %9.1f %9d %8d %10.1f %8lld\n", pct, g.foodTarget, initUs / 1000.0,
+               plain ? plainUs * 1000.0 / plain : 0.0, eats > batches ? eatUs * 1000.0 / (eats - batches) : 0.0,
+               eats, batches, batches ? (double)batchUs / batches : 0.0, maxUs);
+        fflush(stdout);
     }
+}
 
-    bool appleFlashing    = g.appleFlashTimer > 0;
-    bool appleVisible     = ((g.frameCount / APPLE_BLINK_HALF) % 2) == 0;
-    bool appleFlashBright = (g.appleFlashTimer > FLASH_DURATION / 2);
-    int headPhase         = (g.frameCount / HEAD_GLOW_PERIOD) % 3;
-    int sparklePhase      = (g.frameCount / APPLE_SPARKLE_RATE) % 3;
+// ─── Observation Encoding ───────────────────────────────────
+//
+// Fixed-shape planes for learning agents, written channel-major
+// (plane, row, col) into caller-owned buffers.  uint8 planes use
+// 0/255, float planes 0/1.  Nothing here allocates.
+//
+//   OBS_VIEW_FULL  whole board, boardWidth x boardHeight
+//   OBS_VIEW_EGO   (2r+1) x (2r+1) window centred on the head;
+//                  off-board cells read as 0 in every plane
+//
+// Body rows are expanded straight from the occupancy bitmap,
+// 16 cells per SSE2 step (scalar fallback elsewhere).
+//
 
-    if (!g.paused) {
-        g.frameCount++;
-        if (g.appleFlashTimer > 0) g.appleFlashTimer--;
-        if (g.scoreFlashTimer > 0) g.scoreFlashTimer--;
+enum ObsPlane {
+    OBS_BODY, OBS_HEAD, OBS_APPLE,
+    OBS_DIR_UP, OBS_DIR_DOWN, OBS_DIR_LEFT, OBS_DIR_RIGHT,
+    OBS_WALL_DIST,
+    OBS_NUM_PLANES
+};
+
+enum ObsView { OBS_VIEW_FULL, OBS_VIEW_EGO };
+
+struct ObsSpec {
+    ObsView view;
+    int     radius;     // EGO only
+};
+
+static inline int obsWidth(const ObsSpec &s, const GameState &g) {
+    return s.view == OBS_VIEW_EGO ? 2 * s.radius + 1 : g.boardWidth;
+}
+static inline int obsHeight(const ObsSpec &s, const GameState &g) {
+    return s.view == OBS_VIEW_EGO ? 2 * s.radius + 1 : g.boardHeight;
+}
+static inline size_t obsSize(const ObsSpec &s, const GameState &g) {
+    return (size_t)OBS_NUM_PLANES * obsWidth(s, g) * obsHeight(s, g);
+}
+
+// Read n <= 16 bits of the bitmap starting at bit index `bit`
+static inline uint32_t occBits16(const uint64_t *occ, int bit, int n) {
+    int w = bit >> 6, o = bit & 63;
+    uint64_t v = occ[w] >> o;
+    if (o > 48) v |= occ[w + 1] << (64 - o);
+    return (uint32_t)v & ((1u << n) - 1);
+}
+
+static inline void obsStore(uint8_t *d, int i, bool on) { d[i] = on ? 255 : 0; }
+static inline void obsStore(float   *d, int i, bool on) { d[i] = on ? 1.0f : 0.0f; }
+
+#if defined(__SSE2__)
+// 16 bits -> 16 bytes of 0x00/0xFF
+static inline __m128i expandBits16(uint32_t bits) {
+    __m128i v = _mm_cvtsi32_si128((int)bits);
+    v = _mm_unpacklo_epi8(v, v);            // lo lo hi hi
+    v = _mm_unpacklo_epi16(v, v);           // lo x4, hi x4
+    v = _mm_unpacklo_epi32(v, v);           // lo x8, hi x8
+    const __m128i sel = _mm_set_epi8((char)0x80, 0x40, 0x20, 0x10, 8, 4, 2, 1,
+                                     (char)0x80, 0x40, 0x20, 0x10, 8, 4, 2, 1);
+    return _mm_cmpeq_epi8(_mm_and_si128(v, sel), sel);
+}
+
+static inline void storeExpanded(uint8_t *d, __m128i m) {
+    _mm_storeu_si128((__m128i*)d, m);
+}
+
+static inline void storeExpanded(float *d, __m128i m) {
+    const __m128 one = _mm_set1_ps(1.0f);
+    __m128i lo = _mm_unpacklo_epi8(m, m), hi = _mm_unpackhi_epi8(m, m);
+    __m128i q[4] = { _mm_unpacklo_epi16(lo, lo), _mm_unpackhi_epi16(lo, lo),
+                     _mm_unpacklo_epi16(hi, hi), _mm_unpackhi_epi16(hi, hi) };
+    for (int k = 0; k < 4; k++)
+        _mm_storeu_ps(d + 4 * k, _mm_and_ps(_mm_castsi128_ps(q[k]), one));
+}
+#endif
+
+// Expand n bits of the bitmap (starting at `bit`) into n plane cells
+template <typename T>
+static void expandOccRow(const uint64_t *occ, int bit, int n, T *dst) {
+    int i = 0;
+#if defined(__SSE2__)
+    for (; i + 16 <= n; i += 16)
+        storeExpanded(dst + i, expandBits16(occBits16(occ, bit + i, 16)));
+#endif
+    for (; i < n; i++) {
+        int b = bit + i;
+        obsStore(dst, i, (occ[b >> 6] >> (b & 63)) & 1);
+    }
+}
+
+template <typename T>
+static void encodeObsImpl(const GameState &g, const ObsSpec &spec, T *out) {
+    int ow = obsWidth(spec, g), oh = obsHeight(spec, g);
+    size_t plane = (size_t)ow * oh;
+    std::fill(out, out + plane * OBS_NUM_PLANES, (T)0);
+
+    Point head = g.snake.front();
+    int x0 = spec.view == OBS_VIEW_EGO ? head.x - spec.radius : 0;
+    int y0 = spec.view == OBS_VIEW_EGO ? head.y - spec.radius : 0;
+
+    // visible board span in window columns
+    int cx0 = std::max(0, -x0), cx1 = std::min(ow, g.boardWidth - x0);
+    int maxDist = (std::min(g.boardWidth, g.boardHeight) + 1) / 2;
+
+    T *dirPlane = out + (OBS_DIR_UP + (int)g.dir) * plane;
+    for (int r = 0; r < oh; r++) {
+        int y = y0 + r;
+        if (y < 0 || y >= g.boardHeight || cx0 >= cx1) continue;
+        T *body = out + OBS_BODY * plane + (size_t)r * ow;
+        expandOccRow(g.occ.data(), y * g.boardWidth + x0 + cx0, cx1 - cx0, body + cx0);
+        for (int c = cx0; c < cx1; c++) obsStore(dirPlane, r * ow + c, true);
+
+        T *wall = out + OBS_WALL_DIST * plane + (size_t)r * ow;
+        int dy = std::min(y + 1, g.boardHeight - y);
+        for (int c = cx0; c < cx1; c++) {
+            int x = x0 + c;
+            int d = std::min(dy, std::min(x + 1, g.boardWidth - x));
+            wall[c] = (sizeof(T) == 1) ? (T)(d * 255 / maxDist) : (T)((float)d / maxDist);
+        }
+    }
+
+    auto mark = [&](int p, Point pt) {
+        int c = pt.x - x0, r = pt.y - y0;
+        if (c >= 0 && c < ow && r >= 0 && r < oh)
+            obsStore(out + p * plane, r * ow + c, true);
+    };
+    mark(OBS_HEAD, head);
+    for (uint32_t c : g.food)
+        if (bitTest(g.foodMap, (int)c)) mark(OBS_APPLE, { (int)c % g.boardWidth, (int)c / g.boardWidth });
+}
+
+static void encodeObservation(const GameState &g, const ObsSpec &spec, uint8_t *out) {
+    encodeObsImpl(g, spec, out);
+}
+static void encodeObservation(const GameState &g, const ObsSpec &spec, float *out) {
+    encodeObsImpl(g, spec, out);
+}
+
+// Batch form: n environments of identical board size, written back to
+// back with stride obsSize(spec, *envs[0]).
+static void encodeObservationBatch(const GameState *const *envs, int n,
+                                   const ObsSpec &spec, uint8_t *out) {
+    if (n <= 0) return;
+    size_t stride = obsSize(spec, *envs[0]);
+    for (int i = 0; i < n; i++) encodeObsImpl(*envs[i], spec, out + i * stride);
+}
+static void encodeObservationBatch(const GameState *const *envs, int n,
+                                   const ObsSpec &spec, float *out) {
+    if (n <= 0) return;
+    size_t stride = obsSize(spec, *envs[0]);
+    for (int i = 0; i < n; i++) encodeObsImpl(*envs[i], spec, out + i * stride);
+}
+
+// ─── Observation Benchmark ──────────────────────────────────
+// Checks the encoder against a cell-by-cell scalar reference over
+// random games (several food counts, full board and EGO windows that
+// fit, straddle and overhang the board), in both element types, then
+// times batched encoding against the reference.  Returns false on
+// any mismatch.
+template <typename T>
+static void encodeObsReference(const GameState &g, const ObsSpec &spec, T *out) {
+    int ow = obsWidth(spec, g), oh = obsHeight(spec, g);
+    size_t plane = (size_t)ow * oh;
+    Point head = g.snake.front();
+    int x0 = spec.view == OBS_VIEW_EGO ? head.x - spec.radius : 0;
+    int y0 = spec.view == OBS_VIEW_EGO ? head.y - spec.radius : 0;
+    int maxDist = (std::min(g.boardWidth, g.boardHeight) + 1) / 2;
+    for (int r = 0; r < oh; r++)
+        for (int c = 0; c < ow; c++) {
+            int x = x0 + c, y = y0 + r, i = r * ow + c;
+            bool on = x >= 0 && x < g.boardWidth && y >= 0 && y < g.boardHeight;
+            int cell = y * g.boardWidth + x;
+            obsStore(out + OBS_BODY * plane, i, on && occTest(g, { x, y }));
+            obsStore(out + OBS_HEAD * plane, i, on && head == Point{ x, y });
+            obsStore(out + OBS_APPLE * plane, i, on && bitTest(g.foodMap, cell));
+            for (int d = 0; d < 4; d++)
+                obsStore(out + (OBS_DIR_UP + d) * plane, i, on && (int)g.dir == d);
+            int dist = on ? std::min(std::min(y + 1, g.boardHeight - y), std::min(x + 1, g.boardWidth - x)) : 0;
+            out[OBS_WALL_DIST * plane + i] = (sizeof(T) == 1) ? (T)(dist * 255 / maxDist)
+                                                               : (T)((float)dist / maxDist);
+        }
+}
+
+bool runObsBenchmark(int states) {
+    static const int SIZES[][2] = { { 40, 20 }, { 37, 23 }, { 128, 96 } };
+    static const ObsSpec SPECS[] = { { OBS_VIEW_FULL, 0 }, { OBS_VIEW_EGO, 3 },
+                                     { OBS_VIEW_EGO, 7 }, { OBS_VIEW_EGO, 64 } };
+    Rng rng; rng.seed(20261018);
+    long checked = 0, bad = 0;
+    for (auto &sz : SIZES) {
+        std::vector<std::unique_ptr<GameState>> envs;
+        for (int e = 0; e < states; e++) {
+            envs.emplace_back(new GameState());
+            GameState &g = *envs.back();
+            g.foodTarget = 1 + (int)rng.below(8);
+            initGame(g, rng.next(), sz[0] * 2 + 10, sz[1] + 6);
+            g.boardWidth = sz[0]; g.boardHeight = sz[1];
+            resetGame(g, rng.next());
+            for (int t = (int)rng.below(400); t > 0 && g.running; t--) {
+                Direction d = (Direction)rng.below(4);
+                if (!isOpposite(d, g.dir)) g.nextDir = d;
+                updateGame(g);
+            }
+            if (!g.running) resetGame(g, rng.next());
+        }
+        for (const ObsSpec &spec : SPECS) {
+            size_t n = obsSize(spec, *envs[0]);
+            std::vector<uint8_t> a8(n), b8(n);
+            std::vector<float>   af(n), bf(n);
+            for (auto &e : envs) {
+                encodeObservation(*e, spec, a8.data());
+                encodeObsReference(*e, spec, b8.data());
+                encodeObservation(*e, spec, af.data());
+                encodeObsReference(*e, spec, bf.data());
+                checked++;
+                if (a8 != b8 || af != bf) bad++;
+            }
+        }
+    }
+    printf("self-check: %ld encodings, %ld mismatches\n", checked, bad);
+
+    printf("%-10s %-8s %-6s %14s %14s %8s\n", "board", "view", "type", "simd enc/s", "scalar enc/s", "speedup");
+    for (auto &sz : SIZES) {
+        std::vector<std::unique_ptr<GameState>> envs;
+        std::vector<const GameState*> ptrs;
+        for (int e = 0; e < 64; e++) {
+            envs.emplace_back(new GameState());
+            initGame(*envs.back(), rng.next(), sz[0] * 2 + 10, sz[1] + 6);
+            envs.back()->boardWidth = sz[0]; envs.back()->boardHeight = sz[1];
+            resetGame(*envs.back(), rng.next());
+            ptrs.push_back(envs.back().get());
+        }
+        auto timeBatch = [&](const ObsSpec &spec, auto *type, const char* typeName) {
+            typedef typename std::remove_pointer<decltype(type)>::type T;
+            size_t n = obsSize(spec, *envs[0]);
+            std::vector<T> out(n * ptrs.size());
+            int reps = std::max(1, 2000000 / (int)n);
+            long long t0 = nowMicros();
+            for (int r = 0; r < reps; r++) encodeObservationBatch(ptrs.data(), (int)ptrs.size(), spec, out.data());
+            long long t1 = nowMicros();
+            for (int r = 0; r < reps; r++)
+                for (size_t i = 0; i < ptrs.size(); i++) encodeObsReference(*ptrs[i], spec, out.data() + i * n);
+            long long t2 = nowMicros();
+            double fast = reps * ptrs.size() * 1e6 / std::max(1LL, t1 - t0);
+            double slow = reps * ptrs.size() * 1e6 / std::max(1LL, t2 - t1);
+            char board[16];
+            snprintf(board, sizeof(board), "%dx%d", sz[0], sz[1]);
+            printf("%-10s %-8s %-6s %14.0f %14.0f %7.1fx\n", board, spec.view == OBS_VIEW_FULL ? "full" : "ego r7",
+                   typeName, fast, slow, fast / slow);
+            fflush(stdout);
+        };
+        for (const ObsSpec &spec : { SPECS[0], SPECS[2] }) {
+            timeBatch(spec, (uint8_t*)nullptr, "uint8");
+            timeBatch(spec, (float*)nullptr, "float");
+        }
+    }
+    return bad == 0;
+}
+
+// ===== GHOST RACING ========================================
+//
+//   vsnake --ghost [FILE]      race a recording (default: your best)
+//
+// Every local single-player game is recorded while it is played, and
+// one that beats the kept recording's score replaces
+// $XDG_DATA_HOME/vsnake/ghost-<board>.vsr (<board> is the level
+// name, or WxH).  A recording is a GhostFileHeader then one byte per
+// move:
+//
+//   bits 0-1  direction moved    bit 2  grew    bit 3  ate gold
+//   bit 7     jumped (portal): the new head cell follows as a u32
+//
+// Replay is streamed.  GHOST_BUF bytes are read at a time as live
+// moves consume them, and only the ghost's current body is kept, so
+// memory and per-tick cost stay the same however long the recording
+// is.  The ghost takes one step per live move.  It is drawn in dim
+// glyphs beneath everything live and, like any other cell, reaches
+// the terminal through the dirty-cell renderer.
+//
+
+static const char GHOST_MAGIC[8] = { 'V', 'S', 'N', 'G', 'H', 'S', 'T', 1 };
+static const int  GHOST_BUF      = 4096;
+
+enum GhostMoveBits { GHOST_GREW = 0x04, GHOST_GOLD = 0x08, GHOST_JUMP = 0x80 };
+
+struct GhostFileHeader {
+    char     magic[8];
+    uint32_t width, height;
+    int32_t  startX, startY;        // head; the body trails to the left
+    uint32_t startLen;
+    uint32_t moves;                 // 0 if the game never finished writing
+    int32_t  score;
+    uint32_t reserved;
+};
+
+struct Ghost {
+    int               fd = -1;
+    GhostFileHeader   hdr;
+    uint8_t           buf[GHOST_BUF];
+    int               len = 0, pos = 0;
+    int               score = 0;
+    bool              finished = false;
+    std::deque<Point> body;
+
+    ~Ghost() { if (fd >= 0) close(fd); }
+};
+
+struct GhostRecorder {
+    int             fd = -1;
+    std::string     tmpPath, path;
+    GhostFileHeader hdr;
+    uint8_t         buf[GHOST_BUF];
+    int             len = 0;
+    Point           lastHead;
+    size_t          lastLen = 0;
+    int             lastScore = 0;
+
+    ~GhostRecorder() { if (fd >= 0) { close(fd); unlink(tmpPath.c_str()); } }
+};
+
+static std::string ghostBestPath(const GameState &g) {
+    std::string dir = appDataDir();
+    if (dir.empty()) return "";
+    std::string key;
+    if (g.level) {
+        size_t slash = g.level->path.rfind('/');
+        key = g.level->path.substr(slash == std::string::npos ? 0 : slash + 1);
+        key = key.substr(0, key.rfind('.'));
+    } else {
+        key = std::to_string(g.boardWidth) + "x" + std::to_string(g.boardHeight);
+    }
+    return dir + "/ghost-" + key + ".vsr";
+}
+
+static bool readGhostHeader(int fd, GhostFileHeader &h) {
+    return pread(fd, &h, sizeof(h), 0) == (ssize_t)sizeof(h) && memcmp(h.magic, GHOST_MAGIC, 8) == 0;
+}
+
+// Next recorded byte, refilling the buffer; false at the end
+static bool ghostByte(Ghost &gh, uint8_t &b) {
+    if (gh.pos == gh.len) {
+        ssize_t n = read(gh.fd, gh.buf, sizeof(gh.buf));
+        if (n <= 0) return false;
+        gh.len = (int)n; gh.pos = 0;
+    }
+    b = gh.buf[gh.pos++];
+    return true;
+}
+
+// Opens a recording for g's board and puts the ghost at its start.
+// The header is checked against the board so the body starts on it.
+static bool openGhost(Ghost &gh, const std::string &path, const GameState &g) {
+    if (path.empty()) return false;
+    gh.fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (gh.fd < 0) return false;
+    const GhostFileHeader &h = gh.hdr;
+    if (!readGhostHeader(gh.fd, gh.hdr) || (int)h.width != g.boardWidth || (int)h.height != g.boardHeight ||
+        h.startLen < 1 || h.startLen > h.width * h.height ||
+        h.startY < 0 || h.startY >= (int)h.height || h.startX >= (int)h.width ||
+        h.startX - ((int64_t)h.startLen - 1) < 0 || lseek(gh.fd, sizeof(gh.hdr), SEEK_SET) < 0) {
+        close(gh.fd); gh.fd = -1;
+        return false;
+    }
+    for (uint32_t i = 0; i < gh.hdr.startLen; i++) gh.body.push_back({ gh.hdr.startX - (int)i, gh.hdr.startY });
+    return true;
+}
+
+// One ghost move, in lockstep with a live one.  A move that would
+// leave the board (or outgrow it) means a corrupt file: the ghost
+// stops there.
+static void stepGhost(Ghost &gh) {
+    uint8_t b;
+    if (gh.finished || !ghostByte(gh, b)) { gh.finished = true; return; }
+    uint32_t w = gh.hdr.width, h = gh.hdr.height;
+    Point nh = stepPoint(gh.body.front(), (Direction)(b & 3));
+    if (b & GHOST_JUMP) {
+        uint8_t c[4];
+        for (int i = 0; i < 4; i++)
+            if (!ghostByte(gh, c[i])) { gh.finished = true; return; }
+        uint32_t cell = c[0] | c[1] << 8 | c[2] << 16 | (uint32_t)c[3] << 24;
+        if (cell >= w * h) { gh.finished = true; return; }
+        nh = { (int)(cell % w), (int)(cell / w) };
+    }
+    if (nh.x < 0 || nh.x >= (int)w || nh.y < 0 || nh.y >= (int)h ||
+        ((b & GHOST_GREW) && gh.body.size() >= (size_t)w * h)) {
+        gh.finished = true;
+        return;
+    }
+    gh.body.push_front(nh);
+    if (b & GHOST_GREW) gh.score += FOOD_SCORE[(b & GHOST_GOLD) ? FOOD_GOLD : FOOD_APPLE];
+    else                gh.body.pop_back();
+}
+
+static void flushGhostRecording(GhostRecorder &rec) {
+    if (rec.fd >= 0 && rec.len > 0 && write(rec.fd, rec.buf, rec.len) != rec.len) {
+        close(rec.fd); rec.fd = -1;
+        unlink(rec.tmpPath.c_str());
+    }
+    rec.len = 0;
+}
+
+// After initGame; recording is skipped quietly if nowhere to write
+static void startGhostRecording(GhostRecorder &rec, const GameState &g) {
+    rec.path = ghostBestPath(g);
+    if (rec.path.empty()) return;
+    rec.tmpPath = rec.path + "." + std::to_string(getpid()) + ".tmp";
+    rec.fd = open(rec.tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (rec.fd < 0) return;
+    memset(&rec.hdr, 0, sizeof(rec.hdr));
+    memcpy(rec.hdr.magic, GHOST_MAGIC, 8);
+    rec.hdr.width = (uint32_t)g.boardWidth; rec.hdr.height = (uint32_t)g.boardHeight;
+    rec.hdr.startX = g.snake.front().x; rec.hdr.startY = g.snake.front().y;
+    rec.hdr.startLen = (uint32_t)g.snake.size();
+    memcpy(rec.buf, &rec.hdr, sizeof(rec.hdr));
+    rec.len = sizeof(rec.hdr);
+    rec.lastHead = g.snake.front();
+    rec.lastLen = g.snake.size();
+    rec.lastScore = g.score;
+}
+
+// After each updateGame; returns whether the snake moved
+static bool recordGhostMove(GhostRecorder &rec, const GameState &g) {
+    Point head = g.snake.front();
+    if (head == rec.lastHead) return false;             // paused, or the move killed it
+    uint8_t b = (uint8_t)g.dir;
+    if (g.snake.size() > rec.lastLen) b |= GHOST_GREW;
+    if (g.score - rec.lastScore >= FOOD_SCORE[FOOD_GOLD]) b |= GHOST_GOLD;
+    bool jump = !(head == stepPoint(rec.lastHead, g.dir));
+    if (jump) b |= GHOST_JUMP;
+    rec.lastHead = head; rec.lastLen = g.snake.size(); rec.lastScore = g.score;
+    if (rec.fd < 0) return true;
+    if (rec.len + 5 > GHOST_BUF) flushGhostRecording(rec);
+    rec.buf[rec.len++] = b;
+    if (jump) {
+        uint32_t cell = (uint32_t)(head.y * g.boardWidth + head.x);
+        memcpy(rec.buf + rec.len, &cell, 4);
+        rec.len += 4;
     }
+    rec.hdr.moves++;
+    return true;
+}
+
+// Keeps the recording if it beats the best one on this board
+static void finishGhostRecording(GhostRecorder &rec, const GameState &g) {
+    flushGhostRecording(rec);
+    if (rec.fd < 0) return;
+    rec.hdr.score = g.score;
+    bool keep = pwrite(rec.fd, &rec.hdr, sizeof(rec.hdr), 0) == (ssize_t)sizeof(rec.hdr);
+    keep = close(rec.fd) == 0 && keep;
+    rec.fd = -1;
+    int old = open(rec.path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (old >= 0) {
+        GhostFileHeader best;
+        if (readGhostHeader(old, best) && best.score >= g.score) keep = false;
+        close(old);
+    }
+    if (!keep || g.score <= 0 || rename(rec.tmpPath.c_str(), rec.path.c_str()) != 0)
+        unlink(rec.tmpPath.c_str());
+}
+
+// ─── Cell Glyphs ────────────────────────────────────────────
+// Every board cell the renderer can draw, as a code into one table;
+// g.grid holds these codes so frames can also be diffed cell by cell.
+enum CellGlyph : uint8_t {
+    CG_EMPTY,
+    CG_HEAD_GREEN, CG_HEAD_CYAN, CG_HEAD_WHITE,
+    CG_BODY_A, CG_BODY_B, CG_BODY_C, CG_BODY_D,
+    CG_APPLE_FLASH_BRIGHT, CG_APPLE_FLASH, CG_APPLE_RED,
+    CG_APPLE_STAR, CG_APPLE_SPARK, CG_APPLE_DIM,
+    CG_WALL, CG_PORTAL, CG_FOOD_GOLD,
+    CG_GHOST_HEAD, CG_GHOST,
+    CG_TURN_UP, CG_TURN_DOWN, CG_TURN_LEFT, CG_TURN_RIGHT,     // head with a turn pending
+    CG_COUNT
+};
+
+static const char* CELL_GLYPH[CG_COUNT] = {
+    "  ",
+    BOLD BRIGHT_GREEN "OO" RESET, BOLD BRIGHT_CYAN "OO" RESET, BOLD BRIGHT_WHITE "OO" RESET,
+    BOLD BRIGHT_GREEN "oo" RESET, BRIGHT_GREEN "oo" RESET, GREEN "oo" RESET, DIM GREEN "oo" RESET,
+    BOLD BRIGHT_WHITE "@@" RESET, BOLD YELLOW "@@" RESET, BOLD RED "@@" RESET,
+    BOLD YELLOW "**" RESET, BOLD BRIGHT_WHITE "##" RESET, DIM RED "@@" RESET,
+    CYAN "##" RESET, BOLD BRIGHT_MAGENTA "()" RESET, BOLD BRIGHT_YELLOW "$$" RESET,
+    DIM "OO" RESET, DIM "::" RESET,
+    BOLD BRIGHT_WHITE "^^" RESET, BOLD BRIGHT_WHITE "vv" RESET,
+    BOLD BRIGHT_WHITE "<<" RESET, BOLD BRIGHT_WHITE ">>" RESET,
+};
 
-    std::fill(g.grid.begin(), g.grid.end(), ' ');
+static CellGlyph appleGlyph(unsigned long frameCount, int appleFlashTimer) {
+    bool appleFlashing    = appleFlashTimer > 0;
+    bool appleVisible     = ((frameCount / APPLE_BLINK_HALF) % 2) == 0;
+    bool appleFlashBright = (appleFlashTimer > FLASH_DURATION / 2);
+    int sparklePhase      = (frameCount / APPLE_SPARKLE_RATE) % 3;
+    if (appleFlashing) return appleFlashBright ? CG_APPLE_FLASH_BRIGHT : CG_APPLE_FLASH;
+    if (!appleVisible) return CG_APPLE_DIM;
+    switch (sparklePhase) {
+        case 0:  return CG_APPLE_RED;
+        case 1:  return CG_APPLE_STAR;
+        default: return CG_APPLE_SPARK;
+    }
+}
+
+// ─── Rendering ──────────────────────────────────────────────
+
+// Fills g.grid with CellGlyph codes; shared by render and broadcast
+static void fillCellGrid(GameState &g, int headPhase, unsigned long animFrame, int appleFlash) {
+    std::fill(g.grid.begin(), g.grid.end(), (char)CG_EMPTY);
+    if (const Level *lv = g.level) {
+        int words = (g.boardWidth * g.boardHeight + 63) / 64;
+        for (int w = 0; w < words; w++) {
+            for (uint64_t m = lv->wall[w]; m; m &= m - 1)   g.grid[w * 64 + __builtin_ctzll(m)] = (char)CG_WALL;
+            for (uint64_t m = lv->portal[w]; m; m &= m - 1) g.grid[w * 64 + __builtin_ctzll(m)] = (char)CG_PORTAL;
+        }
+    }
+    if (const Ghost *gh = g.ghost) {
+        char glyph = (char)CG_GHOST_HEAD;
+        for (const Point &p : gh->body) { g.grid[p.y * g.boardWidth + p.x] = glyph; glyph = (char)CG_GHOST; }
+    }
     int bodyLen = (int)g.snake.size() - 1;
     for (size_t i = 1; i < g.snake.size(); i++) {
         int seg = (int)i - 1;
         int zone = (bodyLen <= 0) ? 0 : (seg * 4 / bodyLen);
         if (zone > 3) zone = 3;
-        g.grid[g.snake[i].y * g.boardWidth + g.snake[i].x] = (char)('a' + zone);
+        g.grid[g.snake[i].y * g.boardWidth + g.snake[i].x] = (char)(CG_BODY_A + zone);
     }
-    g.grid[g.snake.front().y * g.boardWidth + g.snake.front().x] = 'H';
-    g.grid[g.apple.y * g.boardWidth + g.apple.x] = '@';
+    // An accepted turn shows on the head at once, ahead of the move
+    // that applies it: a one-cell change for the dirty-cell renderer
+    char head = g.nextDir != g.dir ? (char)(CG_TURN_UP + g.nextDir) : (char)(CG_HEAD_GREEN + headPhase);
+    g.grid[g.snake.front().y * g.boardWidth + g.snake.front().x] = head;
+    char apple = (char)appleGlyph(animFrame, appleFlash);
+    char gold  = appleFlash > 0 ? apple : (char)CG_FOOD_GOLD;
+    for (uint32_t c : g.food)
+        if (bitTest(g.foodMap, (int)c)) g.grid[c] = bitTest(g.goldMap, (int)c) ? gold : apple;
+}
+
+// Score flash for truecolor terminals: the same white -> bright green
+// -> green -> yellow fade as the 16-colour steps, but continuous
+static void appendFlashColor(std::string &buf, float ratio) {
+    static const uint8_t STOP[4][3] = { {205, 205, 0}, {0, 170, 0}, {85, 255, 85}, {255, 255, 255} };
+    float t = std::min(std::max(ratio, 0.0f), 1.0f) * 3;
+    int i = std::min((int)t, 2);
+    float f = t - i;
+    char seq[32];
+    snprintf(seq, sizeof(seq), "\033[38;2;%d;%d;%dm",
+             (int)(STOP[i][0] + (STOP[i + 1][0] - STOP[i][0]) * f),
+             (int)(STOP[i][1] + (STOP[i + 1][1] - STOP[i][1]) * f),
+             (int)(STOP[i][2] + (STOP[i + 1][2] - STOP[i][2]) * f));
+    buf += seq;
+}
+
+// Centred score (and ghost score) in the flash colour, no line end
+static void appendScoreLine(const GameState &g, std::string &buf) {
+    const TermCaps &caps = *g.caps;
+    char text[64];
+    int n = snprintf(text, sizeof(text), "Score: %d", g.score);
+    if (g.ghost)
+        snprintf(text + n, sizeof(text) - n, "   Ghost: %d%s", g.ghost->score, g.ghost->finished ? " (done)" : "");
+    appendRun(buf, caps, ' ', (g.termWidth - (int)strlen(text)) / 2);
+    if (g.scoreFlashTimer > 0) {
+        float ratio = (float)g.scoreFlashTimer / FLASH_DURATION;
+        if (caps.truecolor) {
+            buf += BOLD;
+            appendFlashColor(buf, ratio);
+        }
+        else if (ratio > 0.75f) buf += BOLD BRIGHT_WHITE;
+        else if (ratio > 0.5f)  buf += BOLD BRIGHT_GREEN;
+        else if (ratio > 0.25f) buf += BOLD GREEN;
+        else                    buf += YELLOW;
+    } else {
+        buf += BOLD YELLOW;
+    }
+    buf += text;
+    buf += RESET;
+}
 
+// Dirty-cell frame: the score line if it changed, then each cell that
+// differs from what the terminal shows, skipping cursor moves along
+// runs of neighbouring cells.  False if nothing differed.
+static bool renderChangedCells(GameState &g) {
     std::string &buf = g.renderBuf;
-    buf.clear();
-    buf += "\033[1;1H";
+    char pos[32];
+    size_t mark = buf.size();
+    snprintf(pos, sizeof(pos), "\033[%d;1H", g.offsetY + 1);
+    buf += pos;
+    size_t line = buf.size();
+    appendScoreLine(g, buf);
+    if (buf.compare(line, std::string::npos, g.shownScore) == 0) {
+        buf.resize(mark);
+    } else {
+        g.shownScore.assign(buf, line, std::string::npos);
+        buf += ERASE_LINE;
+    }
 
-    int vbw = g.boardWidth * 2 + 4;
-    std::string hpad(g.offsetX, ' ');
+    int w = g.boardWidth, cursor = -1;
+    for (int i = 0, n = w * g.boardHeight; i < n; i++) {
+        if (g.grid[i] == g.shownGrid[i]) continue;
+        if (i != cursor) {
+            snprintf(pos, sizeof(pos), "\033[%d;%dH", g.offsetY + 3 + i / w, g.offsetX + 3 + (i % w) * 2);
+            buf += pos;
+        }
+        buf += CELL_GLYPH[(uint8_t)g.grid[i]];
+        g.shownGrid[i] = g.grid[i];
+        cursor = (i % w == w - 1) ? -1 : i + 1;
+    }
+    return buf.size() != mark;
+}
 
-    char scoreCStr[32];
-    snprintf(scoreCStr, sizeof(scoreCStr), "Score: %d", g.score);
-    int scoreVisLen = (int)strlen(scoreCStr);
+// This frame's g.grid, then the animation timers advance (unless
+// paused or holdAnim)
+static void fillFrameGrid(GameState &g) {
+    if (g.score != g.prevScore) {
+        g.scoreFlashTimer = FLASH_DURATION;
+        g.prevScore = g.score;
+    }
 
-    for (int r = 0; r < g.offsetY; r++) buf += ERASE_LINE "\n";
+    int headPhase         = (g.frameCount / HEAD_GLOW_PERIOD) % 3;
+    unsigned long animFrame = g.frameCount;
+    int appleFlash        = g.appleFlashTimer;
 
-    {
-        int pad = std::max(0, (g.termWidth - scoreVisLen) / 2);
-        for (int i = 0; i < pad; i++) buf += ' ';
-        if (g.scoreFlashTimer > 0) {
-            float ratio = (float)g.scoreFlashTimer / FLASH_DURATION;
-            if (ratio > 0.75f)      buf += BOLD BRIGHT_WHITE;
-            else if (ratio > 0.5f)  buf += BOLD BRIGHT_GREEN;
-            else if (ratio > 0.25f) buf += BOLD GREEN;
-            else                    buf += YELLOW;
-        } else {
-            buf += BOLD YELLOW;
-        }
-        buf += scoreCStr;
-        buf += RESET;
+    if (!g.paused && !g.holdAnim) {
+        g.frameCount++;
+        if (g.appleFlashTimer > 0) g.appleFlashTimer--;
+        if (g.scoreFlashTimer > 0) g.scoreFlashTimer--;
     }
-    buf += ERASE_LINE "\n";
 
-    buf += hpad; buf += CYAN;
-    for (int i = 0; i < vbw; i++) buf += '#';
+    fillCellGrid(g, headPhase, animFrame, appleFlash);
+}
+
+// Top border, board rows and bottom border, each ending its line
+static void appendBoardLines(const GameState &g, std::string &buf) {
+    const TermCaps &caps = *g.caps;
+    int vbw = g.boardWidth * 2 + 4;
+
+    appendRun(buf, caps, ' ', g.offsetX);
+    buf += CYAN;
+    appendRun(buf, caps, '#', vbw);
     buf += RESET ERASE_LINE "\n";
 
     for (int y = 0; y < g.boardHeight; y++) {
-        buf += hpad;
+        appendRun(buf, caps, ' ', g.offsetX);
         buf += CYAN "##" RESET;
-        int base = y * g.boardWidth;
-        for (int x = 0; x < g.boardWidth; x++) {
-            char c = g.grid[base + x];
-            switch (c) {
-                case 'H':
-                    switch (headPhase) {
-                        case 0: buf += BOLD BRIGHT_GREEN "OO" RESET; break;
-                        case 1: buf += BOLD BRIGHT_CYAN  "OO" RESET; break;
-                        case 2: buf += BOLD BRIGHT_WHITE "OO" RESET; break;
-                    }
-                    break;
-                case 'a': buf += BOLD BRIGHT_GREEN "oo" RESET; break;
-                case 'b': buf += BRIGHT_GREEN      "oo" RESET; break;
-                case 'c': buf += GREEN             "oo" RESET; break;
-                case 'd': buf += DIM GREEN         "oo" RESET; break;
-                case '@':
-                    if (appleFlashing) {
-                        if (appleFlashBright) buf += BOLD BRIGHT_WHITE "@@" RESET;
-                        else                  buf += BOLD YELLOW       "@@" RESET;
-                    } else if (appleVisible) {
-                        switch (sparklePhase) {
-                            case 0: buf += BOLD RED          "@@" RESET; break;
-                            case 1: buf += BOLD YELLOW       "**" RESET; break;
-                            case 2: buf += BOLD BRIGHT_WHITE "##" RESET; break;
-                        }
-                    } else {
-                        buf += DIM RED "@@" RESET;
-                    }
-                    break;
-                default: buf += "  "; break;
-            }
+        const char* row = &g.grid[y * g.boardWidth];
+        for (int x = 0; x < g.boardWidth; ) {
+            if (row[x] != CG_EMPTY) { buf += CELL_GLYPH[(uint8_t)row[x++]]; continue; }
+            int run = x;
+            while (run < g.boardWidth && row[run] == CG_EMPTY) run++;
+            appendRun(buf, caps, ' ', (run - x) * 2);
+            x = run;
         }
         buf += CYAN "##" RESET ERASE_LINE "\n";
     }
 
-    buf += hpad; buf += CYAN;
-    for (int i = 0; i < vbw; i++) buf += '#';
+    appendRun(buf, caps, ' ', g.offsetX);
+    buf += CYAN;
+    appendRun(buf, caps, '#', vbw);
     buf += RESET ERASE_LINE "\n";
+}
+
+// Builds the frame into g.renderBuf; render() writes it out.  False
+// (and an empty buffer) when a diffRender state has nothing to change.
+bool renderFrame(GameState &g) {
+    fillFrameGrid(g);
+
+    std::string &buf = g.renderBuf;
+    const TermCaps &caps = *g.caps;
+    buf.clear();
+    if (caps.sync) buf += "\033[?2026h";
+
+    if (g.diffRender && g.paused && g.shownPaused) { buf.clear(); return false; }
+    bool keyframe = !g.diffRender || !g.shownValid || g.paused ||
+                    g.shownGrid.size() != g.grid.size() || (!g.holdAnim && g.frameCount % RENDER_KEYFRAME == 0);
+    if (!keyframe) {
+        if (!renderChangedCells(g)) { buf.clear(); return false; }
+        if (caps.sync) buf += "\033[?2026l";
+        return true;
+    }
+    buf += "\033[1;1H";
+
+    for (int r = 0; r < g.offsetY; r++) buf += ERASE_LINE "\n";
+
+    size_t line = buf.size();
+    appendScoreLine(g, buf);
+    g.shownScore.assign(buf, line, std::string::npos);
+    buf += ERASE_LINE "\n";
+
+    appendBoardLines(g, buf);
 
     {
         const char* t = "Move: WASD/HJKL/Arrows | P: Pause | R: Restart | Q: Menu";
-        int pad = std::max(0, (g.termWidth - (int)strlen(t)) / 2);
-        for (int i = 0; i < pad; i++) buf += ' ';
+        appendRun(buf, caps, ' ', (g.termWidth - (int)strlen(t)) / 2);
         buf += CYAN; buf += t; buf += RESET;
     }
     buf += ERASE_LINE "\n";
@@ -711,8 +2459,116 @@ void render(GameState &g) {
         buf += pm;
         buf += RESET;
     }
+    if (caps.sync) buf += "\033[?2026l";
+    if (g.diffRender) {
+        g.shownGrid.assign(g.grid.begin(), g.grid.end());
+        g.shownValid = !g.paused;           // the overlay hides cells
+        g.shownPaused = g.paused;
+    }
+    return true;
+}
 
-    write(STDOUT_FILENO, buf.c_str(), buf.size());
+void render(GameState &g) {
+    long long t0 = g_metricsOn ? nowMicros() : 0;
+    bool drew = renderFrame(g);
+    if (g_metricsOn) metricEncode(nowMicros() - t0);
+    if (!drew) return;
+    ssize_t n = write(STDOUT_FILENO, g.renderBuf.c_str(), g.renderBuf.size());
+    if (n > 0) metricAdd(MC_BYTES_OUT, (uint64_t)n);
+}
+
+// ─── Restart Benchmark ──────────────────────────────────────
+// Restarts a w x h game the way main does (a fresh GameState per
+// game) with heap buffers and with a reused BufferArena per page
+// mode.  Each game runs a workload: a row sweep of updateGame ticks,
+// one fillCellGrid and 1M random cell probes (grid + bitmaps), with
+// dTLB load misses counted by perf when the kernel allows it.
+static int openDtlbMissCounter() {
+    struct perf_event_attr pe;
+    memset(&pe, 0, sizeof(pe));
+    pe.size = sizeof(pe);
+    pe.type = PERF_TYPE_HW_CACHE;
+    pe.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    pe.disabled = 1;
+    pe.exclude_kernel = 1;
+    pe.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &pe, 0, -1, -1, 0);
+}
+
+static long minorFaults() {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_minflt;
+}
+
+void runRestartBenchmark(int w, int h, double foodPct, int restarts) {
+    int target = std::max(1, (int)((double)w * h * foodPct / 100));
+    int tlbFd = openDtlbMissCounter();
+    printf("board %dx%d, %d food, %d restarts, %d ticks + 1M probes per game%s\n", w, h, target,
+           restarts, w * 4, tlbFd < 0 ? " (dTLB counter unavailable)" : "");
+    printf("%-8s %-11s %12s %12s %12s %12s %14s\n", "buffers", "pages", "first ms", "restart ms",
+           "faults/rst", "work ms", "dTLB miss/game");
+    const int configs[] = { -1, HUGE_NONE, HUGE_THP, HUGE_TLB };
+    for (int cfg : configs) {
+        BufferArena ar;
+        if (cfg >= 0 && !initBufferArena(ar, gameArenaBytes(w, h, target), (HugeMode)cfg)) {
+            printf("%-8s %-11s %12s\n", "arena", HUGE_MODE_NAME[cfg], "mmap failed");
+            continue;
+        }
+        double firstMs = 0, restartMs = 0, workMs = 0;
+        long faults = 0;
+        long long tlbMiss = 0;
+        for (int r = 0; r < restarts; r++) {
+            GameState g;
+            if (cfg >= 0) g.attachArena(&ar);
+            g.termWidth = MIN_TERM_W; g.termHeight = MIN_TERM_H;
+            g.boardWidth = w; g.boardHeight = h;
+            g.foodTarget = target;
+            long f0 = minorFaults();
+            long long t0 = nowMicros();
+            resetGame(g, (uint64_t)r + 1);
+            double ms = (nowMicros() - t0) / 1000.0;
+            if (r == 0) firstMs = ms;
+            else { restartMs += ms; faults += minorFaults() - f0; }
+
+            if (tlbFd >= 0) { ioctl(tlbFd, PERF_EVENT_IOC_RESET, 0); ioctl(tlbFd, PERF_EVENT_IOC_ENABLE, 0); }
+            t0 = nowMicros();
+            for (int t = 0; t < w * 4 && g.running; t++) {
+                Point hd = g.snake.front();
+                if (g.dir == DOWN) g.nextDir = hd.x == 0 ? RIGHT : LEFT;
+                else if ((g.dir == RIGHT && hd.x == w - 1) || (g.dir == LEFT && hd.x == 0)) g.nextDir = DOWN;
+                updateGame(g);
+            }
+            fillCellGrid(g, 0, 0, 0);
+            Rng probe; probe.seed((uint64_t)r);
+            unsigned hits = 0;
+            for (int k = 0; k < 1000000; k++) {
+                int c = probe.below(w * h);
+                hits += g.grid[c] != CG_EMPTY;
+                hits += bitTest(g.occ, c) + bitTest(g.foodMap, c);
+            }
+            workMs += (nowMicros() - t0) / 1000.0 + (hits == 0xFFFFFFFFu);
+            if (tlbFd >= 0) {
+                ioctl(tlbFd, PERF_EVENT_IOC_DISABLE, 0);
+                long long v = 0;
+                if (read(tlbFd, &v, sizeof(v)) == (ssize_t)sizeof(v)) tlbMiss += v;
+            }
+        }
+        int rest = std::max(1, restarts - 1);
+        char tlb[32];
+        if (tlbFd >= 0) snprintf(tlb, sizeof(tlb), "%lld", tlbMiss / restarts);
+        else snprintf(tlb, sizeof(tlb), "-");
+        char pages[32];
+        if (cfg < 0) snprintf(pages, sizeof(pages), "malloc");
+        else if (ar.mode == cfg) snprintf(pages, sizeof(pages), "%s", HUGE_MODE_NAME[cfg]);
+        else snprintf(pages, sizeof(pages), "%s>%s", HUGE_MODE_NAME[cfg], HUGE_MODE_NAME[ar.mode]);
+        printf("%-8s %-11s %12.2f %12.2f %12ld %12.2f %14s\n", cfg < 0 ? "heap" : "arena",
+               pages, firstMs, restartMs / rest,
+               faults / rest, workMs / restarts, tlb);
+        fflush(stdout);
+    }
+    if (tlbFd >= 0) close(tlbFd);
 }
 
 // ─── Centering Helpers ──────────────────────────────────────
@@ -726,12 +2582,252 @@ static std::string centerColorText(const std::string &s, int vl, int tw) {
 }
 
 static void flushInput() {
-    char d; fd_set fds; struct timeval tv;
-    while (true) {
-        FD_ZERO(&fds); FD_SET(STDIN_FILENO, &fds); tv = {0, 0};
-        if (select(STDIN_FILENO + 1, &fds, nullptr, nullptr, &tv) <= 0) break;
-        read(STDIN_FILENO, &d, 1);
+    char d;
+    while (readKeyByte(d)) {}
+}
+
+// ===== ATTRACT MODE =======================================
+//
+// The start menu floats over a live demo: a headless, silent game
+// played by the self-play bot (see SELF-PLAY DATASETS) on the normal
+// board, restarting a moment after it dies.  The menu sits in a
+// fixed panel of ATTRACT_PANEL_H rows by ATTRACT_PANEL_W columns
+// centred on the board.
+//
+// After the first full frame everything goes out as a diff.  The
+// board uses the dirty-cell renderer.  Cells under the panel are held
+// at their shown value, so the diff never draws over the menu.  Only
+// panel rows whose text changed are rewritten.  A restarting demo
+// keeps its diff base, since the board and terminal are unchanged.
+// An idle menu writes a few dozen bytes per frame, and its CPU cost
+// is what --attract-bench measures.
+//
+
+static const int ATTRACT_PANEL_W        = 46;
+static const int ATTRACT_PANEL_H        = 14;
+static const int ATTRACT_RESTART_FRAMES = 45;       // ~1.5 s on the final position
+
+static Direction selfPlayAction(const GameState &g, Rng &rng);
+
+struct AttractMenu {
+    GameState   game;
+    Rng         bot;
+    std::string rows[ATTRACT_PANEL_H];         // panel text, padded to ATTRACT_PANEL_W
+    std::string shownRows[ATTRACT_PANEL_H];
+    int         panelRow = 1, panelCol = 1;    // top-left, 1-based
+    int         restartIn = 0;                 // frames left on a finished demo
+    long long   lastStep = 0;
+};
+
+// (Re)starts the demo for a tw x th terminal; the next frame is full
+static void startAttract(AttractMenu &m, int tw, int th, long long now) {
+    GameState &g = m.game;
+    g.diffRender = true;
+    g.silent = true;
+    g.caps = &g_termCaps;
+    initGame(g, freshSeed(), tw, th);
+    m.bot.seed(g.rng.next());
+    m.panelRow = std::max(1, (th - ATTRACT_PANEL_H) / 2 + 1);
+    m.panelCol = std::max(1, (tw - ATTRACT_PANEL_W) / 2 + 1);
+    for (auto &r : m.shownRows) r.clear();
+    m.restartIn = 0;
+    m.lastStep = now;
+}
+
+// Styled text centred in a panel row, padded to cover the board
+static void setPanelRow(AttractMenu &m, int row, const std::string &styled, int vis) {
+    int left = std::max(0, (ATTRACT_PANEL_W - vis) / 2);
+    std::string &r = m.rows[row];
+    r.assign(left, ' ');
+    r += styled;
+    r.append(std::max(0, ATTRACT_PANEL_W - vis - left), ' ');
+}
+
+// Advances the demo to `now`, the bot choosing each move
+static void stepAttract(AttractMenu &m, long long now) {
+    GameState &g = m.game;
+    long long dt = now - m.lastStep;
+    m.lastStep = now;
+    if (!g.running) {
+        if (--m.restartIn > 0) return;
+        resetGame(g, g.rng.next());
+        g.shownValid = true;            // same board, same terminal: still a valid diff base
+        return;
+    }
+    g.moveAccumulator += dt;
+    long long mi = calcMoveInterval(g.score, g.dir);
+    if (g.moveAccumulator > mi * 3) g.moveAccumulator = mi;
+    while (g.moveAccumulator >= mi) {
+        g.nextDir = selfPlayAction(g, m.bot);
+        updateGame(g);
+        if (!g.running) { m.restartIn = ATTRACT_RESTART_FRAMES; return; }
+        g.moveAccumulator -= mi;
+        mi = calcMoveInterval(g.score, g.dir);
+    }
+}
+
+// Builds the frame into game.renderBuf; false if nothing changed
+static bool renderAttract(AttractMenu &m) {
+    GameState &g = m.game;
+    std::string &buf = g.renderBuf;
+    const TermCaps &caps = *g.caps;
+    fillFrameGrid(g);
+    buf.clear();
+    if (caps.sync) buf += "\033[?2026h";
+    size_t mark = buf.size();
+
+    if (!g.shownValid || (!g.holdAnim && g.frameCount % RENDER_KEYFRAME == 0)) {
+        buf += "\033[1;1H";
+        for (int r = 0; r < g.offsetY; r++) buf += ERASE_LINE "\n";
+        size_t line = buf.size();
+        appendScoreLine(g, buf);
+        g.shownScore.assign(buf, line, std::string::npos);
+        buf += ERASE_LINE "\n";
+        appendBoardLines(g, buf);
+        buf += ERASE_BELOW;
+        g.shownGrid.assign(g.grid.begin(), g.grid.end());
+        g.shownValid = true;
+        for (auto &r : m.shownRows) r.clear();
+    } else {
+        int w = g.boardWidth, top = g.offsetY + 3, left = g.offsetX + 3;
+        for (int y = std::max(0, m.panelRow - top);
+             y < std::min(g.boardHeight, m.panelRow + ATTRACT_PANEL_H - top); y++)
+            for (int x = 0; x < w; x++) {
+                int col = left + 2 * x;
+                if (col + 1 >= m.panelCol && col < m.panelCol + ATTRACT_PANEL_W)
+                    g.grid[y * w + x] = g.shownGrid[y * w + x];
+            }
+        renderChangedCells(g);
+    }
+
+    char pos[32];
+    for (int i = 0; i < ATTRACT_PANEL_H; i++) {
+        if (m.rows[i] == m.shownRows[i]) continue;
+        snprintf(pos, sizeof(pos), "\033[%d;%dH", m.panelRow + i, m.panelCol);
+        buf += pos;
+        buf += m.rows[i];
+        m.shownRows[i] = m.rows[i];
+    }
+    if (buf.size() == mark) { buf.clear(); return false; }
+    if (caps.sync) buf += "\033[?2026l";
+    return true;
+}
+
+// The menu panel for this frame: selection, breathing title, snake
+static void fillMenuPanel(AttractMenu &m, int sel, unsigned long frame) {
+    int breathPhase = (frame / 20) % 3;
+    const char* breathAttr;
+    switch (breathPhase) {
+        case 0: breathAttr = DIM;  break;
+        case 1: breathAttr = "";   break;
+        default: breathAttr = BOLD; break;
+    }
+
+    std::string bline = "========================================";
+    int blVis = (int)bline.size();
+    std::string blCol = std::string(CYAN) + bline + RESET;
+    setPanelRow(m, 0, "", 0);
+    setPanelRow(m, 1, blCol, blVis);
+
+    std::string titleText = "V   S   N   A   K   E";
+    int titleVis = (int)titleText.size();
+    setPanelRow(m, 2, std::string(breathAttr) + BRIGHT_GREEN + titleText + RESET, titleVis);
+    setPanelRow(m, 3, blCol, blVis);
+    setPanelRow(m, 4, "", 0);
+
+    int decoPhase = (frame / 8) % 3;
+    std::string snakeHead;
+    switch (decoPhase) {
+        case 0: snakeHead = std::string(BOLD) + BRIGHT_GREEN + "O>" + RESET; break;
+        case 1: snakeHead = std::string(BOLD) + BRIGHT_CYAN  + "O>" + RESET; break;
+        case 2: snakeHead = std::string(BOLD) + BRIGHT_WHITE + "O>" + RESET; break;
+    }
+    std::string deco = std::string(DIM) + GREEN + "~" + RESET
+                     + BRIGHT_GREEN + "o" + RESET
+                     + GREEN + "o" + RESET
+                     + BRIGHT_GREEN + "o" + RESET
+                     + GREEN + "o" + RESET
+                     + snakeHead;
+    setPanelRow(m, 5, deco, 7);
+    setPanelRow(m, 6, "", 0);
+
+    const char* labels[] = {"Start Game", "Leaderboard", "Multiplayer", "Quit"};
+    const char* keys[]   = {"1", "2", "3", "Q"};
+    for (int i = 0; i < 4; i++) {
+        char plain[48];
+        snprintf(plain, sizeof(plain), " %c  [%s]  %-14s",
+                 (i == sel) ? '>' : ' ', keys[i], labels[i]);
+        int plen = (int)strlen(plain);
+
+        if (i == sel) {
+            setPanelRow(m, 7 + i, std::string(BOLD) + YELLOW + REVERSE + plain + RESET, plen);
+        } else {
+            std::string col = std::string(CYAN) + "[" + keys[i] + "]" + RESET
+                            + "  " + labels[i];
+            int vlen = 1 + (int)strlen(keys[i]) + 1 + 2 + (int)strlen(labels[i]);
+            setPanelRow(m, 7 + i, col, vlen);
+        }
+    }
+
+    setPanelRow(m, 11, "", 0);
+    std::string footer = "Navigate: Arrows/WS  Select: Enter/Space";
+    setPanelRow(m, 12, std::string(DIM) + footer + RESET, (int)footer.size());
+    setPanelRow(m, 13, "", 0);
+}
+
+// One menu frame at `now`; false if there is nothing to write.  A
+// key that wakes the menu early (`held`) redraws the panel only: the
+// demo and the animation wait for the next full frame.
+static bool attractFrame(AttractMenu &m, int sel, unsigned long frame, long long now, bool held = false) {
+    fillMenuPanel(m, sel, frame);
+    if (!held) stepAttract(m, now);
+    m.game.holdAnim = held;
+    return renderAttract(m);
+}
+
+// ─── Attract Benchmark ──────────────────────────────────────
+// The idle menu on a 100x30 terminal for `seconds` of real time,
+// paced like showStartMenu, output to /dev/null.  CPU is the process
+// user + system time from getrusage, so it counts the sleeps' and
+// writes' syscalls too.  The "full" row forces a full frame every
+// frame, for comparison.
+static long long rusageMicros() {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return (long long)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000LL +
+           ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+}
+
+void runAttractBenchmark(int seconds) {
+    int out = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    if (out < 0) { perror("vsnake: /dev/null"); return; }
+    printf("%-6s %8s %12s %12s %10s   (budget 1.0%% of a core)\n",
+           "frames", "count", "bytes/frame", "us/frame", "cpu %");
+    for (int full = 0; full < 2; full++) {
+        AttractMenu m;
+        long long t0 = nowMicros(), c0 = rusageMicros();
+        startAttract(m, 100, 30, t0);
+        unsigned long frame = 0;
+        uint64_t bytes = 0;
+        long long workUs = 0;
+        while (nowMicros() - t0 < seconds * 1000000LL && !g_interrupted) {
+            long long fs = nowMicros();
+            if (full) m.game.shownValid = false;
+            frame++;
+            if (attractFrame(m, 0, frame, fs)) {
+                ssize_t n = write(out, m.game.renderBuf.data(), m.game.renderBuf.size());
+                if (n > 0) bytes += (uint64_t)n;
+            }
+            long long el = nowMicros() - fs;
+            workUs += el;
+            if (RENDER_TICK_US > el) usleep((useconds_t)(RENDER_TICK_US - el));
+        }
+        double cpu = (double)(rusageMicros() - c0) / (nowMicros() - t0) * 100;
+        printf("%-6s %8lu %12.0f %12.1f %10.2f\n", full ? "full" : "diff", frame,
+               (double)bytes / frame, (double)workUs / frame, cpu);
+        fflush(stdout);
     }
+    close(out);
 }
 
 // ─── Start Menu ─────────────────────────────────────────────
@@ -740,36 +2836,40 @@ AppState showStartMenu() {
     clearScreen();
 
     int sel = 0;
-    const int NOPTS = 3;
-    std::string buf;
-    buf.reserve(4096);
+    const int NOPTS = 4;
     unsigned long frame = 0;
+    AttractMenu demo;
+    int demoW = 0, demoH = 0;
+    long long nextFrame = 0;
 
     while (true) {
         if (g_interrupted) return STATE_EXIT;
         long long fs = nowMicros();
+        bool early = fs < nextFrame;            // a key woke us mid-frame
+        if (!early) nextFrame = fs + RENDER_TICK_US;
 
         int tw, th; getTerminalSize(tw, th);
         if (tw < MIN_TERM_W || th < MIN_TERM_H) return STATE_TOO_SMALL;
+        if (tw != demoW || th != demoH) {
+            startAttract(demo, tw, th, fs);
+            demoW = tw; demoH = th;
+        }
 
         {
             char c = 0;
-            while (true) {
-                fd_set fds; FD_ZERO(&fds); FD_SET(STDIN_FILENO, &fds);
-                struct timeval tv = {0, 0};
-                if (select(STDIN_FILENO + 1, &fds, nullptr, nullptr, &tv) <= 0) break;
-                if (read(STDIN_FILENO, &c, 1) != 1) break;
-
+            while (readKeyByte(c)) {
                 if (c == 'q' || c == 'Q') return STATE_EXIT;
                 if (c == '1') { soundMenuSelect(); return STATE_PLAYING; }
                 if (c == '2') { soundMenuSelect(); return STATE_LEADERBOARD; }
+                if (c == '3') { soundMenuSelect(); return STATE_MULTI_SETUP; }
 
                 if (c == '\r' || c == '\n' || c == ' ') {
                     soundMenuSelect();
                     switch (sel) {
                         case 0: return STATE_PLAYING;
                         case 1: return STATE_LEADERBOARD;
-                        case 2: return STATE_EXIT;
+                        case 2: return STATE_MULTI_SETUP;
+                        case 3: return STATE_EXIT;
                     }
                 }
 
@@ -804,95 +2904,24 @@ AppState showStartMenu() {
             }
         }
 
-        frame++;
-        int breathPhase = (frame / 20) % 3;
-        const char* breathAttr;
-        switch (breathPhase) {
-            case 0: breathAttr = DIM;  break;
-            case 1: breathAttr = "";   break;
-            default: breathAttr = BOLD; break;
-        }
-
-        buf.clear();
-        buf += "\033[1;1H";
-
-        int menuH = 13;
-        int topPad = std::max(1, (th - menuH) / 2);
-        for (int i = 0; i < topPad; i++) buf += ERASE_LINE "\n";
+        if (!early) frame++;
+        if (attractFrame(demo, sel, frame, fs, early))
+            write(STDOUT_FILENO, demo.game.renderBuf.data(), demo.game.renderBuf.size());
 
-        std::string bline = "========================================";
-        int blVis = (int)bline.size();
-        std::string blCol = std::string(CYAN) + bline + RESET;
-        buf += centerColorText(blCol, blVis, tw) + ERASE_LINE "\n";
+        long long sl = nextFrame - nowMicros();
+        if (sl > 0) waitForInput(sl);
+    }
+}
 
-        std::string titleText = "V   S   N   A   K   E";
-        int titleVis = (int)titleText.size();
-        std::string titleCol = std::string(breathAttr) + BRIGHT_GREEN + titleText + RESET;
-        buf += centerColorText(titleCol, titleVis, tw) + ERASE_LINE "\n";
-        buf += centerColorText(blCol, blVis, tw) + ERASE_LINE "\n";
-        buf += ERASE_LINE "\n";
+// ─── Leaderboard Screen ────────────────────────────────────
+AppState showLeaderboardScreen() {
+    clearScreen();
+    auto scores = loadScores();
+    int tw, th; getTerminalSize(tw, th);
 
-        int decoPhase = (frame / 8) % 3;
-        std::string snakeHead;
-        switch (decoPhase) {
-            case 0: snakeHead = std::string(BOLD) + BRIGHT_GREEN + "O>" + RESET; break;
-            case 1: snakeHead = std::string(BOLD) + BRIGHT_CYAN  + "O>" + RESET; break;
-            case 2: snakeHead = std::string(BOLD) + BRIGHT_WHITE + "O>" + RESET; break;
-        }
-        std::string deco = std::string(DIM) + GREEN + "~" + RESET
-                         + BRIGHT_GREEN + "o" + RESET
-                         + GREEN + "o" + RESET
-                         + BRIGHT_GREEN + "o" + RESET
-                         + GREEN + "o" + RESET
-                         + snakeHead;
-        buf += centerColorText(deco, 9, tw) + ERASE_LINE "\n";
-        buf += ERASE_LINE "\n";
-
-        const char* labels[] = {"Start Game", "Leaderboard", "Quit"};
-        const char* keys[]   = {"1", "2", "Q"};
-
-        for (int i = 0; i < NOPTS; i++) {
-            char plain[48];
-            snprintf(plain, sizeof(plain), " %c  [%s]  %-14s",
-                     (i == sel) ? '>' : ' ', keys[i], labels[i]);
-            int plen = (int)strlen(plain);
-
-            if (i == sel) {
-                std::string col = std::string(BOLD) + YELLOW + REVERSE + plain + RESET;
-                buf += centerColorText(col, plen, tw);
-            } else {
-                std::string col = std::string(CYAN) + "[" + keys[i] + "]" + RESET
-                                + "  " + labels[i];
-                int vlen = 1 + (int)strlen(keys[i]) + 1 + 2 + (int)strlen(labels[i]);
-                buf += centerColorText(col, vlen, tw);
-            }
-            buf += ERASE_LINE "\n";
-        }
-
-        buf += ERASE_LINE "\n";
-        std::string footer = "Navigate: Arrows/WS  Select: Enter/Space";
-        buf += centerColorText(std::string(DIM) + footer + RESET,
-                               (int)footer.size(), tw);
-        buf += ERASE_LINE "\n";
-        buf += ERASE_BELOW;
-
-        write(STDOUT_FILENO, buf.c_str(), buf.size());
-
-        long long el = nowMicros() - fs;
-        long long sl = RENDER_TICK_US - el;
-        if (sl > 0) usleep(static_cast<useconds_t>(sl));
-    }
-}
-
-// ─── Leaderboard Screen ────────────────────────────────────
-AppState showLeaderboardScreen() {
-    clearScreen();
-    auto scores = loadScores();
-    int tw, th; getTerminalSize(tw, th);
-
-    std::string border = std::string(CYAN) + "=====================================" + RESET;
-    std::string title  = std::string(BOLD) + YELLOW + "L E A D E R B O A R D" + RESET;
-    std::string div    = std::string(CYAN) + "-------------------------------------" + RESET;
+    std::string border = std::string(CYAN) + "=====================================" + RESET;
+    std::string title  = std::string(BOLD) + YELLOW + "L E A D E R B O A R D" + RESET;
+    std::string div    = std::string(CYAN) + "-------------------------------------" + RESET;
 
     std::string buf;
     buf += "\n\n";
@@ -900,7 +2929,7 @@ AppState showLeaderboardScreen() {
     buf += centerColorText(title, 21, tw) + "\n";
     buf += centerColorText(border, 37, tw) + "\n\n";
 
-    int n = std::min((int)scores.size(), 10);
+    int n = std::min((int)scores.size(), LEADERBOARD_TOP);
     if (n == 0) {
         buf += centerText("(no saved scores)", tw) + "\n";
     } else {
@@ -930,7 +2959,7 @@ AppState showLeaderboardScreen() {
         struct timeval tv = {0, 50000};
         if (select(STDIN_FILENO + 1, &fds, nullptr, nullptr, &tv) > 0) {
             char c;
-            if (read(STDIN_FILENO, &c, 1) == 1) {
+            if (readKeyByte(c)) {
                 if (c == 'r' || c == 'R') return STATE_MENU;
                 if (c == 'q' || c == 'Q') return STATE_EXIT;
             }
@@ -947,7 +2976,7 @@ static AppState waitForMenuOrExit() {
         struct timeval tv = {0, 50000};
         if (select(STDIN_FILENO + 1, &fds, nullptr, nullptr, &tv) > 0) {
             char c;
-            if (read(STDIN_FILENO, &c, 1) == 1) {
+            if (readKeyByte(c)) {
                 if (c == 'r' || c == 'R') return STATE_MENU;
                 if (c == 'q' || c == 'Q') return STATE_EXIT;
             }
@@ -980,7 +3009,7 @@ void showEndScreen(int score, bool won) {
     buf += centerColorText(std::string(BOLD) + CYAN + "Top Scores:" + RESET, 11, tw) + "\n";
     buf += centerColorText(div, 29, tw) + "\n";
 
-    int n = std::min((int)scores.size(), 10);
+    int n = std::min((int)scores.size(), LEADERBOARD_TOP);
     for (int i = 0; i < n; i++) {
         std::string rank = std::to_string(i + 1);
         if (i < 9) rank = " " + rank;
@@ -1028,109 +3057,5522 @@ void showTooSmallScreen() {
     write(STDOUT_FILENO, buf.c_str(), buf.size());
 }
 
-// ─── Main ───────────────────────────────────────────────────
-int main() {
-    srand(static_cast<unsigned>(time(nullptr)));
+// ===== MULTIPLAYER =========================================
+//
+// 2–4 snakes on one board, humans sharing the keyboard and bots
+// filling the remaining slots.  All snakes move on the same tick.
+//
+// One shared owner grid (0 = empty, i+1 = snake i) answers every
+// collision question, so a tick costs O(snakes):
+//   1. every live snake picks its next head; tails that will
+//      move are released first, so following a tail is legal
+//   2. a head entering an owned cell or a wall dies; two heads
+//      claiming the same cell both die (swaps die as head-to-body)
+//   3. dead snakes are lifted off the board, survivors advance
+//
 
-    struct sigaction sa;
-    sa.sa_handler = signalHandler;
-    sigemptyset(&sa.sa_mask);
-    sa.sa_flags = 0;
-    sigaction(SIGINT, &sa, nullptr);
-    sigaction(SIGTERM, &sa, nullptr);
+static const int MAX_SNAKES = 4;
 
-        // Ignore SIGPIPE so broken audio pipes don't kill the game
-    struct sigaction spa;
-    spa.sa_handler = SIG_IGN;
-    sigemptyset(&spa.sa_mask);
-    spa.sa_flags = 0;
-    sigaction(SIGPIPE, &spa, nullptr);
+static const char* SNAKE_BRIGHT[MAX_SNAKES] = { BRIGHT_GREEN, BRIGHT_BLUE, BRIGHT_YELLOW, BRIGHT_MAGENTA };
+static const char* SNAKE_BASE[MAX_SNAKES]   = { GREEN,        BLUE,        YELLOW,        MAGENTA };
 
+struct Snake {
+    std::deque<Point> body;
+    Direction         dir, nextDir, queuedDir;
+    bool              dirChangedThisTick, hasQueuedDir;
+    int               score;
+    bool              alive, bot, remote;
+};
 
-    enableRawMode();
-    hideCursor();
-    write(STDOUT_FILENO, "\033[?1049h", 8);
-    atexit(atexitCleanup);
-    initSound();
+struct MultiConfig {
+    int numSnakes;
+    int numHumans;
+};
 
-    AppState state = STATE_MENU;
-    int lastScore = 0;
-    bool lastWon = false;
+struct MultiGame {
+    Snake             snakes[MAX_SNAKES];
+    int               numSnakes, numHumans;
+    Point             apple;
+    int               boardWidth, boardHeight;
+    int               termWidth, termHeight;
+    int               offsetX, offsetY;
+    bool              running, over, boardFull;
+    bool              termResized, termTooSmall;
+    bool              paused, restartRequested;
+    long long         moveAccumulator;
+    unsigned long     frameCount;
+    int               appleFlashTimer;
+    std::vector<uint8_t> owner;     // 0 empty, else snake index + 1
+    std::vector<uint8_t> claim;     // head claims during one tick
+    std::vector<uint8_t> cells;     // render scratch
+    std::string       renderBuf;
+    Rng               rng;
+    int               localPlayer;  // networked: our snake, else -1
+    uint64_t          zobrist;      // XOR of cellKey over owned cells
+    bool              silent;       // no sound (re-simulation)
+};
 
-    while (state != STATE_EXIT) {
-        if (g_interrupted) break;
+// Zobrist key for "cell c owned by v", derived on the fly (splitmix64)
+static inline uint64_t cellKey(int c, int v) {
+    uint64_t z = ((uint64_t)c << 3 | (uint64_t)v) + 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
 
-        switch (state) {
+// Every owner write goes through here to keep the hash incremental
+static inline void setOwner(MultiGame &m, int c, int v) {
+    int old = m.owner[c];
+    if (old) m.zobrist ^= cellKey(c, old);
+    if (v)   m.zobrist ^= cellKey(c, v);
+    m.owner[c] = (uint8_t)v;
+}
 
-        case STATE_MENU:
-            state = showStartMenu();
-            break;
+static inline bool inBoard(const MultiGame &m, Point p) {
+    return p.x >= 0 && p.x < m.boardWidth && p.y >= 0 && p.y < m.boardHeight;
+}
 
-        case STATE_LEADERBOARD:
-            state = showLeaderboardScreen();
-            break;
+static bool spawnMultiApple(MultiGame &m) {
+    int total = m.boardWidth * m.boardHeight;
+    for (int a = 0; a < APPLE_MAX_TRIES; a++) {
+        int c = m.rng.below(total);
+        if (!m.owner[c]) {
+            m.apple = {c % m.boardWidth, c / m.boardWidth};
+            m.appleFlashTimer = FLASH_DURATION;
+            return true;
+        }
+    }
+    for (int c = 0; c < total; c++)
+        if (!m.owner[c]) {
+            m.apple = {c % m.boardWidth, c / m.boardWidth};
+            m.appleFlashTimer = FLASH_DURATION;
+            return true;
+        }
+    return false;
+}
 
-        case STATE_PLAYING: {
-            GameState game;
-            initGame(game);
+void initMultiGame(MultiGame &m, const MultiConfig &cfg, uint64_t seed) {
+    getTerminalSize(m.termWidth, m.termHeight);
+    m.termTooSmall = (m.termWidth < MIN_TERM_W || m.termHeight < MIN_TERM_H);
+    m.boardWidth = BOARD_WIDTH;
+    m.boardHeight = BOARD_HEIGHT;
+    m.offsetX = std::max(0, (m.termWidth - (BOARD_WIDTH * 2 + 4)) / 2);
+    m.offsetY = std::max(0, (m.termHeight - (BOARD_HEIGHT + 5)) / 2);
+
+    m.numSnakes = std::max(2, std::min(MAX_SNAKES, cfg.numSnakes));
+    m.numHumans = std::max(0, std::min(2, std::min(m.numSnakes, cfg.numHumans)));
+    m.rng.seed(seed);
+
+    int total = m.boardWidth * m.boardHeight;
+    m.owner.assign(total, 0);
+    m.zobrist = 0;
+    m.localPlayer = -1;
+    m.silent = false;
+    m.claim.assign(total, 0);
+    m.cells.assign(total, 0);
+    m.renderBuf.reserve((m.boardWidth * 2 + 80) * (m.boardHeight + 8) * 2);
+
+    // One corner each, heading clockwise so nobody starts face to face
+    const int W = m.boardWidth, H = m.boardHeight;
+    const Point     heads[MAX_SNAKES] = { {7, 2}, {W - 8, H - 3}, {W - 3, 7}, {2, H - 8} };
+    const Direction dirs[MAX_SNAKES]  = { RIGHT, LEFT, DOWN, UP };
+
+    for (int i = 0; i < MAX_SNAKES; i++) {
+        Snake &s = m.snakes[i];
+        s.body.clear();
+        s.alive = i < m.numSnakes;
+        s.bot = i >= m.numHumans;
+        s.remote = false;
+        s.score = 0;
+        s.dir = s.nextDir = s.queuedDir = dirs[i];
+        s.dirChangedThisTick = false; s.hasQueuedDir = false;
+        if (!s.alive) continue;
+        Point p = heads[i];
+        Direction back = dirs[i] == UP ? DOWN : dirs[i] == DOWN ? UP
+                       : dirs[i] == LEFT ? RIGHT : LEFT;
+        for (int k = 0; k < 3; k++) {
+            s.body.push_back(p);
+            setOwner(m, p.y * W + p.x, i + 1);
+            p = stepPoint(p, back);
+        }
+    }
 
-            if (game.termTooSmall) { state = STATE_TOO_SMALL; break; }
+    m.running = true; m.over = false; m.boardFull = false;
+    m.termResized = false; m.paused = false; m.restartRequested = false;
+    m.moveAccumulator = 0; m.frameCount = 0; m.appleFlashTimer = 0;
+    spawnMultiApple(m);
+}
 
-            clearScreen();
-            long long lastFrame = nowMicros();
+static int aliveCount(const MultiGame &m) {
+    int n = 0;
+    for (int i = 0; i < m.numSnakes; i++) if (m.snakes[i].alive) n++;
+    return n;
+}
 
-            while (game.running) {
-                long long fs = nowMicros();
-                long long dt = fs - lastFrame;
-                lastFrame = fs;
+static int leaderScore(const MultiGame &m) {
+    int best = 0;
+    for (int i = 0; i < m.numSnakes; i++) best = std::max(best, m.snakes[i].score);
+    return best;
+}
 
-                if (g_interrupted) { game.running = false; state = STATE_EXIT; break; }
-                if (checkTerminalResize(game)) break;
+// Greedy bot: the safe direction closest to the apple, avoiding
+// cells next to an enemy head that could be contested this tick.
+static void botThink(MultiGame &m, int id) {
+    Snake &s = m.snakes[id];
+    const Direction all[4] = { UP, DOWN, LEFT, RIGHT };
+    Point head = s.body.front();
+    int bestScore = -1000000;
+    Direction best = s.dir;
+    for (Direction d : all) {
+        if (isOpposite(d, s.dir)) continue;
+        Point p = stepPoint(head, d);
+        int sc = 0;
+        if (!inBoard(m, p)) sc -= 100000;
+        else {
+            uint8_t o = m.owner[p.y * m.boardWidth + p.x];
+            bool ownTail = (o == id + 1 && p == s.body.back());
+            if (o && !ownTail) sc -= 100000;
+            for (int j = 0; j < m.numSnakes; j++) {
+                if (j == id || !m.snakes[j].alive) continue;
+                Point eh = m.snakes[j].body.front();
+                if (std::abs(eh.x - p.x) + std::abs(eh.y - p.y) == 1) sc -= 5000;
+            }
+            int free = 0;
+            for (Direction d2 : all) {
+                Point q = stepPoint(p, d2);
+                if (inBoard(m, q) && !m.owner[q.y * m.boardWidth + q.x]) free++;
+            }
+            sc += free * 50;
+        }
+        sc -= (std::abs(p.x - m.apple.x) + std::abs(p.y - m.apple.y)) * 10;
+        sc += m.rng.below(5);
+        if (sc > bestScore) { bestScore = sc; best = d; }
+    }
+    s.nextDir = best;
+}
 
-                readInput(game);
-                if (!game.running) break;
+void updateMulti(MultiGame &m) {
+    if (m.paused) return;
+    const int W = m.boardWidth;
+    Point nh[MAX_SNAKES];
+    bool grow[MAX_SNAKES] = {}, dies[MAX_SNAKES] = {};
+
+    for (int i = 0; i < m.numSnakes; i++) {
+        Snake &s = m.snakes[i];
+        if (!s.alive) continue;
+        if (s.bot) botThink(m, i);
+        s.dir = s.nextDir;
+        nh[i] = stepPoint(s.body.front(), s.dir);
+        grow[i] = (nh[i] == m.apple);
+        if (!grow[i]) { Point t = s.body.back(); setOwner(m, t.y * W + t.x, 0); }
+    }
 
-                if (!game.paused) {
-                    game.moveAccumulator += dt;
-                    long long mi = calcMoveInterval(game.score, game.nextDir);
-                    if (game.moveAccumulator > mi * 3) game.moveAccumulator = mi;
-                    while (game.moveAccumulator >= mi) {
-                        updateGame(game);
-                        if (!game.running) break;
-                        game.moveAccumulator -= mi;
-                        game.dirChangedThisTick = false;
-                        if (game.hasQueuedDir) {
-                            if (!isOpposite(game.queuedDir, game.dir) &&
-                                game.queuedDir != game.dir) {
-                                game.nextDir = game.queuedDir;
-                                game.dirChangedThisTick = true;
-                            }
-                            game.hasQueuedDir = false;
-                        }
-                        mi = calcMoveInterval(game.score, game.nextDir);
-                    }
+    for (int i = 0; i < m.numSnakes; i++) {
+        if (!m.snakes[i].alive) continue;
+        if (!inBoard(m, nh[i])) { dies[i] = true; continue; }
+        int c = nh[i].y * W + nh[i].x;
+        if (m.owner[c]) dies[i] = true;
+        if (m.claim[c]) { dies[i] = true; dies[m.claim[c] - 1] = true; }
+        else m.claim[c] = (uint8_t)(i + 1);
+    }
+    for (int i = 0; i < m.numSnakes; i++)
+        if (m.snakes[i].alive && inBoard(m, nh[i]))
+            m.claim[nh[i].y * W + nh[i].x] = 0;
+
+    bool anyDied = false;
+    for (int i = 0; i < m.numSnakes; i++) {
+        Snake &s = m.snakes[i];
+        if (!s.alive || !dies[i]) continue;
+        if (!grow[i]) s.body.pop_back();
+        for (auto &p : s.body) setOwner(m, p.y * W + p.x, 0);
+        s.body.clear();
+        s.alive = false;
+        anyDied = true;
+    }
+
+    bool eaten = false;
+    for (int i = 0; i < m.numSnakes; i++) {
+        Snake &s = m.snakes[i];
+        if (!s.alive) continue;
+        s.body.push_front(nh[i]);
+        setOwner(m, nh[i].y * W + nh[i].x, i + 1);
+        if (grow[i]) { s.score += 10; eaten = true; }
+        else s.body.pop_back();
+    }
+
+    if (anyDied && !m.silent) soundGameOver();
+    if (eaten) {
+        if (!m.silent) soundEat();
+        if (!spawnMultiApple(m)) { m.boardFull = true; m.over = true; m.running = false; }
+    }
+
+    bool humanAlive = m.numHumans == 0;
+    for (int i = 0; i < m.numHumans; i++) if (m.snakes[i].alive) humanAlive = true;
+    if (aliveCount(m) < 2 || !humanAlive) { m.over = true; m.running = false; }
+}
+
+void readMultiInput(MultiGame &m) {
+    char c = 0;
+    while (readKeyByte(c)) {
+
+        if (c == 'q' || c == 'Q') { m.running = false; return; }
+        if (c == 'r' || c == 'R') { m.restartRequested = true; m.running = false; return; }
+        if (c == 'p' || c == 'P') { m.paused = !m.paused; soundPauseToggle(); continue; }
+        if (m.paused || m.numHumans == 0) continue;
+
+        // P1: WASD (HJKL too when alone), P2: arrows (P1 when alone)
+        Snake &p1 = m.snakes[0];
+        Snake &p2 = m.snakes[m.numHumans > 1 ? 1 : 0];
+
+        if (c == '\033') {
+            char seq[2] = {0, 0};
+            fd_set f2; struct timeval t2;
+            FD_ZERO(&f2); FD_SET(STDIN_FILENO, &f2); t2 = {0, 5000};
+            if (select(STDIN_FILENO + 1, &f2, nullptr, nullptr, &t2) > 0)
+                read(STDIN_FILENO, &seq[0], 1);
+            FD_ZERO(&f2); FD_SET(STDIN_FILENO, &f2); t2 = {0, 5000};
+            if (select(STDIN_FILENO + 1, &f2, nullptr, nullptr, &t2) > 0)
+                read(STDIN_FILENO, &seq[1], 1);
+            if (seq[0] == '[' && p2.alive) {
+                switch (seq[1]) {
+                    case 'A': tryChangeDirection(p2, UP);    break;
+                    case 'B': tryChangeDirection(p2, DOWN);  break;
+                    case 'D': tryChangeDirection(p2, LEFT);  break;
+                    case 'C': tryChangeDirection(p2, RIGHT); break;
                 }
-                if (!game.running) break;
+            }
+            continue;
+        }
+        if (!p1.alive) continue;
+        bool solo = m.numHumans == 1;
+        switch (c) {
+            case 'w': case 'W': tryChangeDirection(p1, UP);    break;
+            case 's': case 'S': tryChangeDirection(p1, DOWN);  break;
+            case 'a': case 'A': tryChangeDirection(p1, LEFT);  break;
+            case 'd': case 'D': tryChangeDirection(p1, RIGHT); break;
+            case 'k': case 'K': if (solo) tryChangeDirection(p1, UP);    break;
+            case 'j': case 'J': if (solo) tryChangeDirection(p1, DOWN);  break;
+            case 'h': case 'H': if (solo) tryChangeDirection(p1, LEFT);  break;
+            case 'l': case 'L': if (solo) tryChangeDirection(p1, RIGHT); break;
+        }
+    }
+}
 
-                render(game);
+bool checkMultiResize(MultiGame &m) {
+    int nw, nh; getTerminalSize(nw, nh);
+    if (nw != m.termWidth || nh != m.termHeight) {
+        m.termResized = true; m.running = false; return true;
+    }
+    return false;
+}
 
-                long long el = nowMicros() - fs;
-                long long sl = RENDER_TICK_US - el;
-                if (sl > 0) usleep(static_cast<useconds_t>(sl));
+// Cell codes for the render scratch grid: 0 empty, 1 apple,
+// 2 + snake * 5 + {0 head, 1..4 body zone}
+void renderMulti(MultiGame &m) {
+    unsigned long animFrame = m.frameCount;
+    int appleFlash = m.appleFlashTimer;
+    int headPhase = (m.frameCount / HEAD_GLOW_PERIOD) % 2;
+    if (!m.paused) {
+        m.frameCount++;
+        if (m.appleFlashTimer > 0) m.appleFlashTimer--;
+    }
+
+    const int W = m.boardWidth;
+    std::fill(m.cells.begin(), m.cells.end(), 0);
+    for (int i = 0; i < m.numSnakes; i++) {
+        const Snake &s = m.snakes[i];
+        if (!s.alive) continue;
+        int bodyLen = (int)s.body.size() - 1;
+        for (size_t k = 1; k < s.body.size(); k++) {
+            int zone = (bodyLen <= 0) ? 0 : ((int)(k - 1) * 4 / bodyLen);
+            if (zone > 3) zone = 3;
+            m.cells[s.body[k].y * W + s.body[k].x] = (uint8_t)(2 + i * 5 + 1 + zone);
+        }
+        m.cells[s.body.front().y * W + s.body.front().x] = (uint8_t)(2 + i * 5);
+    }
+    m.cells[m.apple.y * W + m.apple.x] = 1;
+
+    std::string &buf = m.renderBuf;
+    buf.clear();
+    buf += "\033[1;1H";
+    for (int r = 0; r < m.offsetY; r++) buf += ERASE_LINE "\n";
+
+    {
+        std::string line;
+        int vis = 0;
+        for (int i = 0; i < m.numSnakes; i++) {
+            char t[32];
+            snprintf(t, sizeof(t), "%sP%d%s %d", i ? "   " : "", i + 1,
+                     m.snakes[i].bot ? "(bot)" : m.snakes[i].remote ? "(net)" : "",
+                     m.snakes[i].score);
+            vis += (int)strlen(t);
+            line += m.snakes[i].alive ? std::string(BOLD) + SNAKE_BRIGHT[i]
+                                      : std::string(DIM) + SNAKE_BASE[i];
+            line += t; line += RESET;
+        }
+        buf += centerColorText(line, vis, m.termWidth);
+    }
+    buf += ERASE_LINE "\n";
+
+    int vbw = W * 2 + 4;
+    std::string hpad(m.offsetX, ' ');
+    buf += hpad; buf += CYAN;
+    for (int i = 0; i < vbw; i++) buf += '#';
+    buf += RESET ERASE_LINE "\n";
+
+    for (int y = 0; y < m.boardHeight; y++) {
+        buf += hpad;
+        buf += CYAN "##" RESET;
+        for (int x = 0; x < W; x++) {
+            int c = m.cells[y * W + x];
+            if (c == 0) { buf += "  "; continue; }
+            if (c == 1) { buf += CELL_GLYPH[appleGlyph(animFrame, appleFlash)]; continue; }
+            int id = (c - 2) / 5, part = (c - 2) % 5;
+            switch (part) {
+                case 0:
+                    buf += BOLD; buf += headPhase ? BRIGHT_WHITE : SNAKE_BRIGHT[id];
+                    buf += "OO" RESET; break;
+                case 1: buf += BOLD; buf += SNAKE_BRIGHT[id]; buf += "oo" RESET; break;
+                case 2: buf += SNAKE_BRIGHT[id]; buf += "oo" RESET; break;
+                case 3: buf += SNAKE_BASE[id];   buf += "oo" RESET; break;
+                default: buf += DIM; buf += SNAKE_BASE[id]; buf += "oo" RESET; break;
             }
+        }
+        buf += CYAN "##" RESET ERASE_LINE "\n";
+    }
 
-            if (state == STATE_EXIT) break;
-            if (game.restartRequested) { state = STATE_PLAYING; }
-            else if (game.termResized) { state = STATE_RESIZED; }
-            else if (game.gameOver || game.gameWon) {
-                lastScore = game.score; lastWon = game.gameWon;
-                state = STATE_GAMEOVER;
-            } else { state = STATE_MENU; }
-            break;
+    buf += hpad; buf += CYAN;
+    for (int i = 0; i < vbw; i++) buf += '#';
+    buf += RESET ERASE_LINE "\n";
+
+    {
+        char t[80];
+        if (m.localPlayer >= 0)
+            snprintf(t, sizeof(t), "You are P%d | Move: WASD/HJKL/Arrows | Q: Quit", m.localPlayer + 1);
+        else
+            snprintf(t, sizeof(t), "%s", m.numHumans > 1
+                ? "P1: WASD | P2: Arrows | P: Pause | R: Restart | Q: Menu"
+                : "Move: WASD/HJKL/Arrows | P: Pause | R: Restart | Q: Menu");
+        buf += centerColorText(std::string(CYAN) + t + RESET, (int)strlen(t), m.termWidth);
+    }
+    buf += ERASE_LINE "\n";
+    buf += ERASE_BELOW;
+
+    if (m.paused) {
+        const char* pm = "  PAUSED -- Press P to resume  ";
+        int ml = (int)strlen(pm);
+        int cr = m.offsetY + 2 + m.boardHeight / 2;
+        int cc = m.offsetX + 3 + std::max(0, (W * 2 - ml) / 2);
+        if (cc < 1) cc = 1;
+        char pos[32];
+        snprintf(pos, sizeof(pos), "\033[%d;%dH", cr, cc);
+        buf += pos;
+        buf += BOLD YELLOW REVERSE;
+        buf += pm;
+        buf += RESET;
+    }
+
+    write(STDOUT_FILENO, buf.c_str(), buf.size());
+}
+
+// ─── Multiplayer Setup ──────────────────────────────────────
+AppState showMultiSetupScreen(MultiConfig &cfg) {
+    flushInput();
+    clearScreen();
+    int row = 0;
+    std::string buf;
+
+    while (true) {
+        if (g_interrupted) return STATE_EXIT;
+        int tw, th; getTerminalSize(tw, th);
+        if (tw < MIN_TERM_W || th < MIN_TERM_H) return STATE_TOO_SMALL;
+
+        buf.clear();
+        buf += "\033[1;1H";
+        int topPad = std::max(1, (th - 12) / 2);
+        for (int i = 0; i < topPad; i++) buf += ERASE_LINE "\n";
+
+        std::string border = std::string(CYAN) + "=============================" + RESET;
+        std::string title  = std::string(BOLD) + YELLOW + "M U L T I P L A Y E R" + RESET;
+        buf += centerColorText(border, 29, tw) + ERASE_LINE "\n";
+        buf += centerColorText(title, 21, tw) + ERASE_LINE "\n";
+        buf += centerColorText(border, 29, tw) + ERASE_LINE "\n";
+        buf += ERASE_LINE "\n";
+
+        const char* labels[] = { "Snakes", "Humans" };
+        int values[] = { cfg.numSnakes, cfg.numHumans };
+        for (int i = 0; i < 2; i++) {
+            char plain[48];
+            snprintf(plain, sizeof(plain), " %c  %-8s <  %d  > ",
+                     (i == row) ? '>' : ' ', labels[i], values[i]);
+            int plen = (int)strlen(plain);
+            if (i == row) buf += centerColorText(std::string(BOLD) + YELLOW + REVERSE + plain + RESET, plen, tw);
+            else          buf += centerColorText(plain, plen, tw);
+            buf += ERASE_LINE "\n";
         }
+        buf += ERASE_LINE "\n";
+        buf += centerColorText(std::string(DIM) + "P1: WASD   P2: Arrows   Others: bots" + RESET, 35, tw);
+        buf += ERASE_LINE "\n" ERASE_LINE "\n";
+        std::string footer = "Adjust: Arrows/WASD  Start: Enter  Back: Q";
+        buf += centerColorText(std::string(DIM) + footer + RESET, (int)footer.size(), tw);
+        buf += ERASE_LINE "\n";
+        buf += ERASE_BELOW;
+        write(STDOUT_FILENO, buf.c_str(), buf.size());
 
-        case STATE_GAMEOVER:
-            showEndScreen(lastScore, lastWon);
+        fd_set fds; FD_ZERO(&fds); FD_SET(STDIN_FILENO, &fds);
+        struct timeval tv = {0, 50000};
+        if (select(STDIN_FILENO + 1, &fds, nullptr, nullptr, &tv) <= 0) continue;
+        char c;
+        if (!readKeyByte(c)) continue;
+        if (c == 'q' || c == 'Q') return STATE_MENU;
+        if (c == '\r' || c == '\n' || c == ' ') { soundMenuSelect(); return STATE_MULTI_PLAYING; }
+
+        int dRow = 0, dVal = 0;
+        if (c == '\033') {
+            char seq[2] = {0, 0};
+            fd_set f2; struct timeval t2;
+            FD_ZERO(&f2); FD_SET(STDIN_FILENO, &f2); t2 = {0, 5000};
+            if (select(STDIN_FILENO + 1, &f2, nullptr, nullptr, &t2) > 0)
+                read(STDIN_FILENO, &seq[0], 1);
+            FD_ZERO(&f2); FD_SET(STDIN_FILENO, &f2); t2 = {0, 5000};
+            if (select(STDIN_FILENO + 1, &f2, nullptr, nullptr, &t2) > 0)
+                read(STDIN_FILENO, &seq[1], 1);
+            if (seq[0] == '[') {
+                if (seq[1] == 'A') dRow = -1; else if (seq[1] == 'B') dRow = 1;
+                else if (seq[1] == 'D') dVal = -1; else if (seq[1] == 'C') dVal = 1;
+            }
+        } else {
+            switch (c) {
+                case 'w': case 'W': case 'k': case 'K': dRow = -1; break;
+                case 's': case 'S': case 'j': case 'J': dRow = 1;  break;
+                case 'a': case 'A': case 'h': case 'H': dVal = -1; break;
+                case 'd': case 'D': case 'l': case 'L': dVal = 1;  break;
+            }
+        }
+        if (dRow) { row = (row + dRow + 2) % 2; soundMenuMove(); }
+        if (dVal) {
+            if (row == 0) cfg.numSnakes = std::max(2, std::min(MAX_SNAKES, cfg.numSnakes + dVal));
+            else          cfg.numHumans = std::max(0, std::min(2, cfg.numHumans + dVal));
+            cfg.numHumans = std::min(cfg.numHumans, cfg.numSnakes);
+            soundMenuMove();
+        }
+    }
+}
+
+// ─── Multiplayer Results ────────────────────────────────────
+struct MultiResult {
+    int  numSnakes;
+    int  scores[MAX_SNAKES];
+    bool alive[MAX_SNAKES], bot[MAX_SNAKES], remote[MAX_SNAKES];
+};
+
+static MultiResult collectMultiResult(const MultiGame &m) {
+    MultiResult r;
+    r.numSnakes = m.numSnakes;
+    for (int i = 0; i < MAX_SNAKES; i++) {
+        r.scores[i] = m.snakes[i].score;
+        r.alive[i]  = i < m.numSnakes && m.snakes[i].alive;
+        r.bot[i]    = m.snakes[i].bot;
+        r.remote[i] = m.snakes[i].remote;
+    }
+    return r;
+}
+
+// Survivors outrank the fallen; ties on score are draws
+void showMultiEndScreen(const MultiResult &r) {
+    clearScreen();
+    for (int i = 0; i < r.numSnakes; i++)
+        if (!r.bot[i] && !r.remote[i]) saveScore(r.scores[i]);
+
+    int order[MAX_SNAKES];
+    for (int i = 0; i < r.numSnakes; i++) order[i] = i;
+    std::stable_sort(order, order + r.numSnakes, [&](int a, int b) {
+        if (r.alive[a] != r.alive[b]) return r.alive[a];
+        return r.scores[a] > r.scores[b];
+    });
+    int first = order[0], second = order[1];
+    bool draw = r.alive[first] == r.alive[second] && r.scores[first] == r.scores[second];
+
+    int tw, th; getTerminalSize(tw, th);
+    char titleText[32];
+    if (draw) snprintf(titleText, sizeof(titleText), "D R A W");
+    else      snprintf(titleText, sizeof(titleText), "P %d   W I N S !", first + 1);
+    std::string border = std::string(CYAN) + "=============================" + RESET;
+    std::string div    = std::string(CYAN) + "-----------------------------" + RESET;
+
+    std::string buf;
+    buf += "\n\n";
+    buf += centerColorText(border, 29, tw) + "\n";
+    buf += centerColorText(std::string(BOLD) + (draw ? YELLOW : SNAKE_BRIGHT[first])
+                           + titleText + RESET, (int)strlen(titleText), tw) + "\n";
+    buf += centerColorText(border, 29, tw) + "\n\n";
+    buf += centerColorText(div, 29, tw) + "\n";
+    for (int k = 0; k < r.numSnakes; k++) {
+        int i = order[k];
+        char plain[64];
+        snprintf(plain, sizeof(plain), "%d. P%d %-5s  %5d  %s", k + 1, i + 1,
+                 r.bot[i] ? "(bot)" : r.remote[i] ? "(net)" : "",
+                 r.scores[i], r.alive[i] ? "alive" : "out  ");
+        buf += centerColorText(std::string(SNAKE_BRIGHT[i]) + plain + RESET,
+                               (int)strlen(plain), tw) + "\n";
+    }
+    buf += centerColorText(div, 29, tw) + "\n\n";
+    buf += centerColorText(std::string(BOLD) + GREEN + "Press [R] to Return to Menu" + RESET, 27, tw) + "\n";
+    buf += centerColorText(std::string(BOLD) + RED + "Press [Q] to Quit" + RESET, 17, tw) + "\n";
+    write(STDOUT_FILENO, buf.c_str(), buf.size());
+}
+
+// ===== WORKER POOL =========================================
+//
+// Persistent threads for data-parallel phases.  run(n, fn) calls
+// fn(0..n-1) spread over the pool plus the calling thread and
+// returns once every item is done.  Work items must not depend on
+// which thread runs them.
+//
+
+struct WorkerPool {
+    std::vector<std::thread>       threads;
+    std::mutex                     mu;
+    std::condition_variable        cvStart, cvDone;
+    std::function<void(int)>       job;
+    std::atomic<int>               nextItem{0};
+    int                            numItems = 0, busy = 0;
+    unsigned long                  generation = 0;
+    bool                           stopping = false;
+
+    explicit WorkerPool(int n) {
+        for (int i = 1; i < n; i++) threads.emplace_back([this] { workerLoop(); });
+    }
+    ~WorkerPool() {
+        { std::lock_guard<std::mutex> lk(mu); stopping = true; }
+        cvStart.notify_all();
+        for (auto &t : threads) t.join();
+    }
+    int size() const { return (int)threads.size() + 1; }
+
+    void drain() {
+        int i;
+        while ((i = nextItem.fetch_add(1, std::memory_order_relaxed)) < numItems) job(i);
+    }
+
+    void workerLoop() {
+        unsigned long seen = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lk(mu);
+                cvStart.wait(lk, [&] { return stopping || generation != seen; });
+                if (stopping) return;
+                seen = generation;
+            }
+            drain();
+            std::lock_guard<std::mutex> lk(mu);
+            if (--busy == 0) cvDone.notify_one();
+        }
+    }
+
+    void run(int n, const std::function<void(int)> &fn) {
+        if (threads.empty() || n <= 1) { for (int i = 0; i < n; i++) fn(i); return; }
+        {
+            std::lock_guard<std::mutex> lk(mu);
+            job = fn; numItems = n; nextItem = 0;
+            busy = (int)threads.size();
+            generation++;
+        }
+        cvStart.notify_all();
+        drain();
+        std::unique_lock<std::mutex> lk(mu);
+        cvDone.wait(lk, [&] { return busy == 0; });
+    }
+};
+
+// ===== BOARD LAYOUT ========================================
+//
+// Cell storage order for big-board kernels.  Row-major y*width+x
+// puts a cell's vertical neighbours a whole row apart, so flood
+// fills, BFS and block-by-block passes on large boards miss cache
+// (and the TLB) on almost every step.  Each layout below maps (x, y)
+// to a storage index and steps between neighbours on the index
+// alone, so kernels are written once as templates over the layout:
+//
+//   RowMajorLayout   y*width+x, what GameState uses
+//   TiledLayout<S>   2^S square tiles in row-major tile order,
+//                    row-major inside: 8x8 is one 64-byte line of
+//                    byte cells (or one bitmap word), 64x64 one page;
+//                    the arena's board is TiledLayout<6>
+//   MortonLayout     Z-order over the enclosing power-of-two square;
+//                    neighbours by masked add on the interleaved bits
+//
+// Row-major code keeps working through forEachRowMajor, which walks
+// (x, y) in reading order and hands out the storage index.  The
+// neighbour steps assume the result is on the board; kernels keep a
+// wall border instead of checking bounds.
+//
+
+struct RowMajorLayout {
+    int width = 0, height = 0;
+
+    void init(int w, int h) { width = w; height = h; }
+    size_t cells() const { return (size_t)width * height; }
+    size_t index(int x, int y) const { return (size_t)y * width + x; }
+    size_t left(size_t i)  const { return i - 1; }
+    size_t right(size_t i) const { return i + 1; }
+    size_t up(size_t i)    const { return i - width; }
+    size_t down(size_t i)  const { return i + width; }
+};
+
+template <int SHIFT>
+struct TiledLayout {
+    static const int    T = 1 << SHIFT;             // tile side
+    static const size_t TT = (size_t)T * T;
+    int width = 0, height = 0, tilesX = 0, tilesY = 0;
+
+    void init(int w, int h) {
+        width = w; height = h;
+        tilesX = (w + T - 1) / T; tilesY = (h + T - 1) / T;
+    }
+    size_t cells() const { return (size_t)tilesX * tilesY * TT; }
+    size_t index(int x, int y) const {
+        return ((size_t)(y >> SHIFT) * tilesX + (x >> SHIFT)) * TT + ((size_t)(y & (T - 1)) << SHIFT) + (x & (T - 1));
+    }
+    size_t left(size_t i)  const { return (i & (T - 1)) ? i - 1 : i - TT + T - 1; }
+    size_t right(size_t i) const { return (i & (T - 1)) != T - 1 ? i + 1 : i + TT - T + 1; }
+    size_t up(size_t i)    const { return (i & (TT - T)) ? i - T : i - tilesX * TT + TT - T; }
+    size_t down(size_t i)  const { return (i & (TT - T)) != TT - T ? i + T : i + tilesX * TT - TT + T; }
+};
+
+struct MortonLayout {
+    static const uint64_t XBITS = 0x5555555555555555ULL;   // x in the even bits
+    static const uint64_t YBITS = 0xAAAAAAAAAAAAAAAAULL;
+    int width = 0, height = 0, side = 1;
+
+    void init(int w, int h) {
+        width = w; height = h;
+        side = 1;
+        while (side < w || side < h) side *= 2;
+    }
+    size_t cells() const { return (size_t)side * side; }
+
+    static uint64_t spread(uint32_t v) {
+#if defined(__BMI2__)
+        return _pdep_u64(v, XBITS);
+#else
+        uint64_t x = v;
+        x = (x | (x << 16)) & 0x0000FFFF0000FFFFULL;
+        x = (x | (x << 8))  & 0x00FF00FF00FF00FFULL;
+        x = (x | (x << 4))  & 0x0F0F0F0F0F0F0F0FULL;
+        x = (x | (x << 2))  & 0x3333333333333333ULL;
+        x = (x | (x << 1))  & 0x5555555555555555ULL;
+        return x;
+#endif
+    }
+    size_t index(int x, int y) const { return spread((uint32_t)x) | (spread((uint32_t)y) << 1); }
+    // Setting the other axis' bits lets the carry ripple past them
+    size_t left(size_t i)  const { return (((i & XBITS) - 1) & XBITS) | (i & YBITS); }
+    size_t right(size_t i) const { return (((i | YBITS) + 1) & XBITS) | (i & YBITS); }
+    size_t up(size_t i)    const { return (((i & YBITS) - 1) & YBITS) | (i & XBITS); }
+    size_t down(size_t i)  const { return (((i | XBITS) + 1) & YBITS) | (i & XBITS); }
+};
+
+// fn(x, y, i, n) for the cells of [x0,x1) x [y0,y1) in reading
+// order, as runs: cells x..x+n-1 of row y are stored at i..i+n-1.
+// Kernels loop over a run themselves, so the inner loop is plain
+// contiguous memory whatever the layout.  Each layout supplies the
+// longest runs it has.
+template <typename Fn>
+static void forEachRowSpan(const RowMajorLayout &l, int x0, int y0, int x1, int y1, Fn fn) {
+    for (int y = y0; y < y1; y++) fn(x0, y, l.index(x0, y), x1 - x0);
+}
+
+// Morton: an even x and its right neighbour are adjacent, nothing longer
+template <typename Fn>
+static void forEachRowSpan(const MortonLayout &l, int x0, int y0, int x1, int y1, Fn fn) {
+    for (int y = y0; y < y1; y++) {
+        size_t i = l.index(x0, y);
+        for (int x = x0; x < x1; ) {
+            int n = (!(x & 1) && x + 1 < x1) ? 2 : 1;
+            fn(x, y, i, n);
+            i = l.right(i + n - 1);
+            x += n;
+        }
+    }
+}
+
+template <int SHIFT, typename Fn>
+static void forEachRowSpan(const TiledLayout<SHIFT> &l, int x0, int y0, int x1, int y1, Fn fn) {
+    const int T = TiledLayout<SHIFT>::T;
+    for (int y = y0; y < y1; y++)
+        for (int x = x0; x < x1; ) {
+            int n = std::min(T - (x & (T - 1)), x1 - x);
+            fn(x, y, l.index(x, y), n);
+            x += n;
+        }
+}
+
+// fn(x, y, index) for every board cell in reading order
+template <typename L, typename Fn>
+static void forEachRowMajor(const L &l, Fn fn) {
+    forEachRowSpan(l, 0, 0, l.width, l.height, [&](int x, int y, size_t i, int n) {
+        for (int k = 0; k < n; k++) fn(x + k, y, i + k);
+    });
+}
+
+// A board of T cells stored in layout L
+template <typename T, typename L>
+struct BoardGrid {
+    L              layout;
+    std::vector<T> cells;
+
+    void init(int w, int h, T fill) { layout.init(w, h); cells.assign(layout.cells(), fill); }
+    T &at(int x, int y)             { return cells[layout.index(x, y)]; }
+    const T &at(int x, int y) const { return cells[layout.index(x, y)]; }
+};
+
+// ─── Layout Kernels ─────────────────────────────────────────
+// 4-connected flood fill of the open (0) cells reachable from (x, y);
+// marks them 2 and returns how many.  queue must hold cells() entries.
+template <typename L>
+static size_t floodFill(BoardGrid<uint8_t, L> &b, int x, int y, std::vector<uint32_t> &queue) {
+    const L &l = b.layout;
+    uint8_t *c = b.cells.data();
+    size_t head = 0, tail = 0, start = l.index(x, y);
+    if (c[start]) return 0;
+    c[start] = 2;
+    queue[tail++] = (uint32_t)start;
+    while (head < tail) {
+        size_t i = queue[head++];
+        size_t nb[4] = { l.left(i), l.right(i), l.up(i), l.down(i) };
+        for (size_t n : nb)
+            if (!c[n]) { c[n] = 2; queue[tail++] = (uint32_t)n; }
+    }
+    return tail;
+}
+
+// Reading-order pass the renderer does: one glyph byte per cell into
+// a row buffer; returns a checksum so the work is kept
+template <typename L>
+static uint64_t renderScan(const BoardGrid<uint8_t, L> &b, std::vector<char> &row) {
+    static const char glyph[4] = { ' ', '#', '.', '?' };
+    const uint8_t *c = b.cells.data();
+    char *out = row.data();
+    uint64_t sum = 0;
+    const L &l = b.layout;
+    forEachRowSpan(l, 0, 0, l.width, l.height, [&](int x, int y, size_t i, int n) {
+        for (int k = 0; k < n; k++) out[x + k] = glyph[c[i + k] & 3];
+        if (x + n == l.width) sum += (uint64_t)out[l.width / 2] * (y + 1) + out[l.width / 3];
+    });
+    return sum;
+}
+
+// Block-by-block pass (as region-parallel updates walk the board):
+// counts filled cells per 64x64 block
+template <typename L>
+static uint64_t blockPass(const BoardGrid<uint8_t, L> &b) {
+    const L &l = b.layout;
+    const uint8_t *c = b.cells.data();
+    uint64_t sum = 0;
+    for (int by = 0; by < l.height; by += 64)
+        for (int bx = 0; bx < l.width; bx += 64) {
+            unsigned n = 0;
+            forEachRowSpan(l, bx, by, std::min(l.width, bx + 64), std::min(l.height, by + 64),
+                           [&](int, int, size_t i, int len) {
+                unsigned k = 0;
+                for (int j = 0; j < len; j++) k += c[i + j] == 2;
+                n += k;
+            });
+            sum = sum * 31 + n;
+        }
+    return sum;
+}
+
+// ─── Layout Benchmark ───────────────────────────────────────
+// The same w x h maze (random walls at ~30%, walled border) in each
+// layout: flood fill from the centre, a render-order scan, and a
+// 64x64 block pass.  The filled and checksum columns must match down
+// the table.
+template <typename L>
+static void layoutBenchRow(const char *name, int w, int h, std::vector<uint32_t> &queue, int reps) {
+    BoardGrid<uint8_t, L> b;
+    b.init(w, h, 1);
+    Rng r; r.seed(42);
+    for (int y = 0; y < h; y++)                 // same draws in every layout
+        for (int x = 0; x < w; x++) {
+            bool wall = x == 0 || y == 0 || x == w - 1 || y == h - 1 || r.below(100) < 30;
+            b.at(x, y) = wall ? 1 : 0;
+        }
+    b.at(w / 2, h / 2) = 0;
+    std::vector<uint8_t> fresh = b.cells;
+    std::vector<char> row(w);
+
+    long long fillUs = 0, scanUs = 0, blockUs = 0;
+    size_t filled = 0;
+    uint64_t check = 0;
+    for (int k = 0; k < reps; k++) {
+        b.cells = fresh;
+        long long t0 = nowMicros();
+        filled = floodFill(b, w / 2, h / 2, queue);
+        long long t1 = nowMicros();
+        check = renderScan(b, row);
+        long long t2 = nowMicros();
+        check ^= blockPass(b);
+        long long t3 = nowMicros();
+        fillUs += t1 - t0; scanUs += t2 - t1; blockUs += t3 - t2;
+    }
+    printf("%-10s %10.1f %12zu %10.1f %10.1f %18llx %8.1f\n", name, fillUs / 1000.0 / reps, filled,
+           scanUs / 1000.0 / reps, blockUs / 1000.0 / reps, (unsigned long long)check,
+           b.cells.size() / (1024.0 * 1024.0));
+    fflush(stdout);
+}
+
+void runLayoutBenchmark(int w, int h, int reps) {
+    w = std::max(3, w); h = std::max(3, h);
+    printf("board %dx%d, %d runs each\n", w, h, reps);
+    printf("%-10s %10s %12s %10s %10s %18s %8s\n", "layout", "fill ms", "filled",
+           "scan ms", "block ms", "checksum", "MiB");
+    std::vector<uint32_t> queue((size_t)w * h);
+    layoutBenchRow<RowMajorLayout>("row-major", w, h, queue, reps);
+    layoutBenchRow<TiledLayout<3>>("tiled 8x8", w, h, queue, reps);
+    layoutBenchRow<TiledLayout<6>>("tiled 64", w, h, queue, reps);
+    layoutBenchRow<MortonLayout>("morton", w, h, queue, reps);
+}
+
+// ===== AI ARENA ============================================
+//
+// Stress/showcase mode: thousands of bot snakes on a huge board.
+//
+// Each tick runs in phases over horizontal strips of the board
+// (ARENA_STRIP rows, bucketed by head position).  The board is
+// stored in ArenaLayout, 64x64 tiles, and a strip is one row of
+// tiles, so each strip's cells are one contiguous block of storage
+// and a bot's look-ahead stays inside a page or two.  Every phase only
+// reads state frozen by the previous one or writes cells that
+// exactly one snake owns, so the result is identical for any
+// thread count:
+//
+//   intent   bots choose a move from the pre-tick board
+//   release  tails that will move leave the board
+//   claim    heads claim their target cell; walls, bodies and
+//            contested cells kill (every claimant of a cell dies)
+//   apply    dead snakes are lifted off, survivors advance
+//   spawn    serial, in id order: apples and respawning snakes are
+//            placed through the free-cell index
+//
+// Snakes move at their own pace, the single-player speed curve
+// (calcMoveInterval: faster with score, slower vertically), so only
+// a few are due on any tick.  A tick is ARENA_TICK_US of game time
+// and the phases above run over the due snakes only; everyone else
+// is a still obstacle for that tick.  Deadlines live in a hashed
+// timing wheel of ARENA_WHEEL slots (slot = tick mod ARENA_WHEEL,
+// intrusive per-slot lists): each move interval fits inside one
+// revolution, and the rarer long waits (respawns) are simply passed
+// over until their revolution comes round.  A tick's movers are
+// taken in id order, so the result does not depend on the order
+// they were scheduled in.
+//
+// The free-cell index keeps a 64x64 occupancy bitmap and a free
+// count per tile; a Fenwick tree over tile counts picks the k-th
+// free cell in O(log tiles + 64).
+//
+
+typedef TiledLayout<6> ArenaLayout;
+static const int ARENA_STRIP       = ArenaLayout::T;    // one row of tiles
+static const int ARENA_TILE        = 64;
+static const int ARENA_TICK_US     = 5000;   // game time per tick
+static const int ARENA_WHEEL       = 64;     // slots, power of two, > longest move in ticks
+static const int ARENA_RESPAWN     = 400;    // ticks a dead snake waits
+static const int ARENA_START_LEN   = 3;
+static const int ARENA_FOOD_SCAN   = 8;      // cells a bot looks ahead
+
+struct FreeCellIndex {
+    int width = 0, height = 0, tilesX = 0, tilesY = 0;
+    std::unique_ptr<std::atomic<uint64_t>[]> bits;   // per tile: 64 rows of 64 bits, 1 = taken
+    std::unique_ptr<std::atomic<int>[]>      freeCount;
+    std::vector<int>                         fenwick;
+
+    void init(int w, int h) {
+        width = w; height = h;
+        tilesX = (w + ARENA_TILE - 1) / ARENA_TILE;
+        tilesY = (h + ARENA_TILE - 1) / ARENA_TILE;
+        int nt = tilesX * tilesY;
+        bits.reset(new std::atomic<uint64_t>[(size_t)nt * ARENA_TILE]);
+        freeCount.reset(new std::atomic<int>[nt]);
+        for (int t = 0; t < nt; t++) {
+            int tx = t % tilesX, ty = t / tilesX, n = 0;
+            for (int r = 0; r < ARENA_TILE; r++) {
+                int y = ty * ARENA_TILE + r;
+                int cols = std::max(0, std::min(ARENA_TILE, w - tx * ARENA_TILE));
+                uint64_t taken = (y >= h) ? ~0ULL
+                               : (cols == 64 ? 0ULL : ~((1ULL << cols) - 1));
+                bits[(size_t)t * ARENA_TILE + r].store(taken, std::memory_order_relaxed);
+                n += 64 - __builtin_popcountll(taken);
+            }
+            freeCount[t].store(n, std::memory_order_relaxed);
+        }
+        fenwick.assign(nt + 1, 0);
+    }
+
+    std::atomic<uint64_t> &word(Point p, uint64_t &mask) {
+        int t = (p.y / ARENA_TILE) * tilesX + p.x / ARENA_TILE;
+        mask = 1ULL << (p.x % ARENA_TILE);
+        return bits[(size_t)t * ARENA_TILE + p.y % ARENA_TILE];
+    }
+    std::atomic<int> &count(Point p) {
+        return freeCount[(p.y / ARENA_TILE) * tilesX + p.x / ARENA_TILE];
+    }
+
+    // Safe from several threads as long as each cell has one writer
+    void take(Point p) {
+        uint64_t m; word(p, m).fetch_or(m, std::memory_order_relaxed);
+        count(p).fetch_sub(1, std::memory_order_relaxed);
+    }
+    void release(Point p) {
+        uint64_t m; word(p, m).fetch_and(~m, std::memory_order_relaxed);
+        count(p).fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Serial spawn helpers
+    void buildFenwick() {
+        int nt = tilesX * tilesY;
+        for (int i = 1; i <= nt; i++) fenwick[i] = freeCount[i - 1].load(std::memory_order_relaxed);
+        for (int i = 1; i <= nt; i++) {
+            int j = i + (i & -i);
+            if (j <= nt) fenwick[j] += fenwick[i];
+        }
+    }
+    int totalFree() const {
+        int s = 0;
+        for (int i = (int)fenwick.size() - 1; i > 0; i -= i & -i) s += fenwick[i];
+        return s;
+    }
+    void takeIndexed(Point p) {
+        take(p);
+        int nt = tilesX * tilesY;
+        for (int i = (p.y / ARENA_TILE) * tilesX + p.x / ARENA_TILE + 1; i <= nt; i += i & -i)
+            fenwick[i]--;
+    }
+    // k-th free cell (0-based) in tile-major order
+    Point select(int k) const {
+        int nt = tilesX * tilesY, pos = 0, step = 1;
+        while (step * 2 <= nt) step *= 2;
+        for (; step; step >>= 1)
+            if (pos + step <= nt && fenwick[pos + step] <= k) { pos += step; k -= fenwick[pos]; }
+        int t = pos;
+        for (int r = 0; r < ARENA_TILE; r++) {
+            uint64_t freeBits = ~bits[(size_t)t * ARENA_TILE + r].load(std::memory_order_relaxed);
+            int n = __builtin_popcountll(freeBits);
+            if (k >= n) { k -= n; continue; }
+            while (k--) freeBits &= freeBits - 1;
+            int c = __builtin_ctzll(freeBits);
+            return { (t % tilesX) * ARENA_TILE + c, (t / tilesX) * ARENA_TILE + r };
+        }
+        return { -1, -1 };
+    }
+};
+
+struct ArenaSnake {
+    std::deque<Point> body;
+    Direction         dir;
+    int               score, pendingGrow;
+    int               respawnIn;        // set on death, turned into a deadline by stepArena
+    bool              alive;
+    Rng               rng;
+};
+
+template <typename L = ArenaLayout>
+struct Arena {
+    L                       layout;     // owner, food and claim are stored in it
+    int                     width, height, numStrips;
+    int                     targetFood;
+    std::vector<ArenaSnake> snakes;
+    std::vector<uint32_t>   owner;      // 0 empty, else snake id + 1
+    std::vector<uint8_t>    food;
+    std::unique_ptr<std::atomic<uint32_t>[]> claim;
+    std::unique_ptr<std::atomic<uint8_t>[]>  dies;
+    std::vector<Point>      nextHead;
+    std::vector<uint8_t>    grows;
+    std::vector<std::vector<int>> strips;
+    std::vector<int>        stripEaten;
+    int                     foodCount;
+    unsigned long           tick, moves;
+    std::vector<int>        wheel;      // slot -> first snake id, -1 empty
+    std::vector<int>        wheelNext;  // per snake, next id in its slot
+    std::vector<unsigned long> dueTick; // per snake
+    std::vector<int>        due;        // this tick's snakes, ascending id
+    FreeCellIndex           freeCells;
+    bool                    fenwickStale;   // rebuilt on the first spawn of a tick
+    Rng                     rng;
+};
+
+template <typename L>
+static inline bool arenaInBoard(const Arena<L> &a, Point p) {
+    return p.x >= 0 && p.x < a.width && p.y >= 0 && p.y < a.height;
+}
+template <typename L>
+static inline size_t arenaCell(const Arena<L> &a, Point p) { return a.layout.index(p.x, p.y); }
+
+template <typename L>
+static void arenaSchedule(Arena<L> &a, int id, unsigned long at) {
+    int slot = (int)(at & (ARENA_WHEEL - 1));
+    a.dueTick[id] = at;
+    a.wheelNext[id] = a.wheel[slot];
+    a.wheel[slot] = id;
+}
+
+static unsigned long arenaMoveTicks(const ArenaSnake &s) {
+    long long iv = calcMoveInterval(s.score, s.dir);
+    return (unsigned long)std::max(1LL, (iv + ARENA_TICK_US / 2) / ARENA_TICK_US);
+}
+
+// Unlinks the current slot into a.due; entries for a later
+// revolution are linked back
+template <typename L>
+static void arenaCollectDue(Arena<L> &a) {
+    int slot = (int)(a.tick & (ARENA_WHEEL - 1));
+    int id = a.wheel[slot];
+    a.wheel[slot] = -1;
+    a.due.clear();
+    while (id >= 0) {
+        int next = a.wheelNext[id];
+        if (a.dueTick[id] == a.tick) a.due.push_back(id);
+        else { a.wheelNext[id] = a.wheel[slot]; a.wheel[slot] = id; }
+        id = next;
+    }
+    std::sort(a.due.begin(), a.due.end());
+}
+
+// Free-cell counts moved during the parallel phases; the Fenwick
+// tree is only rebuilt on ticks that actually spawn something
+template <typename L>
+static int arenaTotalFree(Arena<L> &a) {
+    if (a.fenwickStale) { a.freeCells.buildFenwick(); a.fenwickStale = false; }
+    return a.freeCells.totalFree();
+}
+
+template <typename L>
+static bool arenaPlaceSnake(Arena<L> &a, int id) {
+    int nfree = arenaTotalFree(a);
+    if (nfree == 0) return false;
+    Point p = a.freeCells.select(a.rng.below(nfree));
+    ArenaSnake &s = a.snakes[id];
+    s.body.clear();
+    s.body.push_back(p);
+    s.dir = (Direction)a.rng.below(4);
+    s.pendingGrow = ARENA_START_LEN - 1;
+    s.alive = true;
+    s.respawnIn = 0;
+    a.owner[arenaCell(a, p)] = (uint32_t)id + 1;
+    a.freeCells.takeIndexed(p);
+    return true;
+}
+
+template <typename L>
+static bool arenaPlaceFood(Arena<L> &a) {
+    int nfree = arenaTotalFree(a);
+    if (nfree == 0) return false;
+    Point p = a.freeCells.select(a.rng.below(nfree));
+    a.food[arenaCell(a, p)] = 1;
+    a.freeCells.takeIndexed(p);
+    a.foodCount++;
+    return true;
+}
+
+template <typename L>
+void initArena(Arena<L> &a, int width, int height, int numSnakes, uint64_t seed) {
+    a.width = width; a.height = height;
+    a.layout.init(width, height);
+    a.numStrips = (height + ARENA_STRIP - 1) / ARENA_STRIP;
+    a.targetFood = std::max(1, numSnakes / 2);
+    size_t cells = a.layout.cells();
+    a.owner.assign(cells, 0);
+    a.food.assign(cells, 0);
+    a.claim.reset(new std::atomic<uint32_t>[cells]);
+    for (size_t i = 0; i < cells; i++) a.claim[i].store(0, std::memory_order_relaxed);
+    a.snakes.assign(numSnakes, ArenaSnake());
+    a.dies.reset(new std::atomic<uint8_t>[numSnakes]);
+    a.nextHead.assign(numSnakes, Point{0, 0});
+    a.grows.assign(numSnakes, 0);
+    a.strips.assign(a.numStrips, std::vector<int>());
+    a.stripEaten.assign(a.numStrips, 0);
+    a.foodCount = 0; a.tick = 0; a.moves = 0;
+    a.wheel.assign(ARENA_WHEEL, -1);
+    a.wheelNext.assign(numSnakes, -1);
+    a.dueTick.assign(numSnakes, 0);
+    a.due.clear();
+    a.freeCells.init(width, height);
+    a.rng.seed(seed);
+    a.fenwickStale = true;
+
+    for (int i = 0; i < numSnakes; i++) {
+        a.snakes[i].rng.seed(seed ^ ((uint64_t)(i + 1) * 0x9E3779B97F4A7C15ULL));
+        a.snakes[i].score = 0;
+        a.dies[i].store(0, std::memory_order_relaxed);
+        if (arenaPlaceSnake(a, i)) arenaSchedule(a, i, a.rng.below((int)arenaMoveTicks(a.snakes[i])));
+        else                       arenaSchedule(a, i, ARENA_RESPAWN);
+    }
+    while (a.foodCount < a.targetFood && arenaPlaceFood(a)) {}
+}
+
+template <typename L>
+static bool arenaFree(const Arena<L> &a, Point p) {
+    return arenaInBoard(a, p) && a.owner[arenaCell(a, p)] == 0;
+}
+
+// Pre-tick board is read-only here
+template <typename L>
+static void arenaIntent(Arena<L> &a, int id) {
+    ArenaSnake &s = a.snakes[id];
+    Point head = s.body.front();
+    const Direction all[4] = { UP, DOWN, LEFT, RIGHT };
+    int bestScore = -1000000;
+    Direction best = s.dir;
+    for (Direction d : all) {
+        if (isOpposite(d, s.dir) && s.body.size() > 1) continue;
+        Point p = stepPoint(head, d);
+        int sc = s.rng.below(8);
+        if (d == s.dir) sc += 4;
+        if (!arenaFree(a, p)) sc -= 100000;
+        Point q = p;
+        for (int k = 0; k < ARENA_FOOD_SCAN; k++) {
+            if (!arenaInBoard(a, q)) break;
+            size_t c = arenaCell(a, q);
+            if (a.food[c]) { sc += 200 - k * 20; break; }
+            if (a.owner[c]) break;
+            q = stepPoint(q, d);
+        }
+        if (sc > bestScore) { bestScore = sc; best = d; }
+    }
+    s.dir = best;
+    Point nh = stepPoint(head, best);
+    a.nextHead[id] = nh;
+    a.grows[id] = s.pendingGrow > 0 || (arenaInBoard(a, nh) && a.food[arenaCell(a, nh)]);
+}
+
+template <typename L>
+static void arenaRelease(Arena<L> &a, int id) {
+    if (a.grows[id]) return;
+    Point t = a.snakes[id].body.back();
+    a.owner[arenaCell(a, t)] = 0;
+    a.freeCells.release(t);
+}
+
+template <typename L>
+static void arenaClaim(Arena<L> &a, int id) {
+    Point nh = a.nextHead[id];
+    if (!arenaInBoard(a, nh)) { a.dies[id].store(1, std::memory_order_relaxed); return; }
+    size_t c = arenaCell(a, nh);
+    if (a.owner[c]) a.dies[id].store(1, std::memory_order_relaxed);
+    uint32_t expected = 0;
+    if (!a.claim[c].compare_exchange_strong(expected, (uint32_t)id + 1, std::memory_order_relaxed)) {
+        a.dies[id].store(1, std::memory_order_relaxed);
+        a.dies[expected - 1].store(1, std::memory_order_relaxed);
+    }
+}
+
+template <typename L>
+static void arenaApply(Arena<L> &a, int id, int strip) {
+    ArenaSnake &s = a.snakes[id];
+    Point nh = a.nextHead[id];
+    if (arenaInBoard(a, nh)) a.claim[arenaCell(a, nh)].store(0, std::memory_order_relaxed);
+
+    if (a.dies[id].load(std::memory_order_relaxed)) {
+        if (!a.grows[id]) s.body.pop_back();
+        for (auto &p : s.body) {
+            a.owner[arenaCell(a, p)] = 0;
+            a.freeCells.release(p);
+        }
+        s.body.clear();
+        s.alive = false;
+        s.respawnIn = ARENA_RESPAWN;
+        a.dies[id].store(0, std::memory_order_relaxed);
+        return;
+    }
+
+    size_t c = arenaCell(a, nh);
+    s.body.push_front(nh);
+    a.owner[c] = (uint32_t)id + 1;
+    if (a.food[c]) {
+        // the cell stays taken in the free index: food -> head
+        a.food[c] = 0;
+        s.score += 10;
+        s.pendingGrow++;
+        a.stripEaten[strip]++;
+    } else {
+        a.freeCells.take(nh);
+    }
+    if (a.grows[id]) s.pendingGrow--;
+    else s.body.pop_back();
+}
+
+template <typename L>
+void stepArena(Arena<L> &a, WorkerPool &pool) {
+    arenaCollectDue(a);
+    for (auto &st : a.strips) st.clear();
+    for (int id : a.due)
+        if (a.snakes[id].alive) a.strips[a.snakes[id].body.front().y / ARENA_STRIP].push_back(id);
+
+    pool.run(a.numStrips, [&](int r) { for (int id : a.strips[r]) arenaIntent(a, id); });
+    pool.run(a.numStrips, [&](int r) { for (int id : a.strips[r]) arenaRelease(a, id); });
+    pool.run(a.numStrips, [&](int r) { for (int id : a.strips[r]) arenaClaim(a, id); });
+    pool.run(a.numStrips, [&](int r) {
+        a.stripEaten[r] = 0;
+        for (int id : a.strips[r]) arenaApply(a, id, r);
+    });
+
+    for (int r = 0; r < a.numStrips; r++) a.foodCount -= a.stripEaten[r];
+    a.fenwickStale = true;
+    for (int id : a.due) {
+        ArenaSnake &s = a.snakes[id];
+        if (s.alive) {                                  // moved
+            a.moves++;
+            arenaSchedule(a, id, a.tick + arenaMoveTicks(s));
+        } else if (s.respawnIn) {                       // died just now
+            arenaSchedule(a, id, a.tick + s.respawnIn);
+            s.respawnIn = 0;
+        } else if (arenaPlaceSnake(a, id)) {            // wait is over
+            arenaSchedule(a, id, a.tick + arenaMoveTicks(s));
+        } else {
+            arenaSchedule(a, id, a.tick + ARENA_RESPAWN);
+        }
+    }
+    while (a.foodCount < a.targetFood && arenaPlaceFood(a)) {}
+    a.tick++;
+}
+
+template <typename L>
+uint64_t hashArena(const Arena<L> &a) {
+    uint64_t h = 1469598103934665603ULL;
+    auto mix = [&](uint64_t v) { h ^= v; h *= 1099511628211ULL; };
+    for (const auto &s : a.snakes) {
+        mix(s.alive); mix((uint64_t)s.score); mix(s.body.size());
+        for (auto &p : s.body) mix(((uint64_t)p.x << 32) | (uint32_t)p.y);
+    }
+    mix((uint64_t)a.foodCount);
+    forEachRowMajor(a.layout, [&](int, int, size_t i) {    // same for every layout
+        mix(((uint64_t)a.owner[i] << 1) | a.food[i]);
+    });
+    return h;
+}
+
+template <typename L>
+static int arenaAliveCount(const Arena<L> &a) {
+    int n = 0;
+    for (const auto &s : a.snakes) if (s.alive) n++;
+    return n;
+}
+
+// ─── Arena Benchmark ────────────────────────────────────────
+// Prints ticks/s and snake moves/s for each snake count x thread
+// count x board layout; the hash column must not change within a
+// snake count.
+template <typename L>
+static void runArenaBenchRow(const char *name, int width, int height, int n, int t, int ticks) {
+    Arena<L> a;
+    initArena(a, width, height, n, 12345);
+    WorkerPool pool(t);
+    long long t0 = nowMicros();
+    for (int k = 0; k < ticks; k++) stepArena(a, pool);
+    long long el = std::max(1LL, nowMicros() - t0);
+    printf("%8d %8d %6s %12.1f %12.0f %10d %18llx\n", n, t, name, ticks * 1e6 / el, a.moves * 1e6 / el,
+           arenaAliveCount(a), (unsigned long long)hashArena(a));
+    fflush(stdout);
+}
+
+void runArenaBenchmark(int width, int height, const std::vector<int> &snakeCounts,
+                       const std::vector<int> &threadCounts, const std::vector<std::string> &layouts,
+                       int ticks) {
+    printf("arena %dx%d, %d ticks of %d us per run\n", width, height, ticks, ARENA_TICK_US);
+    printf("%8s %8s %6s %12s %12s %10s %18s\n", "snakes", "threads", "layout", "ticks/s", "moves/s",
+           "alive", "state hash");
+    for (int n : snakeCounts)
+        for (int t : threadCounts)
+            for (const auto &l : layouts) {
+                if (l == "row") runArenaBenchRow<RowMajorLayout>("row", width, height, n, t, ticks);
+                else            runArenaBenchRow<ArenaLayout>("tiled", width, height, n, t, ticks);
+            }
+}
+
+// ─── Arena Showcase ─────────────────────────────────────────
+// Live view of the whole board squeezed into the terminal; each
+// character shades the share of taken cells in its block.
+void runArenaWatch(int width, int height, int numSnakes, int threads) {
+    Arena<> a;
+    initArena(a, width, height, numSnakes, (uint64_t)nowMicros());
+    WorkerPool pool(threads);
+    static const char shades[] = " .:-=+*#%@";
+    std::string buf;
+
+    enableRawMode();
+    hideCursor();
+    write(STDOUT_FILENO, "\033[?1049h", 8);
+    clearScreen();
+
+    long long tickTime = 0;
+    while (!g_interrupted) {
+        long long fs = nowMicros();
+        char c;
+        if (readKeyByte(c) && (c == 'q' || c == 'Q')) break;
+
+        long long ts = nowMicros();
+        for (int k = 0; k < RENDER_TICK_US / ARENA_TICK_US; k++) stepArena(a, pool);
+        tickTime = nowMicros() - ts;
+
+        int tw, th; getTerminalSize(tw, th);
+        int vw = std::max(1, tw), vh = std::max(1, th - 2);
+        int bw = (width + vw - 1) / vw, bh = (height + vh - 1) / vh;
+        buf.clear();
+        buf += "\033[1;1H";
+        char hdr[160];
+        snprintf(hdr, sizeof(hdr), "%s%sARENA%s %dx%d  tick %lu  alive %d/%d  food %d  step %.2f ms  threads %d  [Q] quit",
+                 BOLD, BRIGHT_GREEN, RESET, width, height, a.tick, arenaAliveCount(a),
+                 numSnakes, a.foodCount, tickTime / 1000.0, pool.size());
+        buf += hdr; buf += ERASE_LINE "\n";
+        for (int vy = 0; vy * bh < height && vy < vh; vy++) {
+            for (int vx = 0; vx * bw < width && vx < vw; vx++) {
+                int taken = 0, apples = 0, n = 0;
+                forEachRowSpan(a.layout, vx * bw, vy * bh, std::min(width, (vx + 1) * bw),
+                               std::min(height, (vy + 1) * bh), [&](int, int, size_t i, int len) {
+                    for (int k = 0; k < len; k++) { taken += a.owner[i + k] != 0; apples += a.food[i + k]; }
+                    n += len;
+                });
+                if (taken == 0 && apples) { buf += RED "." RESET; continue; }
+                int lvl = n ? (taken * 9 + n - 1) / n : 0;
+                buf += shades[std::min(9, lvl)];
+            }
+            buf += ERASE_LINE "\n";
+        }
+        buf += ERASE_BELOW;
+        write(STDOUT_FILENO, buf.c_str(), buf.size());
+
+        long long sl = RENDER_TICK_US - (nowMicros() - fs);
+        if (sl > 0) usleep(static_cast<useconds_t>(sl));
+    }
+    performCleanup();
+}
+
+// ===== NETWORK PLAY ========================================
+//
+// Two vsnake processes play head to head in deterministic lockstep:
+//
+//   vsnake --host 127.0.0.1:7777      (or a UNIX socket path)
+//   vsnake --join 127.0.0.1:7777
+//
+// Only inputs cross the wire.  The host picks the seed; both sides
+// run the same MultiGame and step tick t only once both players'
+// inputs for t are known.  Inputs are scheduled NET_INPUT_DELAY
+// ticks ahead so a round trip shorter than the delay never stalls.
+// Tick pacing comes from the game state (calcBaseInterval), not
+// from the render loop.  Every NET_HASH_EVERY ticks both sides
+// swap the incremental state hash; a mismatch stops the game.
+//
+// Wire messages are 16 bytes, little-endian:
+//   u8 type | u8 arg | u16 0 | u32 tick | u64 value
+//
+
+static const int     NET_DEFAULT_PORT = 7777;
+static const int     NET_INPUT_DELAY  = 3;
+static const int     NET_HASH_EVERY   = 8;
+static const int     NET_HISTORY      = 256;       // ring size, > delay + hash lag
+static const int     NET_PING_US      = 500000;
+static const int     NET_CONNECT_MS   = 10000;
+static const uint32_t NET_PROTOCOL    = 1;
+static const uint8_t NET_NO_INPUT     = 0xFF;
+
+enum NetMsgType : uint8_t {
+    NET_HELLO = 1, NET_INPUT, NET_HASH, NET_PING, NET_PONG, NET_BYE
+};
+
+struct NetMsg {
+    uint8_t  type, arg;
+    uint32_t tick;
+    uint64_t value;
+};
+
+static const int NET_MSG_SIZE = 16;
+
+static void encodeNetMsg(const NetMsg &m, uint8_t *p) {
+    p[0] = m.type; p[1] = m.arg; p[2] = p[3] = 0;
+    for (int i = 0; i < 4; i++) p[4 + i] = (uint8_t)(m.tick >> (8 * i));
+    for (int i = 0; i < 8; i++) p[8 + i] = (uint8_t)(m.value >> (8 * i));
+}
+
+static NetMsg decodeNetMsg(const uint8_t *p) {
+    NetMsg m;
+    m.type = p[0]; m.arg = p[1]; m.tick = 0; m.value = 0;
+    for (int i = 0; i < 4; i++) m.tick  |= (uint32_t)p[4 + i] << (8 * i);
+    for (int i = 0; i < 8; i++) m.value |= (uint64_t)p[8 + i] << (8 * i);
+    return m;
+}
+
+// ─── Sockets ────────────────────────────────────────────────
+// "host:port", ":port", "port" -> TCP; anything with a '/' or a
+// "unix:" prefix -> UNIX stream socket.
+static bool isUnixSpec(const std::string &spec) {
+    return spec.compare(0, 5, "unix:") == 0 || spec.find('/') != std::string::npos;
+}
+
+static std::string unixPath(const std::string &spec) {
+    return spec.compare(0, 5, "unix:") == 0 ? spec.substr(5) : spec;
+}
+
+static void splitHostPort(const std::string &spec, std::string &host, std::string &port) {
+    size_t c = spec.rfind(':');
+    if (c == std::string::npos) {
+        bool digits = !spec.empty() && spec.find_first_not_of("0123456789") == std::string::npos;
+        host = digits ? "127.0.0.1" : spec;
+        port = digits ? spec : std::to_string(NET_DEFAULT_PORT);
+    } else {
+        host = c ? spec.substr(0, c) : "0.0.0.0";
+        port = spec.substr(c + 1);
+    }
+}
+
+// True when path is a UNIX socket nobody accepts on any more (left by
+// a process that died), so binding may replace it
+static bool unixSocketStale(const std::string &path) {
+    struct stat st;
+    if (lstat(path.c_str(), &st) != 0 || !S_ISSOCK(st.st_mode)) return false;
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return false;
+    struct sockaddr_un sa; memset(&sa, 0, sizeof(sa));
+    sa.sun_family = AF_UNIX;
+    memcpy(sa.sun_path, path.c_str(), path.size());
+    bool stale = connect(fd, (struct sockaddr*)&sa, sizeof(sa)) != 0 && errno == ECONNREFUSED;
+    close(fd);
+    return stale;
+}
+
+static void tuneSocket(int fd) {
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+int netListen(const std::string &spec) {
+    if (isUnixSpec(spec)) {
+        std::string path = unixPath(spec);
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) return -1;
+        struct sockaddr_un sa; memset(&sa, 0, sizeof(sa));
+        sa.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(sa.sun_path)) { close(fd); errno = ENAMETOOLONG; return -1; }
+        memcpy(sa.sun_path, path.c_str(), path.size());
+        // a live listener keeps its path; only a dead one's is reused
+        bool bound = bind(fd, (struct sockaddr*)&sa, sizeof(sa)) == 0;
+        if (!bound && errno == EADDRINUSE && unixSocketStale(path)) {
+            unlink(path.c_str());
+            bound = bind(fd, (struct sockaddr*)&sa, sizeof(sa)) == 0;
+        }
+        if (!bound || listen(fd, 64) != 0) {
+            int e = errno;
+            close(fd); errno = e; return -1;
+        }
+        return fd;
+    }
+    std::string host, port;
+    splitHostPort(spec, host, port);
+    struct addrinfo hints, *res = nullptr;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC; hints.ai_socktype = SOCK_STREAM; hints.ai_flags = AI_PASSIVE;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &res) != 0) return -1;
+    int fd = -1;
+    for (struct addrinfo *ai = res; ai; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd < 0) continue;
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && listen(fd, 64) == 0) break;
+        close(fd); fd = -1;
+    }
+    freeaddrinfo(res);
+    return fd;
+}
+
+// Retries until the peer is up or NET_CONNECT_MS passes
+int netConnect(const std::string &spec) {
+    long long deadline = nowMicros() + NET_CONNECT_MS * 1000LL;
+    while (!g_interrupted) {
+        int fd = -1;
+        if (isUnixSpec(spec)) {
+            std::string path = unixPath(spec);
+            fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            struct sockaddr_un sa; memset(&sa, 0, sizeof(sa));
+            sa.sun_family = AF_UNIX;
+            strncpy(sa.sun_path, path.c_str(), sizeof(sa.sun_path) - 1);
+            if (fd >= 0 && connect(fd, (struct sockaddr*)&sa, sizeof(sa)) == 0) return fd;
+        } else {
+            std::string host, port;
+            splitHostPort(spec, host, port);
+            if (host == "0.0.0.0") host = "127.0.0.1";
+            struct addrinfo hints, *res = nullptr;
+            memset(&hints, 0, sizeof(hints));
+            hints.ai_family = AF_UNSPEC; hints.ai_socktype = SOCK_STREAM;
+            if (getaddrinfo(host.c_str(), port.c_str(), &hints, &res) == 0) {
+                for (struct addrinfo *ai = res; ai; ai = ai->ai_next) {
+                    fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+                    if (fd < 0) continue;
+                    if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) { tuneSocket(fd); break; }
+                    close(fd); fd = -1;
+                }
+                freeaddrinfo(res);
+                if (fd >= 0) return fd;
+            }
+        }
+        if (fd >= 0) close(fd);
+        if (nowMicros() > deadline) return -1;
+        usleep(100000);
+    }
+    return -1;
+}
+
+static void setNonBlocking(int fd) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+}
+
+// ─── Message Stream ─────────────────────────────────────────
+struct NetConn {
+    int         fd = -1;
+    std::string rx, tx;
+    bool        closed = false;
+
+    void send(uint8_t type, uint8_t arg, uint32_t tick, uint64_t value) {
+        uint8_t b[NET_MSG_SIZE];
+        encodeNetMsg({type, arg, tick, value}, b);
+        tx.append((const char*)b, NET_MSG_SIZE);
+        flush();
+    }
+    void flush() {
+        while (!tx.empty() && !closed) {
+            ssize_t n = write(fd, tx.data(), tx.size());
+            if (n > 0) { tx.erase(0, (size_t)n); continue; }
+            if (n < 0 && (errno == EAGAIN || errno == EINTR)) return;
+            closed = true;
+        }
+    }
+    // Appends every complete message that has arrived
+    void poll(std::vector<NetMsg> &out) {
+        char b[4096];
+        while (!closed) {
+            ssize_t n = read(fd, b, sizeof(b));
+            if (n > 0) { rx.append(b, (size_t)n); continue; }
+            if (n < 0 && (errno == EAGAIN || errno == EINTR)) break;
+            closed = true;
+        }
+        size_t off = 0;
+        while (rx.size() - off >= (size_t)NET_MSG_SIZE) {
+            out.push_back(decodeNetMsg((const uint8_t*)rx.data() + off));
+            off += NET_MSG_SIZE;
+        }
+        rx.erase(0, off);
+    }
+    // Blocking wait for one message (handshake only)
+    bool waitFor(NetMsg &m, int timeoutMs) {
+        long long deadline = nowMicros() + timeoutMs * 1000LL;
+        std::vector<NetMsg> got;
+        while (!closed && !g_interrupted && nowMicros() < deadline) {
+            poll(got);
+            if (!got.empty()) {
+                m = got.front();
+                // keep anything that came in behind it
+                std::string rest;
+                for (size_t i = 1; i < got.size(); i++) {
+                    uint8_t b[NET_MSG_SIZE]; encodeNetMsg(got[i], b);
+                    rest.append((const char*)b, NET_MSG_SIZE);
+                }
+                rx = rest + rx;
+                return true;
+            }
+            struct pollfd pfd = { fd, POLLIN, 0 };
+            ::poll(&pfd, 1, 50);
+        }
+        return false;
+    }
+};
+
+// ─── Deterministic State Hash ───────────────────────────────
+uint64_t multiStateHash(const MultiGame &m) {
+    uint64_t h = m.zobrist;
+    auto mix = [&](uint64_t v) { h ^= v + 0x9E3779B97F4A7C15ULL + (h << 6) + (h >> 2); };
+    for (int i = 0; i < m.numSnakes; i++) {
+        const Snake &s = m.snakes[i];
+        mix((uint64_t)s.score); mix(s.alive); mix((uint64_t)s.dir); mix(s.body.size());
+    }
+    mix(((uint64_t)m.apple.x << 32) | (uint32_t)m.apple.y);
+    mix(m.rng.s);
+    return h;
+}
+
+// Apply one tick's remote or local input to a snake, identically
+// on both peers
+static void applyNetInput(Snake &s, uint8_t in) {
+    if (in == NET_NO_INPUT || !s.alive) return;
+    Direction d = (Direction)in;
+    if (!isOpposite(d, s.dir)) s.nextDir = d;
+}
+
+// Keys while playing online: directions queue (max 3), q quits
+static bool readNetKeys(std::deque<Direction> &q) {
+    char c = 0;
+    while (readKeyByte(c)) {
+        if (c == 'q' || c == 'Q') return true;
+
+        int d = -1;
+        if (c == '\033') {
+            char seq[2] = {0, 0};
+            fd_set f2; struct timeval t2;
+            FD_ZERO(&f2); FD_SET(STDIN_FILENO, &f2); t2 = {0, 5000};
+            if (select(STDIN_FILENO + 1, &f2, nullptr, nullptr, &t2) > 0)
+                read(STDIN_FILENO, &seq[0], 1);
+            FD_ZERO(&f2); FD_SET(STDIN_FILENO, &f2); t2 = {0, 5000};
+            if (select(STDIN_FILENO + 1, &f2, nullptr, nullptr, &t2) > 0)
+                read(STDIN_FILENO, &seq[1], 1);
+            if (seq[0] == '[') {
+                switch (seq[1]) {
+                    case 'A': d = UP; break;   case 'B': d = DOWN; break;
+                    case 'D': d = LEFT; break; case 'C': d = RIGHT; break;
+                }
+            }
+        } else {
+            switch (c) {
+                case 'w': case 'W': case 'k': case 'K': d = UP;    break;
+                case 's': case 'S': case 'j': case 'J': d = DOWN;  break;
+                case 'a': case 'A': case 'h': case 'H': d = LEFT;  break;
+                case 'd': case 'D': case 'l': case 'L': d = RIGHT; break;
+            }
+        }
+        if (d >= 0 && q.size() < 3 && (q.empty() || q.back() != (Direction)d))
+            q.push_back((Direction)d);
+    }
+    return false;
+}
+
+struct NetStats {
+    long long     rttSum = 0, rttMax = 0;
+    int           rttCount = 0;
+    long long     stallUs = 0, stallMax = 0;
+    long long     intervalSum = 0;
+    unsigned long ticks = 0;
+    bool          desync = false;
+    uint32_t      desyncTick = 0;
+};
+
+static void printNetReport(const char* mode, const NetStats &st, int inputDelay) {
+    double avgIv   = st.ticks ? (double)st.intervalSum / st.ticks : 0;
+    double avgRtt  = st.rttCount ? (double)st.rttSum / st.rttCount : 0;
+    double avgStall = st.ticks ? (double)st.stallUs / st.ticks : 0;
+    printf("%s: %lu ticks, input delay %d ticks\n", mode, st.ticks, inputDelay);
+    printf("  rtt            avg %7.2f ms   max %7.2f ms\n", avgRtt / 1000, st.rttMax / 1000.0);
+    printf("  stall/tick     avg %7.2f ms   max %7.2f ms\n", avgStall / 1000, st.stallMax / 1000.0);
+    printf("  added latency  %7.2f ms  (delay %.2f + avg stall %.2f)\n",
+           (inputDelay * avgIv + avgStall) / 1000, inputDelay * avgIv / 1000, avgStall / 1000);
+    if (st.desync) printf("  DESYNC detected at tick %u\n", st.desyncTick);
+}
+
+// Connects and handshakes into `c` (which keeps any bytes that
+// arrived behind the HELLO); the host also chooses the seed, input
+// delay and lockstep/rollback for both.
+static const uint8_t NET_HELLO_ROLLBACK = 0x80;
+
+static bool netHandshake(const std::string &spec, bool host, uint64_t &seed,
+                         int &delay, bool &rollback, NetConn &c) {
+    int fd;
+    if (host) {
+        int lfd = netListen(spec);
+        if (lfd < 0) { perror("vsnake: listen"); return false; }
+        printf("waiting for opponent on %s ...\n", spec.c_str());
+        fflush(stdout);
+        fd = accept4(lfd, nullptr, nullptr, SOCK_CLOEXEC);
+        close(lfd);
+        if (isUnixSpec(spec)) unlink(unixPath(spec).c_str());
+        if (fd < 0) { perror("vsnake: accept"); return false; }
+        tuneSocket(fd);
+    } else {
+        fd = netConnect(spec);
+        if (fd < 0) { fprintf(stderr, "vsnake: cannot connect to %s\n", spec.c_str()); return false; }
+    }
+    setNonBlocking(fd);
+
+    c.fd = fd;
+    NetMsg m;
+    if (host) {
+        c.send(NET_HELLO, (uint8_t)(delay | (rollback ? NET_HELLO_ROLLBACK : 0)),
+               NET_PROTOCOL, seed);
+        if (!c.waitFor(m, NET_CONNECT_MS) || m.type != NET_HELLO || m.value != seed) {
+            fprintf(stderr, "vsnake: handshake failed\n"); close(fd); return false;
+        }
+    } else {
+        if (!c.waitFor(m, NET_CONNECT_MS) || m.type != NET_HELLO || m.tick != NET_PROTOCOL) {
+            fprintf(stderr, "vsnake: handshake failed\n"); close(fd); return false;
+        }
+        seed = m.value;
+        delay = m.arg & ~NET_HELLO_ROLLBACK;
+        rollback = (m.arg & NET_HELLO_ROLLBACK) != 0;
+        c.send(NET_HELLO, m.arg, NET_PROTOCOL, seed);
+    }
+    return true;
+}
+
+int runLockstepGame(NetConn &conn, bool host, uint64_t seed, int delay) {
+    int fd = conn.fd;
+    NetStats st;
+
+    MultiGame m;
+    initMultiGame(m, { 2, 2 }, seed);
+    if (m.termTooSmall) {
+        conn.send(NET_BYE, 0, 0, 0);
+        fprintf(stderr, "vsnake: terminal too small (need %d x %d)\n", MIN_TERM_W, MIN_TERM_H);
+        close(fd); return 1;
+    }
+    int me = host ? 0 : 1, peer = 1 - me;
+    m.localPlayer = me;
+    m.snakes[peer].remote = true;
+
+    // Input rings, tagged with the tick they belong to
+    uint8_t  inputs[2][NET_HISTORY];
+    uint32_t inputTick[2][NET_HISTORY];
+    uint64_t hashes[2][NET_HISTORY];
+    uint32_t hashTick[2][NET_HISTORY];
+    memset(inputTick, 0xFF, sizeof(inputTick));
+    memset(hashTick, 0xFF, sizeof(hashTick));
+
+    std::deque<Direction> pending;
+    enableRawMode();
+    hideCursor();
+    write(STDOUT_FILENO, "\033[?1049h", 8);
+    clearScreen();
+
+    uint32_t tick = 0;
+    long long now = nowMicros();
+    long long nextTick = now, nextRender = now, nextPing = now;
+    long long stallStart = 0;
+    bool quit = false, peerLeft = false;
+    std::vector<NetMsg> msgs;
+
+    auto checkHash = [&](uint32_t t) {
+        int k = t % NET_HISTORY;
+        if (hashTick[0][k] == t && hashTick[1][k] == t && hashes[0][k] != hashes[1][k]) {
+            st.desync = true; st.desyncTick = t;
+        }
+    };
+
+    while (!g_interrupted && !quit && !peerLeft && !st.desync && !m.over) {
+        msgs.clear();
+        conn.poll(msgs);
+        for (const NetMsg &msg : msgs) {
+            int k = msg.tick % NET_HISTORY;
+            switch (msg.type) {
+                case NET_INPUT: inputs[1][k] = msg.arg; inputTick[1][k] = msg.tick; break;
+                case NET_HASH:  hashes[1][k] = msg.value; hashTick[1][k] = msg.tick; checkHash(msg.tick); break;
+                case NET_PING:  conn.send(NET_PONG, 0, msg.tick, msg.value); break;
+                case NET_PONG: {
+                    long long rtt = nowMicros() - (long long)msg.value;
+                    st.rttSum += rtt; st.rttCount++; st.rttMax = std::max(st.rttMax, rtt);
+                    break;
+                }
+                case NET_BYE: peerLeft = true; break;
+            }
+        }
+        if (conn.closed) peerLeft = true;
+        if (readNetKeys(pending)) quit = true;
+
+        now = nowMicros();
+        if (now >= nextPing) { conn.send(NET_PING, 0, tick, (uint64_t)now); nextPing = now + NET_PING_US; }
+
+        // Advance as many ticks as are due and have both inputs
+        while (now >= nextTick && !m.over) {
+            int k = tick % NET_HISTORY;
+            bool haveRemote = tick < (uint32_t)delay || inputTick[1][k] == tick;
+            if (!haveRemote) {
+                if (!stallStart) stallStart = now;
+                break;
+            }
+            if (stallStart) {
+                long long s = now - stallStart;
+                st.stallUs += s; st.stallMax = std::max(st.stallMax, s);
+                stallStart = 0;
+            }
+
+            // our input for tick + delay goes out now
+            uint32_t future = tick + delay;
+            uint8_t mine = NET_NO_INPUT;
+            if (!pending.empty()) { mine = (uint8_t)pending.front(); pending.pop_front(); }
+            inputs[0][future % NET_HISTORY] = mine; inputTick[0][future % NET_HISTORY] = future;
+            conn.send(NET_INPUT, mine, future, 0);
+
+            uint8_t in[2] = { NET_NO_INPUT, NET_NO_INPUT };
+            if (tick >= (uint32_t)delay) { in[0] = inputs[0][k]; in[1] = inputs[1][k]; }
+            applyNetInput(m.snakes[me], in[0]);
+            applyNetInput(m.snakes[peer], in[1]);
+            updateMulti(m);
+            tick++;
+            st.ticks++;
+
+            if (tick % NET_HASH_EVERY == 0) {
+                int hk = tick % NET_HISTORY;
+                hashes[0][hk] = multiStateHash(m); hashTick[0][hk] = tick;
+                conn.send(NET_HASH, 0, tick, hashes[0][hk]);
+                checkHash(tick);
+            }
+
+            long long iv = calcBaseInterval(leaderScore(m));
+            st.intervalSum += iv;
+            nextTick += iv;
+            if (now - nextTick > iv * 3) nextTick = now;   // don't sprint after a stall
+        }
+
+        if (now >= nextRender) {
+            renderMulti(m);
+            nextRender += RENDER_TICK_US;
+            if (nextRender < now) nextRender = now + RENDER_TICK_US;
+        }
+
+        long long wake = std::min(nextRender, std::max(nextTick, now + 1000));
+        int timeoutMs = (int)std::max(0LL, (wake - nowMicros()) / 1000);
+        struct pollfd pfds[2] = { { fd, POLLIN, 0 }, { STDIN_FILENO, POLLIN, 0 } };
+        if (!conn.tx.empty()) pfds[0].events |= POLLOUT;
+        ::poll(pfds, 2, timeoutMs);
+        conn.flush();
+    }
+
+    if (quit) conn.send(NET_BYE, 0, tick, 0);
+    close(fd);
+
+    if (m.over) {
+        showMultiEndScreen(collectMultiResult(m));
+        waitForMenuOrExit();
+    }
+    performCleanup();
+    if (peerLeft && !m.over) printf("opponent left the game\n");
+    printNetReport("lockstep", st, delay);
+    return st.desync ? 2 : 0;
+}
+
+// ─── Rollback ───────────────────────────────────────────────
+//
+// vsnake --host ADDR --rollback: no input delay.  The remote snake is
+// predicted to keep its heading (no turn), the game runs ahead,
+// and when a real remote input contradicts the prediction the
+// state is restored from that tick's snapshot and re-simulated up
+// to the present.  Snapshots hold only simulation state in
+// preallocated buffers, so save/restore is a few memcpys.  At most
+// NET_MAX_ROLLBACK unconfirmed ticks are simulated before stalling.
+//
+
+static const int NET_MAX_ROLLBACK = 32;
+
+struct MultiSnapshot {
+    std::vector<Point>   body[MAX_SNAKES];
+    Direction            dir[MAX_SNAKES], nextDir[MAX_SNAKES];
+    int                  score[MAX_SNAKES];
+    bool                 alive[MAX_SNAKES];
+    Point                apple;
+    bool                 over, boardFull;
+    uint64_t             zobrist;
+    Rng                  rng;
+    std::vector<uint8_t> owner;
+};
+
+void saveMultiSnapshot(const MultiGame &m, MultiSnapshot &s) {
+    for (int i = 0; i < m.numSnakes; i++) {
+        const Snake &k = m.snakes[i];
+        s.body[i].assign(k.body.begin(), k.body.end());
+        s.dir[i] = k.dir; s.nextDir[i] = k.nextDir;
+        s.score[i] = k.score; s.alive[i] = k.alive;
+    }
+    s.apple = m.apple; s.over = m.over; s.boardFull = m.boardFull;
+    s.zobrist = m.zobrist; s.rng = m.rng;
+    s.owner.resize(m.owner.size());
+    memcpy(s.owner.data(), m.owner.data(), m.owner.size());
+}
+
+void restoreMultiSnapshot(MultiGame &m, const MultiSnapshot &s) {
+    for (int i = 0; i < m.numSnakes; i++) {
+        Snake &k = m.snakes[i];
+        k.body.assign(s.body[i].begin(), s.body[i].end());
+        k.dir = s.dir[i]; k.nextDir = s.nextDir[i];
+        k.score = s.score[i]; k.alive = s.alive[i];
+    }
+    m.apple = s.apple; m.over = s.over; m.boardFull = s.boardFull;
+    m.running = !s.over;
+    m.zobrist = s.zobrist; m.rng = s.rng;
+    memcpy(m.owner.data(), s.owner.data(), m.owner.size());
+}
+
+// multiStateHash of the state a snapshot holds, without rebuilding a
+// MultiGame; both must mix the same fields in the same order
+static uint64_t snapshotStateHash(const MultiSnapshot &s, int numSnakes) {
+    uint64_t h = s.zobrist;
+    auto mix = [&](uint64_t v) { h ^= v + 0x9E3779B97F4A7C15ULL + (h << 6) + (h >> 2); };
+    for (int i = 0; i < numSnakes; i++) {
+        mix((uint64_t)s.score[i]); mix(s.alive[i]); mix((uint64_t)s.dir[i]); mix(s.body[i].size());
+    }
+    mix(((uint64_t)s.apple.x << 32) | (uint32_t)s.apple.y);
+    mix(s.rng.s);
+    return h;
+}
+
+struct RollbackStats {
+    unsigned long rollbacks = 0, resimTicks = 0;
+    int           maxDepth = 0;
+    long long     saveNs = 0, restoreNs = 0, stepNs = 0;
+    unsigned long saves = 0, restores = 0, steps = 0;
+};
+
+static long long nowNanos() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static double cpuSeconds() {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec
+         + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+}
+
+int runRollbackGame(NetConn &conn, bool host, uint64_t seed, int delay) {
+    int fd = conn.fd;
+    NetStats st;
+    RollbackStats rb;
+
+    MultiGame m;
+    initMultiGame(m, { 2, 2 }, seed);
+    if (m.termTooSmall) {
+        conn.send(NET_BYE, 0, 0, 0);
+        fprintf(stderr, "vsnake: terminal too small (need %d x %d)\n", MIN_TERM_W, MIN_TERM_H);
+        close(fd); return 1;
+    }
+    int me = host ? 0 : 1, peer = 1 - me;
+    m.localPlayer = me;
+    m.snakes[peer].remote = true;
+
+    // snap[t % N] is the state at the start of tick t, with the
+    // remote input that tick was simulated with
+    const int N = NET_MAX_ROLLBACK + 1;
+    std::vector<MultiSnapshot> snap(N);
+    for (auto &s : snap) {
+        s.owner.reserve(m.owner.size());
+        for (auto &b : s.body) b.reserve(m.owner.size());
+    }
+    uint8_t  usedRemote[NET_HISTORY];
+    uint8_t  inputs[2][NET_HISTORY];
+    uint32_t inputTick[2][NET_HISTORY];
+    uint64_t hashes[2][NET_HISTORY];
+    uint32_t hashTick[2][NET_HISTORY];
+    memset(inputTick, 0xFF, sizeof(inputTick));
+    memset(hashTick, 0xFF, sizeof(hashTick));
+
+    std::deque<Direction> pending;
+    enableRawMode();
+    hideCursor();
+    write(STDOUT_FILENO, "\033[?1049h", 8);
+    clearScreen();
+
+    uint32_t tick = 0;          // next tick to simulate
+    uint32_t confirmed = 0;     // remote inputs known for every tick < confirmed
+    uint32_t hashedUpTo = 0;
+    long long rollbackFrom = -1, latestRemote = -1;
+    long long now = nowMicros();
+    long long nextTick = now, nextRender = now, nextPing = now, stallStart = 0;
+    long long wallStart = now;
+    double cpuStart = cpuSeconds();
+    bool quit = false, peerLeft = false;
+    std::vector<NetMsg> msgs;
+
+    auto remoteFor = [&](uint32_t t) -> uint8_t {
+        if (t < (uint32_t)delay) return NET_NO_INPUT;
+        int k = t % NET_HISTORY;
+        return inputTick[1][k] == t ? inputs[1][k] : NET_NO_INPUT;   // predict: keep heading
+    };
+    auto localFor = [&](uint32_t t) -> uint8_t {
+        int k = t % NET_HISTORY;
+        return (t >= (uint32_t)delay && inputTick[0][k] == t) ? inputs[0][k] : NET_NO_INPUT;
+    };
+    auto simulate = [&](uint32_t t) {
+        MultiSnapshot &s = snap[t % N];
+        long long t0 = nowNanos();
+        saveMultiSnapshot(m, s);
+        rb.saveNs += nowNanos() - t0; rb.saves++;
+        uint8_t r = remoteFor(t);
+        usedRemote[t % NET_HISTORY] = r;
+        t0 = nowNanos();
+        applyNetInput(m.snakes[me], localFor(t));
+        applyNetInput(m.snakes[peer], r);
+        updateMulti(m);
+        rb.stepNs += nowNanos() - t0; rb.steps++;
+    };
+    // The heading remote input `in` leaves the peer with at tick t (as
+    // applyNetInput would); only a different heading needs a rollback
+    auto remoteHeading = [&](uint32_t t, uint8_t in) {
+        const MultiSnapshot &s = snap[t % N];
+        if (in == NET_NO_INPUT || !s.alive[peer] || isOpposite((Direction)in, s.dir[peer])) return s.nextDir[peer];
+        return (Direction)in;
+    };
+    auto checkHash = [&](uint32_t t) {
+        int k = t % NET_HISTORY;
+        if (hashTick[0][k] == t && hashTick[1][k] == t && hashes[0][k] != hashes[1][k]) {
+            st.desync = true; st.desyncTick = t;
+        }
+    };
+
+    while (!g_interrupted && !quit && !peerLeft && !st.desync) {
+        msgs.clear();
+        conn.poll(msgs);
+        for (const NetMsg &msg : msgs) {
+            int k = msg.tick % NET_HISTORY;
+            switch (msg.type) {
+                case NET_INPUT:
+                    inputs[1][k] = msg.arg; inputTick[1][k] = msg.tick;
+                    latestRemote = std::max(latestRemote, (long long)msg.tick);
+                    if (msg.tick < tick && (rollbackFrom < 0 || msg.tick < rollbackFrom) &&
+                        remoteHeading(msg.tick, msg.arg) != remoteHeading(msg.tick, usedRemote[k]))
+                        rollbackFrom = msg.tick;
+                    break;
+                case NET_HASH:  hashes[1][k] = msg.value; hashTick[1][k] = msg.tick; checkHash(msg.tick); break;
+                case NET_PING:  conn.send(NET_PONG, 0, msg.tick, msg.value); break;
+                case NET_PONG: {
+                    long long rtt = nowMicros() - (long long)msg.value;
+                    st.rttSum += rtt; st.rttCount++; st.rttMax = std::max(st.rttMax, rtt);
+                    break;
+                }
+                case NET_BYE: peerLeft = true; break;
+            }
+        }
+        if (conn.closed) peerLeft = true;
+        if (readNetKeys(pending)) quit = true;
+        while (confirmed < (uint32_t)delay ||
+               inputTick[1][confirmed % NET_HISTORY] == confirmed) confirmed++;
+
+        // Correct a misprediction: back to the first wrong tick, replay
+        if (rollbackFrom >= 0) {
+            uint32_t from = (uint32_t)rollbackFrom;
+            int depth = (int)(tick - from);
+            long long t0 = nowNanos();
+            restoreMultiSnapshot(m, snap[from % N]);
+            rb.restoreNs += nowNanos() - t0; rb.restores++;
+            m.silent = true;
+            for (uint32_t t = from; t < tick; t++) simulate(t);
+            m.silent = false;
+            rb.rollbacks++; rb.resimTicks += depth;
+            rb.maxDepth = std::max(rb.maxDepth, depth);
+            rollbackFrom = -1;
+        }
+
+        now = nowMicros();
+        if (now >= nextPing) { conn.send(NET_PING, 0, tick, (uint64_t)now); nextPing = now + NET_PING_US; }
+
+        while (now >= nextTick && !m.over) {
+            if (tick >= confirmed + NET_MAX_ROLLBACK) {
+                if (!stallStart) stallStart = now;
+                break;
+            }
+            if (stallStart) {
+                long long s = now - stallStart;
+                st.stallUs += s; st.stallMax = std::max(st.stallMax, s);
+                stallStart = 0;
+            }
+            uint32_t future = tick + delay;
+            uint8_t mine = NET_NO_INPUT;
+            if (!pending.empty()) { mine = (uint8_t)pending.front(); pending.pop_front(); }
+            inputs[0][future % NET_HISTORY] = mine; inputTick[0][future % NET_HISTORY] = future;
+            conn.send(NET_INPUT, mine, future, 0);
+
+            simulate(tick);
+            tick++;
+            st.ticks++;
+
+            long long iv = calcBaseInterval(leaderScore(m));
+            st.intervalSum += iv;
+            nextTick += iv;
+
+            // Time sync: the side that runs ahead of the peer (beyond
+            // half an RTT) eases off so rollbacks split evenly
+            long long rtt = st.rttCount ? st.rttSum / st.rttCount : 0;
+            long long peerTick = latestRemote + 1 - delay + rtt / 2 / iv;
+            if ((long long)tick - peerTick > 1) nextTick += iv / 8;
+            if (now - nextTick > iv * 3) nextTick = now;
+        }
+
+        // Hash only confirmed history: state at the start of tick t
+        while (hashedUpTo + NET_HASH_EVERY <= std::min(confirmed, tick)) {
+            uint32_t t = hashedUpTo + NET_HASH_EVERY;
+            int hk = t % NET_HISTORY;
+            hashes[0][hk] = t < tick ? snapshotStateHash(snap[t % N], m.numSnakes) : multiStateHash(m);
+            hashTick[0][hk] = t;
+            conn.send(NET_HASH, 0, t, hashes[0][hk]);
+            checkHash(t);
+            hashedUpTo = t;
+        }
+
+        // Game over counts once every input up to it is confirmed
+        if (m.over && confirmed >= tick) break;
+
+        if (now >= nextRender) {
+            renderMulti(m);
+            nextRender += RENDER_TICK_US;
+            if (nextRender < now) nextRender = now + RENDER_TICK_US;
+        }
+
+        long long wake = std::min(nextRender, std::max(nextTick, now + 1000));
+        int timeoutMs = (int)std::max(0LL, (wake - nowMicros()) / 1000);
+        struct pollfd pfds[2] = { { fd, POLLIN, 0 }, { STDIN_FILENO, POLLIN, 0 } };
+        if (!conn.tx.empty()) pfds[0].events |= POLLOUT;
+        ::poll(pfds, 2, timeoutMs);
+        conn.flush();
+    }
+
+    double wall = (nowMicros() - wallStart) / 1e6;
+    double cpu = cpuSeconds() - cpuStart;
+    if (quit) conn.send(NET_BYE, 0, tick, 0);
+    close(fd);
+
+    if (m.over) {
+        showMultiEndScreen(collectMultiResult(m));
+        waitForMenuOrExit();
+    }
+    performCleanup();
+    if (peerLeft && !m.over) printf("opponent left the game\n");
+    printNetReport("rollback", st, delay);
+    printf("rollback: %lu rollbacks, %lu re-simulated ticks, avg depth %.2f, max %d\n",
+           rb.rollbacks, rb.resimTicks,
+           rb.rollbacks ? (double)rb.resimTicks / rb.rollbacks : 0.0, rb.maxDepth);
+    printf("  snapshot %.2f us   restore %.2f us   step %.2f us\n",
+           rb.saves ? rb.saveNs / 1000.0 / rb.saves : 0.0,
+           rb.restores ? rb.restoreNs / 1000.0 / rb.restores : 0.0,
+           rb.steps ? rb.stepNs / 1000.0 / rb.steps : 0.0);
+    printf("  cpu %.2f ms per second of play\n", wall > 0 ? cpu * 1000 / wall : 0.0);
+    return st.desync ? 2 : 0;
+}
+
+int runNetGame(const std::string &spec, bool host, bool rollback, int delay) {
+    uint64_t seed = freshSeed();
+    NetConn conn;
+    if (!netHandshake(spec, host, seed, delay, rollback, conn)) return 1;
+    return rollback ? runRollbackGame(conn, host, seed, delay)
+                    : runLockstepGame(conn, host, seed, delay);
+}
+
+// ─── Latency Proxy ──────────────────────────────────────────
+//
+// vsnake --lag-proxy LISTEN TARGET --lag MS --jitter MS
+// Relays one connection each way, holding every chunk for lag +
+// uniform(0, jitter) ms.  Release times never go backwards, so the
+// byte stream keeps its order (TCP-like head-of-line blocking).
+//
+
+struct DelayedChunk {
+    long long   due;
+    std::string data;
+};
+
+int runLagProxy(const std::string &listenSpec, const std::string &target,
+                int lagMs, int jitterMs) {
+    int lfd = netListen(listenSpec);
+    if (lfd < 0) { perror("vsnake: proxy listen"); return 1; }
+    printf("lag proxy %s -> %s  (%d ms + 0..%d ms jitter)\n",
+           listenSpec.c_str(), target.c_str(), lagMs, jitterMs);
+    fflush(stdout);
+    int a = accept4(lfd, nullptr, nullptr, SOCK_CLOEXEC);
+    close(lfd);
+    if (a < 0) { perror("vsnake: proxy accept"); return 1; }
+    int b = netConnect(target);
+    if (b < 0) { fprintf(stderr, "vsnake: proxy cannot reach %s\n", target.c_str()); close(a); return 1; }
+    tuneSocket(a);
+    setNonBlocking(a); setNonBlocking(b);
+
+    Rng rng; rng.seed(freshSeed());
+    int fds[2] = { a, b };
+    std::deque<DelayedChunk> q[2];      // q[i]: read from fds[i], goes to fds[1 - i]
+    long long lastDue[2] = { 0, 0 };
+    bool open = true;
+    char buf[4096];
+
+    while (open && !g_interrupted) {
+        long long now = nowMicros(), wake = now + 100000;
+        bool full[2] = { false, false };    // a due chunk is waiting for fds[1 - i] to drain
+        for (int i = 0; i < 2; i++) {
+            while (!q[i].empty() && q[i].front().due <= now) {
+                std::string &d = q[i].front().data;
+                ssize_t n = write(fds[1 - i], d.data(), d.size());
+                if (n < 0 && errno == EAGAIN) { full[i] = true; break; }
+                if (n <= 0) { open = false; break; }
+                d.erase(0, (size_t)n);
+                if (d.empty()) q[i].pop_front();
+            }
+            if (!q[i].empty() && !full[i]) wake = std::min(wake, q[i].front().due);
+        }
+        struct pollfd p[2] = { { a, POLLIN, 0 }, { b, POLLIN, 0 } };
+        for (int i = 0; i < 2; i++) if (full[i]) p[1 - i].events |= POLLOUT;
+        ::poll(p, 2, (int)std::max(0LL, (wake - now) / 1000));
+        now = nowMicros();
+        for (int i = 0; i < 2; i++) {
+            if (!(p[i].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+            ssize_t n = read(fds[i], buf, sizeof(buf));
+            if (n <= 0) { if (n == 0 || errno != EAGAIN) open = false; continue; }
+            long long due = now + (lagMs + (jitterMs > 0 ? rng.below(jitterMs + 1) : 0)) * 1000LL;
+            due = std::max(due, lastDue[i]);
+            lastDue[i] = due;
+            q[i].push_back({ due, std::string(buf, (size_t)n) });
+        }
+    }
+    close(a); close(b);
+    return 0;
+}
+
+// ===== SPECTATOR BROADCAST =================================
+//
+// vsnake --broadcast PATH   play, serving the game on a UNIX socket
+// vsnake --watch PATH       watch it from another terminal
+//
+// The game thread only copies the glyph grid into a mailbox
+// (publishFrame).  A broadcaster thread diffs it against the last
+// frame it encoded -- once per frame, whatever the viewer count --
+// and appends the same bytes to every viewer's queue with
+// non-blocking writes.  A viewer whose backlog passes
+// VIEWER_BACKLOG stops receiving diffs; once its queue drains it
+// gets a fresh keyframe.  New viewers start with a keyframe too.
+//
+// Viewer layout (1-based rows): 1 status, 2 border, 3.. board.
+//
+
+static const size_t VIEWER_BACKLOG = 64 * 1024;
+
+struct Viewer {
+    int         fd;
+    std::string out;
+    bool        needsKey;
+};
+
+struct Broadcaster {
+    int                     listenFd = -1;
+    std::string             path;
+    std::thread             worker;
+    std::mutex              mu;
+    std::condition_variable cv;
+    bool                    stopping = false;
+
+    // mailbox, guarded by mu
+    std::vector<uint8_t>    mailCells;
+    int                     mailScore = 0, mailW = 0, mailH = 0;
+    std::string             mailStatus;
+    bool                    mailFull = false;
+
+    // broadcaster thread only
+    std::vector<uint8_t>    cells, prevCells;
+    int                     score = -1, prevScore = -1, w = 0, h = 0;
+    std::string             status, prevStatus;
+    std::vector<Viewer>     viewers;
+    std::string             diff, key;
+
+    // written by the broadcaster, read live by the benchmark
+    std::atomic<unsigned long> frames{0};
+    std::atomic<long long>     encodeNs{0};
+};
+
+static void appendStatusLine(std::string &buf, int score, const std::string &status) {
+    char t[96];
+    snprintf(t, sizeof(t), "\033[1;1H" BOLD BRIGHT_GREEN "vsnake" RESET " live   "
+             BOLD YELLOW "Score: %d" RESET "   %s" ERASE_LINE, score, status.c_str());
+    buf += t;
+}
+
+static void encodeKeyframe(Broadcaster &b, std::string &buf) {
+    buf.clear();
+    buf += RESET "\033[2J";
+    appendStatusLine(buf, b.score, b.status);
+    buf += "\033[2;1H" CYAN;
+    for (int i = 0; i < b.w * 2 + 4; i++) buf += '#';
+    buf += RESET;
+    for (int y = 0; y < b.h; y++) {
+        char pos[32];
+        snprintf(pos, sizeof(pos), "\033[%d;1H", y + 3);
+        buf += pos;
+        buf += CYAN "##" RESET;
+        for (int x = 0; x < b.w; x++) buf += CELL_GLYPH[b.cells[y * b.w + x]];
+        buf += CYAN "##" RESET;
+    }
+    char pos[32];
+    snprintf(pos, sizeof(pos), "\033[%d;1H" CYAN, b.h + 3);
+    buf += pos;
+    for (int i = 0; i < b.w * 2 + 4; i++) buf += '#';
+    buf += RESET "\n";
+}
+
+// Cursor moves are skipped for runs of neighbouring changed cells
+static void encodeDiff(Broadcaster &b, std::string &buf) {
+    buf.clear();
+    if (b.score != b.prevScore || b.status != b.prevStatus)
+        appendStatusLine(buf, b.score, b.status);
+    int cursorCell = -1;
+    for (int i = 0; i < b.w * b.h; i++) {
+        if (b.cells[i] == b.prevCells[i]) continue;
+        if (i != cursorCell) {
+            char pos[32];
+            snprintf(pos, sizeof(pos), "\033[%d;%dH", i / b.w + 3, (i % b.w) * 2 + 3);
+            buf += pos;
+        }
+        buf += CELL_GLYPH[b.cells[i]];
+        cursorCell = (i % b.w == b.w - 1) ? -1 : i + 1;
+    }
+}
+
+static void flushViewer(Viewer &v) {
+    while (!v.out.empty()) {
+        ssize_t n = send(v.fd, v.out.data(), v.out.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n > 0) { v.out.erase(0, (size_t)n); continue; }
+        if (n < 0 && (errno == EAGAIN || errno == EINTR)) return;
+        close(v.fd); v.fd = -1; return;
+    }
+}
+
+static void broadcastLoop(Broadcaster &b) {
+    bool haveFrame = false;
+    while (true) {
+        bool fresh = false;
+        {
+            std::unique_lock<std::mutex> lk(b.mu);
+            b.cv.wait_for(lk, std::chrono::milliseconds(10),
+                          [&] { return b.stopping || b.mailFull; });
+            if (b.stopping) break;
+            if (b.mailFull) {
+                b.cells.swap(b.mailCells);
+                b.score = b.mailScore; b.w = b.mailW; b.h = b.mailH;
+                b.status = b.mailStatus;
+                b.mailFull = false;
+                fresh = true;
+            }
+        }
+
+        int fd;
+        while ((fd = accept4(b.listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+            b.viewers.push_back({ fd, std::string(), true });
+
+        if (fresh) {
+            long long t0 = nowNanos();
+            bool sized = haveFrame && b.prevCells.size() == b.cells.size();
+            if (sized) encodeDiff(b, b.diff);
+            b.key.clear();
+            b.prevCells = b.cells; b.prevScore = b.score; b.prevStatus = b.status;
+            haveFrame = true;
+            for (auto &v : b.viewers) {
+                if (!sized) v.needsKey = true;
+                if (!v.needsKey && v.out.size() > VIEWER_BACKLOG) v.needsKey = true;
+                if (!v.needsKey) v.out += b.diff;
+            }
+            b.frames.fetch_add(1, std::memory_order_relaxed);
+            b.encodeNs.fetch_add(nowNanos() - t0, std::memory_order_relaxed);
+        }
+
+        for (auto &v : b.viewers) {
+            if (haveFrame && v.needsKey && v.out.empty()) {
+                if (b.key.empty()) encodeKeyframe(b, b.key);
+                v.out = b.key;
+                v.needsKey = false;
+            }
+            flushViewer(v);
+        }
+        b.viewers.erase(std::remove_if(b.viewers.begin(), b.viewers.end(),
+                                       [](const Viewer &v) { return v.fd < 0; }),
+                        b.viewers.end());
+    }
+    for (auto &v : b.viewers) close(v.fd);
+    b.viewers.clear();
+}
+
+static Broadcaster* g_broadcast = nullptr;
+
+Broadcaster* startBroadcast(const std::string &path) {
+    int fd = netListen(path.find('/') == std::string::npos ? "unix:" + path : path);
+    if (fd < 0) return nullptr;
+    setNonBlocking(fd);
+    Broadcaster* b = new Broadcaster();
+    b->listenFd = fd;
+    b->path = unixPath(path);
+    b->worker = std::thread([b] { broadcastLoop(*b); });
+    return b;
+}
+
+void stopBroadcast(Broadcaster* b) {
+    if (!b) return;
+    { std::lock_guard<std::mutex> lk(b->mu); b->stopping = true; }
+    b->cv.notify_one();
+    b->worker.join();
+    close(b->listenFd);
+    unlink(b->path.c_str());
+    delete b;
+}
+
+// Game thread: a copy into the mailbox, independent of viewer count
+void publishFrame(Broadcaster* b, const GameState &g, const char* status) {
+    if (!b) return;
+    {
+        std::lock_guard<std::mutex> lk(b->mu);
+        b->mailCells.assign(g.grid.begin(), g.grid.end());
+        b->mailScore = g.score;
+        b->mailW = g.boardWidth; b->mailH = g.boardHeight;
+        b->mailStatus = status;
+        b->mailFull = true;
+    }
+    b->cv.notify_one();
+}
+
+// ─── Watch Client ───────────────────────────────────────────
+int runWatch(const std::string &path) {
+    std::string spec = path.find('/') == std::string::npos ? "unix:" + path : path;
+    int fd = netConnect(spec);
+    if (fd < 0) { fprintf(stderr, "vsnake: nothing to watch at %s\n", path.c_str()); return 1; }
+
+    enableRawMode();
+    hideCursor();
+    write(STDOUT_FILENO, "\033[?1049h", 8);
+    clearScreen();
+
+    char buf[16384];
+    bool ended = false;
+    while (!g_interrupted && !ended) {
+        struct pollfd p[2] = { { fd, POLLIN, 0 }, { STDIN_FILENO, POLLIN, 0 } };
+        if (::poll(p, 2, 200) <= 0) continue;
+        if (p[1].revents & (POLLIN | POLLHUP | POLLERR)) {
+            char c;
+            if (readKeyByte(c) && (c == 'q' || c == 'Q')) break;
+        }
+        if (p[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+            ssize_t n = read(fd, buf, sizeof(buf));
+            if (n <= 0) { ended = true; break; }
+            write(STDOUT_FILENO, buf, (size_t)n);
+        }
+    }
+    close(fd);
+    performCleanup();
+    if (ended) printf("broadcast ended\n");
+    return 0;
+}
+
+// ─── Broadcast Benchmark ────────────────────────────────────
+static long long threadCpuNanos() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Publishes frames of a scripted game with N connected
+// viewers (half of them never read) and reports the game-thread
+// publish cost next to the broadcaster's per-frame encode cost.
+// Publish time is thread CPU time, so a broadcaster preempting the
+// game thread on a small machine is not billed to the game.
+void runBroadcastBenchmark(const std::vector<int> &viewerCounts, int frames) {
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+    printf("%8s %16s %16s %12s\n", "viewers", "publish us/frm", "encode us/frm", "connected");
+    for (int n : viewerCounts) {
+        std::string path = "/tmp/vsnake-bench-" + std::to_string(getpid()) + ".sock";
+        Broadcaster* b = startBroadcast(path);
+        if (!b) { perror("vsnake: broadcast"); return; }
+        std::vector<int> clients;
+        for (int i = 0; i < n; i++) {
+            int fd = netConnect(path);
+            if (fd >= 0) { setNonBlocking(fd); clients.push_back(fd); }
+        }
+
+        GameState g;
+        initGame(g, 7);
+        long long publishNs = 0;
+        char sink[65536];
+        for (int f = 0; f < frames; f++) {
+            if (f % 4 == 0) {
+                g.nextDir = (f / 40) % 2 ? DOWN : RIGHT;
+                updateGame(g);
+                if (!g.running) initGame(g, (uint64_t)f);
+            }
+            fillCellGrid(g, (f / HEAD_GLOW_PERIOD) % 3, (unsigned long)f, 0);
+            long long t0 = threadCpuNanos();
+            publishFrame(b, g, "");
+            publishNs += threadCpuNanos() - t0;
+            for (size_t i = 0; i < clients.size(); i += 2)
+                while (read(clients[i], sink, sizeof(sink)) > 0) {}
+            usleep(2000);
+        }
+        unsigned long encoded = b->frames.load(std::memory_order_relaxed);
+        long long encodeNs = b->encodeNs.load(std::memory_order_relaxed);
+        printf("%8d %16.2f %16.2f %12zu\n", n, publishNs / 1000.0 / frames,
+               encoded ? encodeNs / 1000.0 / encoded : 0.0, clients.size());
+        fflush(stdout);
+        for (int fd : clients) close(fd);
+        stopBroadcast(b);
+    }
+}
+
+// ===== ARCADE SERVER =======================================
+//
+// One process serving many players:
+//
+//   vsnake --serve /run/vsnake.sock [--threads N]
+//   vsnake --connect /run/vsnake.sock     (e.g. an sshd ForceCommand)
+//
+// --connect is a thin client: it forwards raw key bytes and reports
+// its window size in-band as the xterm "CSI 8;rows;cols t" sequence,
+// and copies whatever the server sends straight to the terminal.
+//
+// The server runs one epoll loop.  Between frames it only accepts
+// and reads sockets into each session's input bytes.  Every
+// SERVE_FRAME_US the sessions are split into SERVE_BATCH-sized work
+// items on the WorkerPool; a work item decodes input, advances the
+// game, renders a frame into the session's GameState.renderBuf and
+// writes it with a non-blocking send.  Frames are dirty-cell diffs
+// against the last frame rendered (see renderChangedCells), and a
+// session whose previous frame has not drained yet skips rendering
+// the new one.  A skipped frame is never encoded, so the diff base is
+// always a frame the client gets in full; a slow client just sees
+// fewer, larger diffs.  Frames with no changes are not sent at all.
+//
+// Idle sessions are kept small: the engine buffers and the shown grid
+// share one arena page, glyphs and levels are shared tables, and
+// output and input buffers are let go once they grow past what a diff
+// frame or a burst of keys needs.  The stats line reports the
+// per-session bytes (see Session Memory).
+//
+
+static const int  SERVE_FRAME_US   = 30000;     // 33 fps
+static const int  SERVE_BATCH      = 16;        // sessions per work item
+static const int  SERVE_MAX_INPUT  = 4096;      // unread input kept per session
+static const int  SERVE_STATS_SEC  = 5;
+static const int  SERVE_OUT_KEEP   = 512;       // frame buffer kept between frames
+static const int  SERVE_IN_KEEP    = 64;        // input buffer kept between frames
+static const int  KEY_TERM_SIZE    = 512;       // decoder result: size report
+
+// ─── Input Decoder ──────────────────────────────────────────
+// Byte-at-a-time: plain keys, CSI/SS3 arrows, CSI 8;h;w t size
+struct InputDecoder {
+    int  state = 0;             // 0 ground, 1 after ESC, 2 in CSI, 3 after SS3
+    char params[24];
+    int  plen = 0;
+};
+
+static int decodeInputByte(InputDecoder &d, unsigned char c, int &rows, int &cols) {
+    switch (d.state) {
+    case 1:
+        if (c == '[') { d.state = 2; d.plen = 0; return 0; }
+        if (c == 'O') { d.state = 3; return 0; }
+        d.state = 0;
+        break;              // lone ESC: treat c as a plain key
+    case 2:
+        if ((c >= '0' && c <= '9') || c == ';') {
+            if (d.plen < (int)sizeof(d.params) - 1) d.params[d.plen++] = (char)c;
+            return 0;
+        }
+        d.state = 0;
+        d.params[d.plen] = '\0';
+        if (c == 't') {
+            int op, r, w;
+            if (sscanf(d.params, "%d;%d;%d", &op, &r, &w) == 3 && op == 8 && r > 0 && w > 0) {
+                rows = r; cols = w; return KEY_TERM_SIZE;
+            }
+            return 0;
+        }
+        return arrowKey((char)c);
+    case 3:
+        d.state = 0;
+        return arrowKey((char)c);
+    }
+    if (c == '\033') { d.state = 1; return 0; }
+    return c;
+}
+
+// ─── Sessions ───────────────────────────────────────────────
+enum SessionPhase { SESSION_PLAYING, SESSION_OVER };
+
+struct Session {
+    int           fd;
+    BufferArena   arena;              // game's buffers, kept across restarts
+    GameState     game;
+    InputDecoder  dec;
+    SessionPhase  phase = SESSION_PLAYING;
+    std::string   in;                 // raw bytes, filled by the loop thread
+    int           termW = 80, termH = 24;
+    long long     lastFrame = 0;
+    bool          closing = false;
+    int           scoreToSave = -1;   // picked up by the loop thread
+
+    // Pending output is prefix + game.renderBuf, outSent bytes in.
+    // Neither is touched while a send is pending or in flight.
+    std::string   prefix;
+    size_t        outLen = 0, outSent = 0;
+    bool          needClear = false;  // clear the screen before the next frame
+    bool          inFlight = false;   // io_uring send submitted, not reaped
+    struct iovec  iov[2];
+    struct msghdr msg;
+};
+
+static bool outputPending(const Session &s) { return s.outSent < s.outLen; }
+
+// Unsent part of the pending frame as at most two iovecs
+static int sessionIov(Session &s) {
+    int n = 0;
+    size_t skip = s.outSent, pre = s.prefix.size();
+    if (skip < pre) {
+        s.iov[n].iov_base = (void*)(s.prefix.data() + skip);
+        s.iov[n++].iov_len = pre - skip;
+        skip = 0;
+    } else {
+        skip -= pre;
+    }
+    if (skip < s.game.renderBuf.size()) {
+        s.iov[n].iov_base = (void*)(s.game.renderBuf.data() + skip);
+        s.iov[n++].iov_len = s.game.renderBuf.size() - skip;
+    }
+    return n;
+}
+
+// Account for res bytes written (or an error) on the pending frame
+static void sessionSent(Session &s, ssize_t res) {
+    if (res > 0) { s.outSent += (size_t)res; metricAdd(MC_BYTES_OUT, (uint64_t)res); return; }
+    if (res == -EAGAIN || res == -EINTR) return;
+    s.closing = true;
+}
+
+// ─── Session Memory ─────────────────────────────────────────
+// What one session holds, by owner.  Heap figures are what the
+// containers asked for (allocator overhead not included); the arena
+// counts its whole mapping, faulted in on first use.  The deque is
+// estimated from libstdc++'s 512-byte nodes and 8-slot minimum map.
+struct SessionMemory {
+    size_t object = 0;          // the Session itself
+    size_t arena = 0;           // engine buffers and shown grid
+    size_t snake = 0;
+    size_t output = 0;          // frame, prefix, shown score line
+    size_t input = 0;
+    size_t total() const { return object + arena + snake + output + input; }
+};
+
+static size_t stringHeap(const std::string &s) {
+    return s.capacity() > 15 ? s.capacity() + 1 : 0;     // beyond the inline buffer
+}
+
+static SessionMemory sessionMemory(const Session &s) {
+    SessionMemory m;
+    const GameState &g = s.game;
+    m.object = sizeof(Session);
+    m.arena  = s.arena.base ? s.arena.size
+                            : g.grid.capacity() + g.shownGrid.capacity() + g.food.capacity() * sizeof(uint32_t) +
+                              (g.occ.capacity() + g.foodMap.capacity() + g.goldMap.capacity()) * sizeof(uint64_t);
+    size_t nodes = g.snake.size() / (512 / sizeof(Point)) + 1;
+    m.snake  = nodes * 512 + std::max(nodes + 2, (size_t)8) * sizeof(void*);
+    m.output = stringHeap(g.renderBuf) + stringHeap(s.prefix) + stringHeap(g.shownScore);
+    m.input  = stringHeap(s.in);
+    return m;
+}
+
+// ===== BATCHED OUTPUT ======================================
+//
+// How the server gets frames onto the sockets:
+//
+//   OUT_WRITE   each work item writes its own sessions (one send
+//               per session per frame, spread over the pool)
+//   OUT_WRITEV  after the frame, the loop thread writes every
+//               pending session with writev (prefix + frame)
+//   OUT_URING   after the frame, one SENDMSG per pending session
+//               goes into an io_uring submission queue and the
+//               whole batch is submitted with a single
+//               io_uring_enter.  Completions are reaped without
+//               waiting at the start of the next frame; sockets stay
+//               blocking so the kernel parks a full one on its own
+//               poll instead of failing with EAGAIN.
+//
+// The ring is driven through the raw syscalls (no liburing).  When
+// the kernel or the headers lack io_uring, OUT_URING falls back to
+// OUT_WRITEV.
+//
+
+enum OutputMode { OUT_WRITE, OUT_WRITEV, OUT_URING };
+static const char* const OUTPUT_MODE_NAME[] = { "write", "writev", "io_uring" };
+
+static const unsigned URING_ENTRIES = 1024;
+
+#ifdef VSNAKE_HAVE_URING
+struct Uring {
+    int                  fd = -1;
+    unsigned            *sqHead, *sqTail, *sqMask, *sqArray;
+    unsigned            *cqHead, *cqTail, *cqMask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void                *sqMap = MAP_FAILED, *cqMap = MAP_FAILED, *sqeMap = MAP_FAILED;
+    size_t               sqMapLen = 0, cqMapLen = 0, sqeMapLen = 0;
+    unsigned             sqEntries = 0, cqEntries = 0, queued = 0;
+};
+
+static bool uringInit(Uring &u, unsigned entries, unsigned cqEntries) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_CQSIZE;
+    p.cq_entries = cqEntries;
+    u.fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+    if (u.fd < 0) return false;
+
+    u.sqMapLen  = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    u.cqMapLen  = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    u.sqeMapLen = p.sq_entries * sizeof(struct io_uring_sqe);
+    u.sqMap  = mmap(nullptr, u.sqMapLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    u.fd, IORING_OFF_SQ_RING);
+    u.cqMap  = mmap(nullptr, u.cqMapLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    u.fd, IORING_OFF_CQ_RING);
+    u.sqeMap = mmap(nullptr, u.sqeMapLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    u.fd, IORING_OFF_SQES);
+    if (u.sqMap == MAP_FAILED || u.cqMap == MAP_FAILED || u.sqeMap == MAP_FAILED) return false;
+
+    char *sq = (char*)u.sqMap, *cq = (char*)u.cqMap;
+    u.sqHead  = (unsigned*)(sq + p.sq_off.head);
+    u.sqTail  = (unsigned*)(sq + p.sq_off.tail);
+    u.sqMask  = (unsigned*)(sq + p.sq_off.ring_mask);
+    u.sqArray = (unsigned*)(sq + p.sq_off.array);
+    u.cqHead  = (unsigned*)(cq + p.cq_off.head);
+    u.cqTail  = (unsigned*)(cq + p.cq_off.tail);
+    u.cqMask  = (unsigned*)(cq + p.cq_off.ring_mask);
+    u.cqes    = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+    u.sqes    = (struct io_uring_sqe*)u.sqeMap;
+    u.sqEntries = p.sq_entries;
+    u.cqEntries = p.cq_entries;
+    return true;
+}
+
+static void uringFree(Uring &u) {
+    if (u.sqeMap != MAP_FAILED) munmap(u.sqeMap, u.sqeMapLen);
+    if (u.cqMap  != MAP_FAILED) munmap(u.cqMap, u.cqMapLen);
+    if (u.sqMap  != MAP_FAILED) munmap(u.sqMap, u.sqMapLen);
+    if (u.fd >= 0) close(u.fd);
+    u = Uring();
+}
+
+// Next free SQE, or nullptr when the submission queue is full.
+// Queued entries are published to the kernel by uringSubmit.
+static struct io_uring_sqe* uringGetSqe(Uring &u) {
+    unsigned head = __atomic_load_n(u.sqHead, __ATOMIC_ACQUIRE);
+    unsigned tail = *u.sqTail + u.queued;
+    if (tail - head >= u.sqEntries) return nullptr;
+    unsigned idx = tail & *u.sqMask;
+    u.sqArray[idx] = idx;
+    u.queued++;
+    struct io_uring_sqe *sqe = &u.sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+static int uringSubmit(Uring &u) {
+    unsigned n = u.queued;
+    u.queued = 0;
+    if (!n) return 0;
+    __atomic_store_n(u.sqTail, *u.sqTail + n, __ATOMIC_RELEASE);
+    return (int)syscall(__NR_io_uring_enter, u.fd, n, 0, 0, nullptr, 0);
+}
+#endif
+
+struct OutputPath {
+    OutputMode    mode = OUT_WRITE;
+    unsigned long syscalls = 0;        // output syscalls issued (loop thread)
+    std::atomic<unsigned long> workerSyscalls{0};
+    unsigned      inFlight = 0;
+#ifdef VSNAKE_HAVE_URING
+    Uring         ring;
+#endif
+};
+
+static OutputMode initOutput(OutputPath &o, OutputMode want) {
+    o.mode = want;
+#ifdef VSNAKE_HAVE_URING
+    if (want == OUT_URING && uringInit(o.ring, URING_ENTRIES, URING_ENTRIES * 4)) return o.mode;
+    if (want == OUT_URING) uringFree(o.ring);
+#endif
+    if (want == OUT_URING) o.mode = OUT_WRITEV;
+    return o.mode;
+}
+
+static void freeOutput(OutputPath &o) {
+#ifdef VSNAKE_HAVE_URING
+    if (o.mode == OUT_URING) uringFree(o.ring);
+#endif
+    (void)o;
+}
+
+// OUT_WRITE, on a pool thread: non-blocking send of the pending frame
+static void flushSession(Session &s, OutputPath &o) {
+    while (outputPending(s) && !s.closing) {
+        int n = sessionIov(s);
+        struct msghdr m;
+        memset(&m, 0, sizeof(m));
+        m.msg_iov = s.iov; m.msg_iovlen = (size_t)n;
+        ssize_t r = sendmsg(s.fd, &m, MSG_NOSIGNAL | MSG_DONTWAIT);
+        o.workerSyscalls.fetch_add(1, std::memory_order_relaxed);
+        sessionSent(s, r < 0 ? -errno : r);
+        if (r < 0) return;
+    }
+}
+
+// Pull in finished sends; never waits
+static void reapOutput(OutputPath &o) {
+#ifdef VSNAKE_HAVE_URING
+    if (o.mode != OUT_URING) return;
+    Uring &u = o.ring;
+    unsigned head = *u.cqHead;
+    unsigned tail = __atomic_load_n(u.cqTail, __ATOMIC_ACQUIRE);
+    for (; head != tail; head++) {
+        struct io_uring_cqe *cqe = &u.cqes[head & *u.cqMask];
+        Session *s = (Session*)(uintptr_t)cqe->user_data;
+        s->inFlight = false;
+        o.inFlight--;
+        sessionSent(*s, cqe->res);
+    }
+    __atomic_store_n(u.cqHead, head, __ATOMIC_RELEASE);
+#else
+    (void)o;
+#endif
+}
+
+// Shutdown: wait until the kernel has let go of every session buffer
+static void drainOutput(OutputPath &o) {
+#ifdef VSNAKE_HAVE_URING
+    while (o.mode == OUT_URING && o.inFlight > 0) {
+        if (syscall(__NR_io_uring_enter, o.ring.fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 &&
+            errno != EINTR) break;
+        reapOutput(o);
+    }
+#else
+    (void)o;
+#endif
+}
+
+// Loop thread, after the frame's work items: push every pending frame
+static void submitOutput(OutputPath &o, std::vector<std::unique_ptr<Session>> &sessions) {
+    if (o.mode == OUT_WRITEV) {
+        for (auto &sp : sessions) {
+            Session &s = *sp;
+            if (!outputPending(s) || s.closing) continue;
+            int n = sessionIov(s);
+            ssize_t r = writev(s.fd, s.iov, n);
+            o.syscalls++;
+            sessionSent(s, r < 0 ? -errno : r);
+        }
+        return;
+    }
+#ifdef VSNAKE_HAVE_URING
+    if (o.mode != OUT_URING) return;
+    Uring &u = o.ring;
+    for (auto &sp : sessions) {
+        Session &s = *sp;
+        if (!outputPending(s) || s.closing || s.inFlight) continue;
+        if (o.inFlight >= u.cqEntries) break;           // keep the CQ from overflowing
+        struct io_uring_sqe *sqe = uringGetSqe(u);
+        if (!sqe) {                                     // SQ full: flush this batch
+            uringSubmit(u); o.syscalls++;
+            if (!(sqe = uringGetSqe(u))) break;
+        }
+        memset(&s.msg, 0, sizeof(s.msg));
+        s.msg.msg_iov = s.iov;
+        s.msg.msg_iovlen = (size_t)sessionIov(s);
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = s.fd;
+        sqe->addr = (uint64_t)(uintptr_t)&s.msg;
+        sqe->len = 1;
+        sqe->msg_flags = MSG_NOSIGNAL;
+        sqe->user_data = (uint64_t)(uintptr_t)&s;
+        s.inFlight = true;
+        o.inFlight++;
+    }
+    if (u.queued) { uringSubmit(u); o.syscalls++; }
+#endif
+}
+
+struct ArcadeServer {
+    int                                    listenFd = -1, ep = -1;
+    std::vector<std::unique_ptr<Session>>  sessions;
+    WorkerPool                             pool;
+    OutputPath                             out;
+    const Level                           *level = nullptr;     // shared by every session
+    int                                    foodTarget = 1;
+    unsigned long                          frames = 0;
+    long long                              frameUsSum = 0, frameUsMax = 0;
+
+    explicit ArcadeServer(int threads) : pool(threads) {}
+    ~ArcadeServer() { freeOutput(out); }
+};
+
+static void addSession(ArcadeServer &srv, int fd) {
+    if (srv.out.mode != OUT_URING) setNonBlocking(fd);
+    Session* s = new Session();
+    s->fd = fd;
+    s->game.level = srv.level;
+    s->game.foodTarget = srv.foodTarget;
+    s->game.diffRender = true;
+    int bw = srv.level ? srv.level->width : BOARD_WIDTH, bh = srv.level ? srv.level->height : BOARD_HEIGHT;
+    if (initBufferArena(s->arena, gameArenaBytes(bw, bh, std::min(srv.foodTarget, bw * bh / 4)), HUGE_NONE))
+        s->game.attachArena(&s->arena);
+    initGame(s->game, freshSeed() ^ (uint64_t)fd, s->termW, s->termH);
+    s->lastFrame = nowMicros();
+    srv.sessions.emplace_back(s);
+    if (srv.ep >= 0) {
+        struct epoll_event ev;
+        ev.events = EPOLLIN | EPOLLRDHUP;
+        ev.data.ptr = s;
+        epoll_ctl(srv.ep, EPOLL_CTL_ADD, fd, &ev);
+    }
+}
+
+static void closeSession(ArcadeServer &srv, Session &s) {
+    s.closing = true;
+    if (srv.ep >= 0) epoll_ctl(srv.ep, EPOLL_CTL_DEL, s.fd, nullptr);
+    shutdown(s.fd, SHUT_RDWR);      // also fails a send still in flight
+}
+
+// Shutdown path: closes every session once no send references it
+static void closeAllSessions(ArcadeServer &srv) {
+    for (auto &s : srv.sessions) closeSession(srv, *s);
+    drainOutput(srv.out);
+    for (auto &s : srv.sessions) close(s->fd);
+    srv.sessions.clear();
+}
+
+static void readSession(Session &s) {
+    char buf[1024];
+    while (true) {
+        ssize_t n = recv(s.fd, buf, sizeof(buf), MSG_DONTWAIT);
+        if (n > 0) {
+            if ((int)s.in.size() < SERVE_MAX_INPUT) s.in.append(buf, (size_t)n);
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EINTR)) return;
+        s.closing = true;
+        return;
+    }
+}
+
+static void appendCentered(std::string &buf, int row, int termW, const char* text, const char* style) {
+    char pos[32];
+    snprintf(pos, sizeof(pos), "\033[%d;%dH", row, std::max(1, (termW - (int)strlen(text)) / 2 + 1));
+    buf += pos; buf += style; buf += text; buf += RESET;
+}
+
+// False if nothing on the client's screen would change
+static bool renderSessionFrame(Session &s) {
+    GameState &g = s.game;
+    if (g.termTooSmall) {
+        std::string &buf = g.renderBuf;
+        buf.clear();
+        buf += "\033[2J";
+        char t[64];
+        snprintf(t, sizeof(t), "Terminal too small (need %dx%d)", MIN_TERM_W, MIN_TERM_H);
+        appendCentered(buf, std::max(1, s.termH / 2), s.termW, t, BOLD RED);
+        g.shownValid = false;
+        return true;
+    }
+    if (!renderFrame(g)) return false;
+    // Cells redrawn under the banner are covered again at once; the
+    // banner goes out with every frame that changed anything
+    if (s.phase == SESSION_OVER) {
+        char t[80];
+        snprintf(t, sizeof(t), "  %s  Score: %d   R: play again   Q: quit  ",
+                 g.gameWon ? "YOU WIN" : "GAME OVER", g.score);
+        appendCentered(g.renderBuf, g.offsetY + 2 + g.boardHeight / 2, s.termW, t,
+                       BOLD YELLOW REVERSE);
+    }
+    return true;
+}
+
+// Runs on a pool thread; touches nothing but its own session
+static void stepSession(Session &s, long long now, OutputPath &o) {
+    GameState &g = s.game;
+    bool resized = false;
+    for (unsigned char c : s.in) {
+        int rows = 0, cols = 0;
+        int k = decodeInputByte(s.dec, c, rows, cols);
+        if (!k) continue;
+        if (k == KEY_TERM_SIZE) {
+            resized = rows != s.termH || cols != s.termW;
+            s.termH = rows; s.termW = cols;
+        } else if (s.phase == SESSION_PLAYING) {
+            handleGameKey(g, k);
+        } else if (k == 'r' || k == 'R') {
+            g.restartRequested = true;
+        } else if (k == 'q' || k == 'Q') {
+            s.closing = true;
+        }
+    }
+    s.in.clear();
+    if (s.in.capacity() > SERVE_IN_KEEP) std::string().swap(s.in);
+    if (s.closing) return;
+
+    long long dt = now - s.lastFrame;
+    s.lastFrame = now;
+    if (s.phase == SESSION_PLAYING && g.running && !g.paused && !g.termTooSmall) {
+        g.moveAccumulator += dt;
+        long long mi = calcMoveInterval(g.score, g.nextDir);
+        if (g.moveAccumulator > mi * 3) g.moveAccumulator = mi;
+        while (g.moveAccumulator >= mi) {
+            updateGame(g);
+            if (!g.running) break;
+            g.moveAccumulator -= mi;
+            applyQueuedDirection(g);
+            mi = calcMoveInterval(g.score, g.nextDir);
+        }
+    }
+
+    if (resized || g.restartRequested) {
+        initGame(g, g.rng.next() ^ (uint64_t)now, s.termW, s.termH);
+        s.phase = SESSION_PLAYING;
+        s.needClear = true;
+    } else if (s.phase == SESSION_PLAYING && !g.running) {
+        if (!g.gameOver && !g.gameWon) { s.closing = true; return; }
+        s.phase = SESSION_OVER;
+        g.shownValid = false;               // the banner needs a full frame
+        if (g.score > 0) s.scoreToSave = g.score;
+    }
+
+    if (!outputPending(s) && !s.inFlight) {
+        // a keyframe's buffer is let go once sent; diffs need little
+        if (g.renderBuf.capacity() > SERVE_OUT_KEEP) std::string().swap(g.renderBuf);
+        long long t0 = g_metricsOn ? nowMicros() : 0;
+        renderSessionFrame(s);
+        if (g_metricsOn) metricEncode(nowMicros() - t0);
+        s.prefix = s.needClear ? "\033[2J" : "";
+        s.needClear = false;
+        s.outLen = s.prefix.size() + g.renderBuf.size();
+        s.outSent = 0;
+    }
+    if (o.mode == OUT_WRITE) flushSession(s, o);
+}
+
+static void serverTick(ArcadeServer &srv) {
+    long long t0 = nowMicros();
+    reapOutput(srv.out);
+    int n = (int)srv.sessions.size();
+    srv.pool.run((n + SERVE_BATCH - 1) / SERVE_BATCH, [&](int item) {
+        int end = std::min(n, (item + 1) * SERVE_BATCH);
+        for (int i = item * SERVE_BATCH; i < end; i++) stepSession(*srv.sessions[i], t0, srv.out);
+    });
+    submitOutput(srv.out, srv.sessions);
+    long long us = nowMicros() - t0;
+    srv.frames++;
+    srv.frameUsSum += us;
+    srv.frameUsMax = std::max(srv.frameUsMax, us);
+
+    for (auto &s : srv.sessions) {
+        if (s->scoreToSave >= 0) { saveScore(s->scoreToSave); s->scoreToSave = -1; }
+        if (!s->closing) continue;
+        // a send still in flight references the session: reap it first
+        closeSession(srv, *s);
+        if (!s->inFlight) { close(s->fd); s->fd = -1; }
+    }
+    srv.sessions.erase(std::remove_if(srv.sessions.begin(), srv.sessions.end(),
+                                      [](const std::unique_ptr<Session> &s) { return s->fd < 0; }),
+                       srv.sessions.end());
+}
+
+// Sessions one core could carry at 33 fps, from the mean frame time
+static double sessionsPerCore(const ArcadeServer &srv, size_t sessions) {
+    if (!srv.frames || !srv.frameUsSum) return 0.0;
+    double meanUs = (double)srv.frameUsSum / srv.frames;
+    return (double)sessions * SERVE_FRAME_US / (meanUs * srv.pool.size());
+}
+
+int runServer(const std::string &spec, int threads, OutputMode mode, const Level *level, int foodTarget) {
+    ArcadeServer srv(threads);
+    srv.level = level;
+    srv.foodTarget = foodTarget;
+    initOutput(srv.out, mode);
+    srv.listenFd = netListen(spec);
+    if (srv.listenFd < 0) { perror("vsnake: listen"); return 1; }
+    setNonBlocking(srv.listenFd);
+    srv.ep = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event lev;
+    lev.events = EPOLLIN;
+    lev.data.ptr = nullptr;
+    epoll_ctl(srv.ep, EPOLL_CTL_ADD, srv.listenFd, &lev);
+
+    fprintf(stderr, "vsnake: serving on %s with %d threads, %s output\n", spec.c_str(),
+            srv.pool.size(), OUTPUT_MODE_NAME[srv.out.mode]);
+    long long nextFrame = nowMicros() + SERVE_FRAME_US;
+    long long nextStats = nowMicros() + SERVE_STATS_SEC * 1000000LL;
+    struct epoll_event evs[256];
+    while (!g_interrupted) {
+        long long now = nowMicros();
+        int timeout = (int)std::max(0LL, (nextFrame - now + 999) / 1000);
+        int ne = epoll_wait(srv.ep, evs, 256, timeout);
+        for (int i = 0; i < ne; i++) {
+            Session* s = (Session*)evs[i].data.ptr;
+            if (!s) {
+                int fd;
+                while ((fd = accept4(srv.listenFd, nullptr, nullptr, SOCK_CLOEXEC)) >= 0)
+                    addSession(srv, fd);
+                continue;
+            }
+            readSession(*s);
+            if (s->closing || (evs[i].events & (EPOLLHUP | EPOLLERR))) closeSession(srv, *s);
+        }
+
+        now = nowMicros();
+        if (now < nextFrame) continue;
+        metricTick(now - nextFrame);
+        serverTick(srv);
+        g_metricSessions.store((int)srv.sessions.size(), std::memory_order_relaxed);
+        nextFrame += SERVE_FRAME_US;
+        if (nextFrame < now) nextFrame = now + SERVE_FRAME_US;   // overloaded: don't bunch up
+
+        if (now >= nextStats) {
+            unsigned long calls = srv.out.syscalls + srv.out.workerSyscalls.load();
+            size_t bytes = 0;
+            for (auto &s : srv.sessions) bytes += sessionMemory(*s).total();
+            fprintf(stderr, "vsnake: %zu sessions  frame %.2f ms avg, %.2f ms max  "
+                    "%.1f output syscalls/frame  ~%.0f sessions/core at 33 fps  %.1f KB/session\n",
+                    srv.sessions.size(), srv.frames ? srv.frameUsSum / 1000.0 / srv.frames : 0.0,
+                    srv.frameUsMax / 1000.0, srv.frames ? (double)calls / srv.frames : 0.0,
+                    sessionsPerCore(srv, srv.sessions.size()),
+                    srv.sessions.empty() ? 0.0 : bytes / 1024.0 / srv.sessions.size());
+            srv.frames = 0; srv.frameUsSum = 0; srv.frameUsMax = 0;
+            srv.out.syscalls = 0; srv.out.workerSyscalls = 0;
+            nextStats = now + SERVE_STATS_SEC * 1000000LL;
+        }
+    }
+    closeAllSessions(srv);
+    close(srv.ep);
+    close(srv.listenFd);
+    if (isUnixSpec(spec)) unlink(unixPath(spec).c_str());
+    return 0;
+}
+
+// ─── Thin Client ────────────────────────────────────────────
+static void sendTermSize(int fd, int &lastW, int &lastH) {
+    int tw, th; getTerminalSize(tw, th);
+    if (tw == lastW && th == lastH) return;
+    lastW = tw; lastH = th;
+    char t[32];
+    int n = snprintf(t, sizeof(t), "\033[8;%d;%dt", th, tw);
+    send(fd, t, (size_t)n, MSG_NOSIGNAL);
+}
+
+int runConnect(const std::string &spec) {
+    int fd = netConnect(spec);
+    if (fd < 0) { fprintf(stderr, "vsnake: no server at %s\n", spec.c_str()); return 1; }
+
+    enableRawMode();
+    hideCursor();
+    write(STDOUT_FILENO, "\033[?1049h", 8);
+    clearScreen();
+
+    int lastW = 0, lastH = 0;
+    char buf[16384];
+    bool lost = false;
+    while (!g_interrupted) {
+        sendTermSize(fd, lastW, lastH);
+        struct pollfd p[2] = { { fd, POLLIN, 0 }, { STDIN_FILENO, POLLIN, 0 } };
+        if (::poll(p, 2, 100) <= 0) continue;
+        if (p[1].revents & (POLLIN | POLLHUP | POLLERR)) {
+            ssize_t n = read(STDIN_FILENO, buf, sizeof(buf));
+            if (n == 0) break;                  // our terminal went away
+            if (n > 0 && send(fd, buf, (size_t)n, MSG_NOSIGNAL) < 0) { lost = true; break; }
+        }
+        if (p[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+            ssize_t n = read(fd, buf, sizeof(buf));
+            if (n <= 0) break;
+            write(STDOUT_FILENO, buf, (size_t)n);
+        }
+    }
+    close(fd);
+    performCleanup();
+    if (lost) fprintf(stderr, "vsnake: connection lost\n");
+    return 0;
+}
+
+// ─── Server Benchmark ───────────────────────────────────────
+// In-process clients on socketpairs: each reports a 100x30 terminal,
+// steers at random and restarts when its game ends.  Only the frame
+// work (decode, simulate, render, output) is measured, as wall time
+// and as process CPU time (which includes the pool threads and any
+// io_uring workers); draining the client ends happens between
+// frames.  Each session count runs once per output mode.
+static long long processCpuNanos() {
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void runServerBenchmark(const std::vector<int> &sessionCounts, const std::vector<OutputMode> &modes,
+                        int threads, int frames) {
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+    static const char* keys[] = { "\033[A", "\033[B", "\033[C", "\033[D", "w", "a", "s", "d" };
+    printf("%9s %9s %8s %13s %13s %15s %17s\n", "sessions", "output", "threads", "frame ms avg",
+           "syscalls/frm", "cpu us/session", "sessions/core@33");
+    for (int n : sessionCounts) {
+        for (OutputMode mode : modes) {
+            ArcadeServer srv(threads);
+            OutputMode used = initOutput(srv.out, mode);
+            if (used != mode && mode == OUT_URING) {
+                printf("%9d %9s   unavailable, skipped\n", n, OUTPUT_MODE_NAME[mode]);
+                continue;
+            }
+            std::vector<int> clients;
+            for (int i = 0; i < n; i++) {
+                int sv[2];
+                if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) != 0) { perror("socketpair"); break; }
+                addSession(srv, sv[0]);
+                setNonBlocking(sv[1]);
+                clients.push_back(sv[1]);
+                send(sv[1], "\033[8;30;100t", 11, MSG_NOSIGNAL);
+            }
+            for (auto &sp : srv.sessions) readSession(*sp);
+            serverTick(srv);
+            srv.frames = 0; srv.frameUsSum = 0; srv.frameUsMax = 0;
+            srv.out.syscalls = 0; srv.out.workerSyscalls = 0;
+
+            Rng rng; rng.seed(12345);
+            char sink[65536];
+            long long cpuNs = 0;
+            for (int f = 0; f < frames && !g_interrupted; f++) {
+                if (srv.sessions.size() != clients.size()) break;
+                for (size_t i = 0; i < clients.size(); i++) {
+                    while (read(clients[i], sink, sizeof(sink)) > 0) {}
+                    const char* k = srv.sessions[i]->phase == SESSION_OVER ? "r"
+                                  : rng.below(8) == 0 ? keys[rng.below(8)] : nullptr;
+                    if (k) send(clients[i], k, strlen(k), MSG_NOSIGNAL);
+                    readSession(*srv.sessions[i]);
+                }
+                long long c0 = processCpuNanos();
+                serverTick(srv);
+                cpuNs += processCpuNanos() - c0;
+            }
+            unsigned long calls = srv.out.syscalls + srv.out.workerSyscalls.load();
+            double perFrame = srv.frames ? 1.0 / srv.frames : 0.0;
+            printf("%9zu %9s %8d %13.3f %13.1f %15.2f %17.0f\n", srv.sessions.size(),
+                   OUTPUT_MODE_NAME[srv.out.mode], srv.pool.size(), srv.frameUsSum / 1000.0 * perFrame,
+                   calls * perFrame, srv.sessions.empty() ? 0.0 : cpuNs / 1000.0 * perFrame / srv.sessions.size(),
+                   sessionsPerCore(srv, srv.sessions.size()));
+            fflush(stdout);
+            closeAllSessions(srv);
+            for (int fd : clients) close(fd);
+        }
+    }
+}
+
+// Idle sessions: clients on socketpairs report a 100x30 terminal and
+// never press a key, so each game runs into the wall and sits on the
+// game-over screen.  After `frames` real-time frames (clients drained
+// between them) prints the average SessionMemory breakdown next to the growth
+// in resident set per session, which also counts malloc overhead but
+// not kernel socket buffers.
+static long residentBytes() {
+    long pages = 0, resident = 0;
+    if (FILE *f = fopen("/proc/self/statm", "r")) {
+        if (fscanf(f, "%ld %ld", &pages, &resident) != 2) resident = 0;
+        fclose(f);
+    }
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+void runSessionMemoryBenchmark(int sessions, int frames) {
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+    ArcadeServer srv(1);
+    initOutput(srv.out, OUT_WRITEV);
+    std::vector<int> clients;
+    long rss0 = residentBytes();
+    for (int i = 0; i < sessions; i++) {
+        int sv[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) != 0) { perror("socketpair"); break; }
+        addSession(srv, sv[0]);
+        setNonBlocking(sv[1]);
+        clients.push_back(sv[1]);
+        send(sv[1], "\033[8;30;100t", 11, MSG_NOSIGNAL);
+    }
+    for (auto &s : srv.sessions) readSession(*s);
+    char sink[65536];
+    uint64_t outBytes = 0;
+    for (int f = 0; f < frames && !g_interrupted; f++) {
+        long long t0 = nowMicros();
+        serverTick(srv);
+        for (int fd : clients) {
+            ssize_t n;
+            while ((n = read(fd, sink, sizeof(sink))) > 0) outBytes += (uint64_t)n;
+        }
+        long long sl = SERVE_FRAME_US - (nowMicros() - t0);
+        if (sl > 0) usleep((useconds_t)sl);
+    }
+    long rss1 = residentBytes();
+    size_t n = std::max((size_t)1, srv.sessions.size());
+    SessionMemory sum;
+    int over = 0;
+    for (auto &s : srv.sessions) {
+        SessionMemory m = sessionMemory(*s);
+        sum.object += m.object; sum.arena += m.arena; sum.snake += m.snake;
+        sum.output += m.output; sum.input += m.input;
+        over += s->phase == SESSION_OVER;
+    }
+    int w = BOARD_WIDTH, h = BOARD_HEIGHT;
+    if (srv.level) { w = srv.level->width; h = srv.level->height; }
+    printf("%zu idle sessions on %dx%d, %d frames (%d on the game-over screen)\n",
+           srv.sessions.size(), w, h, frames, over);
+    printf("  session object %8.0f B\n", (double)sum.object / n);
+    printf("  arena          %8.0f B\n", (double)sum.arena / n);
+    printf("  snake          %8.0f B\n", (double)sum.snake / n);
+    printf("  output         %8.0f B\n", (double)sum.output / n);
+    printf("  input          %8.0f B\n", (double)sum.input / n);
+    printf("  accounted      %8.0f B\n", (double)sum.total() / n);
+    printf("  resident       %8.0f B  (target %d B)\n", (double)(rss1 - rss0) / n, 16 * 1024);
+    printf("  sent           %8.0f B/frame\n", (double)outBytes / n / std::max(1, frames));
+    closeAllSessions(srv);
+    for (int fd : clients) close(fd);
+}
+
+// ─── Metrics Exporter ───────────────────────────────────────
+struct MetricsExporter {
+    std::string        file;                // textfile target; empty = none
+    int                listenFd = -1;       // UNIX socket; -1 = none
+    std::string        socketPath;
+    int                intervalSec = 10;
+    std::atomic<bool>  stop{false};
+    std::thread        thread;
+    MetricTotals       prev;
+    long long          prevAt = 0;
+    std::string        text;                // latest snapshot, exporter thread only
+
+    ~MetricsExporter() {
+        stop = true;
+        if (thread.joinable()) thread.join();
+        if (listenFd >= 0) { close(listenFd); unlink(socketPath.c_str()); }
+    }
+};
+
+static std::unique_ptr<MetricsExporter> g_metrics;
+
+// Upper-bound estimate of quantile q from one interval's bucket deltas
+static double encodeQuantileSec(const uint64_t *delta, double q) {
+    uint64_t total = 0;
+    for (int i = 0; i < METRIC_ENCODE_BUCKETS; i++) total += delta[i];
+    if (!total) return 0.0;
+    uint64_t want = (uint64_t)std::ceil(q * total), seen = 0;
+    for (int i = 0; i < METRIC_ENCODE_BUCKETS - 1; i++) {
+        seen += delta[i];
+        if (seen >= want) return METRIC_ENCODE_LE_US[i] / 1e6;
+    }
+    return METRIC_ENCODE_LE_US[METRIC_ENCODE_BUCKETS - 2] / 1e6;
+}
+
+static std::string formatMetrics(MetricsExporter &e) {
+    MetricTotals t = sumMetricShards();
+    long long now = nowMicros();
+    double secs = e.prevAt ? (now - e.prevAt) / 1e6 : 0.0;
+    uint64_t delta[METRIC_ENCODE_BUCKETS];
+    for (int i = 0; i < METRIC_ENCODE_BUCKETS; i++) delta[i] = t.encode[i] - e.prev.encode[i];
+    auto rate = [&](MetricCounter k) { return secs > 0 ? (t.c[k] - e.prev.c[k]) / secs : 0.0; };
+
+    std::string out;
+    char line[256];
+    auto emit = [&](const char* fmt, auto... v) { snprintf(line, sizeof(line), fmt, v...); out += line; };
+
+    emit("# HELP vsnake_sessions_active Connected --serve sessions.\n"
+         "# TYPE vsnake_sessions_active gauge\nvsnake_sessions_active %d\n",
+         g_metricSessions.load(std::memory_order_relaxed));
+
+    emit("# HELP vsnake_frame_encode_seconds Time to build one frame.\n"
+         "# TYPE vsnake_frame_encode_seconds histogram\n");
+    uint64_t cum = 0;
+    for (int i = 0; i < METRIC_ENCODE_BUCKETS - 1; i++) {
+        cum += t.encode[i];
+        emit("vsnake_frame_encode_seconds_bucket{le=\"%g\"} %llu\n",
+             METRIC_ENCODE_LE_US[i] / 1e6, (unsigned long long)cum);
+    }
+    emit("vsnake_frame_encode_seconds_bucket{le=\"+Inf\"} %llu\n", (unsigned long long)t.c[MC_FRAMES]);
+    emit("vsnake_frame_encode_seconds_sum %.6f\n", t.c[MC_ENCODE_US] / 1e6);
+    emit("vsnake_frame_encode_seconds_count %llu\n", (unsigned long long)t.c[MC_FRAMES]);
+    emit("# HELP vsnake_frame_encode_quantile_seconds Encode time over the last interval (bucket bound).\n"
+         "# TYPE vsnake_frame_encode_quantile_seconds gauge\n");
+    for (double q : { 0.5, 0.9, 0.99 })
+        emit("vsnake_frame_encode_quantile_seconds{quantile=\"%g\"} %g\n", q, encodeQuantileSec(delta, q));
+
+    emit("# HELP vsnake_bytes_out_total Frame bytes written to terminals and sockets.\n"
+         "# TYPE vsnake_bytes_out_total counter\nvsnake_bytes_out_total %llu\n",
+         (unsigned long long)t.c[MC_BYTES_OUT]);
+    emit("# HELP vsnake_bytes_out_per_second Output rate over the last interval.\n"
+         "# TYPE vsnake_bytes_out_per_second gauge\nvsnake_bytes_out_per_second %.1f\n", rate(MC_BYTES_OUT));
+
+    emit("# HELP vsnake_ticks_total Scheduled server ticks.\n"
+         "# TYPE vsnake_ticks_total counter\nvsnake_ticks_total %llu\n", (unsigned long long)t.c[MC_TICKS]);
+    emit("# HELP vsnake_ticks_late_total Ticks that started over 1 ms after their deadline.\n"
+         "# TYPE vsnake_ticks_late_total counter\nvsnake_ticks_late_total %llu\n",
+         (unsigned long long)t.c[MC_LATE_TICKS]);
+    emit("# HELP vsnake_tick_lateness_seconds_total Summed start delay of all ticks.\n"
+         "# TYPE vsnake_tick_lateness_seconds_total counter\nvsnake_tick_lateness_seconds_total %.6f\n",
+         t.c[MC_LATE_US] / 1e6);
+
+    emit("# HELP vsnake_audio_worker_starts_total Sound player processes started.\n"
+         "# TYPE vsnake_audio_worker_starts_total counter\nvsnake_audio_worker_starts_total %llu\n",
+         (unsigned long long)t.c[MC_AUDIO_STARTS]);
+    emit("# HELP vsnake_audio_worker_failures_total Sound players that could not be started or fed.\n"
+         "# TYPE vsnake_audio_worker_failures_total counter\nvsnake_audio_worker_failures_total %llu\n",
+         (unsigned long long)t.c[MC_AUDIO_FAILURES]);
+
+    emit("# HELP vsnake_turns_total Local turn keys timed to their first frame (shown) and move (moved).\n"
+         "# TYPE vsnake_turns_total counter\n");
+    emit("vsnake_turns_total{stage=\"shown\"} %llu\n", (unsigned long long)t.c[MC_TURNS_SHOWN]);
+    emit("vsnake_turns_total{stage=\"moved\"} %llu\n", (unsigned long long)t.c[MC_TURNS_MOVED]);
+    emit("# HELP vsnake_turn_latency_seconds_total Summed key-to-frame time of timed turns.\n"
+         "# TYPE vsnake_turn_latency_seconds_total counter\n");
+    emit("vsnake_turn_latency_seconds_total{stage=\"shown\"} %.6f\n", t.c[MC_TURN_SHOWN_US] / 1e6);
+    emit("vsnake_turn_latency_seconds_total{stage=\"moved\"} %.6f\n", t.c[MC_TURN_MOVED_US] / 1e6);
+
+    emit("# HELP vsnake_score_writes_total Scores saved.\n"
+         "# TYPE vsnake_score_writes_total counter\nvsnake_score_writes_total %llu\n",
+         (unsigned long long)t.c[MC_SCORE_WRITES]);
+    emit("# HELP vsnake_score_writes_per_minute Score write rate over the last interval.\n"
+         "# TYPE vsnake_score_writes_per_minute gauge\nvsnake_score_writes_per_minute %.2f\n",
+         rate(MC_SCORE_WRITES) * 60);
+
+    e.prev = t;
+    e.prevAt = now;
+    return out;
+}
+
+// Textfile collectors must never see a half-written file
+static void writeMetricsFile(const std::string &path, const std::string &text) {
+    std::string tmp = path + ".tmp." + std::to_string(getpid());
+    FILE* f = fopen(tmp.c_str(), "w");
+    if (!f) return;
+    fwrite(text.data(), 1, text.size(), f);
+    if (fclose(f) == 0) rename(tmp.c_str(), path.c_str());
+    else unlink(tmp.c_str());
+}
+
+// One scrape: a short wait for the request, then the snapshot
+static void serveMetrics(int fd, const std::string &text) {
+    char req[512];
+    struct pollfd p = { fd, POLLIN, 0 };
+    ssize_t n = poll(&p, 1, 100) > 0 ? recv(fd, req, sizeof(req), MSG_DONTWAIT) : 0;
+    std::string reply;
+    if (n >= 4 && memcmp(req, "GET ", 4) == 0) {
+        reply = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " +
+                std::to_string(text.size()) + "\r\n\r\n";
+    }
+    reply += text;
+    const char* d = reply.data();
+    size_t rem = reply.size();
+    while (rem > 0) {
+        ssize_t w = send(fd, d, rem, MSG_NOSIGNAL);
+        if (w <= 0) break;
+        d += w; rem -= (size_t)w;
+    }
+    close(fd);
+}
+
+static void metricsLoop(MetricsExporter &e) {
+    e.text = formatMetrics(e);
+    long long next = nowMicros();
+    while (!e.stop && !g_interrupted) {
+        long long now = nowMicros();
+        if (now >= next) {
+            e.text = formatMetrics(e);
+            if (!e.file.empty()) writeMetricsFile(e.file, e.text);
+            next = now + e.intervalSec * 1000000LL;
+        }
+        // short waits so shutdown never lags by a whole interval
+        int waitMs = (int)std::min(200LL, (next - now + 999) / 1000);
+        if (e.listenFd < 0) { usleep(waitMs * 1000); continue; }
+        struct pollfd p = { e.listenFd, POLLIN, 0 };
+        if (poll(&p, 1, waitMs) <= 0) continue;
+        int fd;
+        while ((fd = accept4(e.listenFd, nullptr, nullptr, SOCK_CLOEXEC)) >= 0) serveMetrics(fd, e.text);
+    }
+    if (!e.file.empty()) writeMetricsFile(e.file, formatMetrics(e));
+}
+
+// Before any other thread starts; false with errno set on a bad socket
+static bool startMetrics(const char* file, const char* socketPath, int intervalSec) {
+    g_metrics.reset(new MetricsExporter());
+    MetricsExporter &e = *g_metrics;
+    if (file) e.file = file;
+    e.intervalSec = std::max(1, intervalSec);
+    if (socketPath) {
+        e.socketPath = socketPath;
+        e.listenFd = netListen(std::string("unix:") + socketPath);
+        if (e.listenFd < 0) { g_metrics.reset(); return false; }
+        setNonBlocking(e.listenFd);
+    }
+    g_metricsOn = true;
+    e.thread = std::thread(metricsLoop, std::ref(e));
+    return true;
+}
+
+// ===== LEADERBOARD DAEMON ==================================
+//
+//   vsnaked                       (or: vsnake --daemon [--socket PATH])
+//
+// Optional per-user daemon that owns the score file.  It parses the
+// file once, keeps the best LB_KEEP scores plus running totals in
+// memory, appends each submitted score to the file, and answers
+// requests on a UNIX socket: $VSNAKED_SOCKET, else
+// $XDG_RUNTIME_DIR/vsnaked.sock, else /tmp/vsnaked-<uid>/sock.  That
+// last directory is created mode 0700 and used only while it is still
+// a directory owned by this user with no group or other access, so
+// another user cannot plant a socket there to collect the scores.
+// saveScore/loadScores try it first and fall back to the file when
+// nothing is listening or it does not answer within LB_TIMEOUT_MS.
+//
+// Protocol, all little-endian, any number of requests per connection:
+//
+//   request  16 bytes  op u8, version u8, k u16, score u32, time i64
+//   reply    24 bytes  status u8, op u8, count u16, rank u32,
+//                      total u64, sum u64
+//            followed by count entries of 12 bytes: time i64, score u32
+//
+//   LB_SUBMIT  record score at time; rank is its place in the kept
+//              top scores (0 if it did not make it)
+//   LB_QUERY   best k scores (k <= LB_KEEP; 0 for totals only)
+//
+
+static const int      LB_KEEP        = 100;
+static const int      LB_TIMEOUT_MS  = 250;
+static const int      LB_REQ_SIZE    = 16;
+static const int      LB_REPLY_SIZE  = 24;
+static const int      LB_ENTRY_SIZE  = 12;
+static const uint8_t  LB_VERSION     = 1;
+
+enum LbOp : uint8_t { LB_SUBMIT = 1, LB_QUERY = 2 };
+enum LbStatus : uint8_t { LB_OK = 0, LB_BAD_REQUEST = 1 };
+
+struct LbRequest {
+    uint8_t  op, version;
+    uint16_t k;
+    uint32_t score;
+    int64_t  time;
+};
+
+struct LbReply {
+    uint8_t  status, op;
+    uint16_t count;
+    uint32_t rank;
+    uint64_t total, sum;
+};
+
+struct LbEntry {
+    int64_t  time;
+    uint32_t score;
+};
+
+static void putLE(uint8_t *p, uint64_t v, int n) {
+    for (int i = 0; i < n; i++) p[i] = (uint8_t)(v >> (8 * i));
+}
+static uint64_t getLE(const uint8_t *p, int n) {
+    uint64_t v = 0;
+    for (int i = 0; i < n; i++) v |= (uint64_t)p[i] << (8 * i);
+    return v;
+}
+
+static void encodeLbRequest(const LbRequest &r, uint8_t *p) {
+    p[0] = r.op; p[1] = r.version;
+    putLE(p + 2, r.k, 2); putLE(p + 4, r.score, 4); putLE(p + 8, (uint64_t)r.time, 8);
+}
+static LbRequest decodeLbRequest(const uint8_t *p) {
+    LbRequest r;
+    r.op = p[0]; r.version = p[1];
+    r.k = (uint16_t)getLE(p + 2, 2); r.score = (uint32_t)getLE(p + 4, 4);
+    r.time = (int64_t)getLE(p + 8, 8);
+    return r;
+}
+static void encodeLbReply(const LbReply &r, uint8_t *p) {
+    p[0] = r.status; p[1] = r.op;
+    putLE(p + 2, r.count, 2); putLE(p + 4, r.rank, 4);
+    putLE(p + 8, r.total, 8); putLE(p + 16, r.sum, 8);
+}
+static LbReply decodeLbReply(const uint8_t *p) {
+    LbReply r;
+    r.status = p[0]; r.op = p[1];
+    r.count = (uint16_t)getLE(p + 2, 2); r.rank = (uint32_t)getLE(p + 4, 4);
+    r.total = getLE(p + 8, 8); r.sum = getLE(p + 16, 8);
+    return r;
+}
+
+// The socket path, or "" when the /tmp fallback directory is not
+// safely ours; the daemon (create) makes that directory first
+static std::string leaderboardSocketPath(bool create = false) {
+    const char* env = getenv("VSNAKED_SOCKET");
+    if (env && env[0]) return env;
+    const char* run = getenv("XDG_RUNTIME_DIR");
+    if (run && run[0]) return std::string(run) + "/vsnaked.sock";
+    std::string dir = "/tmp/vsnaked-" + std::to_string(getuid());
+    if (create) mkdir(dir.c_str(), 0700);
+    struct stat st;
+    if (lstat(dir.c_str(), &st) != 0 || !S_ISDIR(st.st_mode) || st.st_uid != getuid() || (st.st_mode & 077))
+        return "";
+    return dir + "/sock";
+}
+
+// ─── Client ─────────────────────────────────────────────────
+// Connected socket with send/receive timeouts, or -1 if no daemon
+static int lbConnect(const std::string &path) {
+    if (path.empty()) return -1;
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    struct sockaddr_un sa; memset(&sa, 0, sizeof(sa));
+    sa.sun_family = AF_UNIX;
+    strncpy(sa.sun_path, path.c_str(), sizeof(sa.sun_path) - 1);
+    if (connect(fd, (struct sockaddr*)&sa, sizeof(sa)) != 0) { close(fd); return -1; }
+    struct timeval tv = { LB_TIMEOUT_MS / 1000, (LB_TIMEOUT_MS % 1000) * 1000 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    return fd;
+}
+
+static bool lbReadFull(int fd, uint8_t *p, size_t n) {
+    while (n > 0) {
+        ssize_t r = recv(fd, p, n, 0);
+        if (r <= 0) { if (r < 0 && errno == EINTR) continue; return false; }
+        p += r; n -= (size_t)r;
+    }
+    return true;
+}
+
+// One request/reply on an open connection; entries may be null
+static bool lbRoundTrip(int fd, const LbRequest &req, LbReply &rep, std::vector<LbEntry> *entries) {
+    uint8_t buf[LB_REPLY_SIZE];
+    encodeLbRequest(req, buf);
+    if (send(fd, buf, LB_REQ_SIZE, MSG_NOSIGNAL) != LB_REQ_SIZE) return false;
+    if (!lbReadFull(fd, buf, LB_REPLY_SIZE)) return false;
+    rep = decodeLbReply(buf);
+    if (rep.status != LB_OK || rep.op != req.op || rep.count > LB_KEEP) return false;
+    uint8_t eb[LB_KEEP * LB_ENTRY_SIZE];
+    if (!lbReadFull(fd, eb, (size_t)rep.count * LB_ENTRY_SIZE)) return false;
+    if (entries) {
+        entries->resize(rep.count);
+        for (int i = 0; i < rep.count; i++) {
+            (*entries)[i].time  = (int64_t)getLE(eb + i * LB_ENTRY_SIZE, 8);
+            (*entries)[i].score = (uint32_t)getLE(eb + i * LB_ENTRY_SIZE + 8, 4);
+        }
+    }
+    return true;
+}
+
+bool lbSubmit(int score) {
+    int fd = lbConnect(leaderboardSocketPath());
+    if (fd < 0) return false;
+    LbRequest req = { LB_SUBMIT, LB_VERSION, 0, (uint32_t)std::max(0, score), (int64_t)time(nullptr) };
+    LbReply rep;
+    bool ok = lbRoundTrip(fd, req, rep, nullptr);
+    close(fd);
+    return ok;
+}
+
+bool lbQuery(int k, std::vector<ScoreEntry> &out) {
+    int fd = lbConnect(leaderboardSocketPath());
+    if (fd < 0) return false;
+    LbRequest req = { LB_QUERY, LB_VERSION, (uint16_t)std::min(k, LB_KEEP), 0, 0 };
+    LbReply rep;
+    std::vector<LbEntry> entries;
+    bool ok = lbRoundTrip(fd, req, rep, &entries);
+    close(fd);
+    if (!ok) return false;
+    out.clear();
+    for (auto &e : entries) out.push_back({ formatTimestamp((time_t)e.time), (int)e.score });
+    return true;
+}
+
+// ─── Daemon ─────────────────────────────────────────────────
+struct ScoreBoard {
+    std::vector<LbEntry> top;          // best first, at most LB_KEEP
+    uint64_t             total = 0, sum = 0;
+    int                  fileFd = -1;
+};
+
+static bool lbBetter(const LbEntry &a, const LbEntry &b) {
+    if (a.score != b.score) return a.score > b.score;
+    return a.time > b.time;
+}
+
+// Returns the 1-based place among the kept scores, 0 if not kept
+static uint32_t scoreBoardInsert(ScoreBoard &sb, const LbEntry &e) {
+    sb.total++;
+    sb.sum += e.score;
+    auto it = std::upper_bound(sb.top.begin(), sb.top.end(), e, lbBetter);
+    if (it == sb.top.end() && (int)sb.top.size() >= LB_KEEP) return 0;
+    uint32_t rank = (uint32_t)(it - sb.top.begin()) + 1;
+    sb.top.insert(it, e);
+    if ((int)sb.top.size() > LB_KEEP) sb.top.pop_back();
+    return rank;
+}
+
+static bool loadScoreBoard(ScoreBoard &sb) {
+    for (const ScoreEntry &s : loadScoreFile())
+        scoreBoardInsert(sb, { (int64_t)parseTimestamp(s.timestamp), (uint32_t)std::max(0, s.score) });
+    sb.fileFd = open(getScoreFilePath().c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    return sb.fileFd >= 0;
+}
+
+// Appends the reply to tx
+static void handleLbRequest(ScoreBoard &sb, const LbRequest &req, std::string &tx) {
+    LbReply rep = { LB_OK, req.op, 0, 0, 0, 0 };
+    if (req.version != LB_VERSION || (req.op != LB_SUBMIT && req.op != LB_QUERY) ||
+        req.k > LB_KEEP || req.score > (uint32_t)INT32_MAX) {
+        rep.status = LB_BAD_REQUEST;
+    } else if (req.op == LB_SUBMIT) {
+        LbEntry e = { req.time, req.score };
+        rep.rank = scoreBoardInsert(sb, e);
+        std::string line = formatTimestamp((time_t)req.time) + " | " + std::to_string(req.score) + "\n";
+        if (write(sb.fileFd, line.data(), line.size()) < 0)
+            fprintf(stderr, "vsnaked: score file: %s\n", strerror(errno));
+    } else {
+        rep.count = (uint16_t)std::min<size_t>(req.k, sb.top.size());
+    }
+    rep.total = sb.total; rep.sum = sb.sum;
+
+    size_t at = tx.size();
+    tx.resize(at + LB_REPLY_SIZE + (size_t)rep.count * LB_ENTRY_SIZE);
+    uint8_t *p = (uint8_t*)&tx[at];
+    encodeLbReply(rep, p);
+    p += LB_REPLY_SIZE;
+    for (int i = 0; i < rep.count; i++, p += LB_ENTRY_SIZE) {
+        putLE(p, (uint64_t)sb.top[i].time, 8);
+        putLE(p + 8, sb.top[i].score, 4);
+    }
+}
+
+struct LbClient {
+    int         fd;
+    size_t      slot;               // index in the daemon's client list
+    std::string rx, tx;
+    bool        wantOut = false;
+};
+
+// Single-threaded epoll loop; stop (if given) ends it like SIGINT
+int runLeaderboardDaemon(const std::string &path, const std::atomic<bool> *stop = nullptr) {
+    int probe = lbConnect(path);
+    if (probe >= 0) {
+        close(probe);
+        fprintf(stderr, "vsnaked: already running on %s\n", path.c_str());
+        return 1;
+    }
+    ScoreBoard sb;
+    if (!loadScoreBoard(sb)) { perror("vsnaked: score file"); return 1; }
+    int lfd = netListen("unix:" + path);
+    if (lfd < 0) { perror("vsnaked: listen"); close(sb.fileFd); return 1; }
+    setNonBlocking(lfd);
+    int ep = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event lev;
+    lev.events = EPOLLIN;
+    lev.data.ptr = nullptr;
+    epoll_ctl(ep, EPOLL_CTL_ADD, lfd, &lev);
+    if (!stop)
+        fprintf(stderr, "vsnaked: %llu scores loaded, listening on %s\n",
+                (unsigned long long)sb.total, path.c_str());
+
+    std::vector<LbClient*> clients;
+    struct epoll_event evs[128];
+    while (!g_interrupted && !(stop && stop->load())) {
+        int ne = epoll_wait(ep, evs, 128, 200);
+        for (int i = 0; i < ne; i++) {
+            LbClient *c = (LbClient*)evs[i].data.ptr;
+            if (!c) {
+                int fd;
+                while ((fd = accept4(lfd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+                    LbClient *nc = new LbClient{ fd, clients.size(), std::string(), std::string() };
+                    clients.push_back(nc);
+                    struct epoll_event ev;
+                    ev.events = EPOLLIN;
+                    ev.data.ptr = nc;
+                    epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev);
+                }
+                continue;
+            }
+            bool dead = (evs[i].events & EPOLLERR) != 0;
+            char buf[4096];
+            while (!dead) {
+                ssize_t n = read(c->fd, buf, sizeof(buf));
+                if (n > 0) { c->rx.append(buf, (size_t)n); continue; }
+                dead = n == 0 || (errno != EAGAIN && errno != EINTR);
+                break;
+            }
+            size_t used = 0;
+            while (c->rx.size() - used >= (size_t)LB_REQ_SIZE) {
+                handleLbRequest(sb, decodeLbRequest((const uint8_t*)c->rx.data() + used), c->tx);
+                used += LB_REQ_SIZE;
+            }
+            c->rx.erase(0, used);
+            while (!c->tx.empty()) {
+                ssize_t w = send(c->fd, c->tx.data(), c->tx.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+                if (w > 0) { c->tx.erase(0, (size_t)w); continue; }
+                if (w < 0 && (errno == EAGAIN || errno == EINTR)) break;
+                dead = true; break;
+            }
+            if (dead) {                       // close also drops it from epoll
+                close(c->fd);
+                clients[c->slot] = clients.back();
+                clients[c->slot]->slot = c->slot;
+                clients.pop_back();
+                delete c;
+                continue;
+            }
+            bool want = !c->tx.empty();
+            if (want != c->wantOut) {
+                struct epoll_event ev;
+                ev.events = want ? EPOLLIN | EPOLLOUT : EPOLLIN;
+                ev.data.ptr = c;
+                epoll_ctl(ep, EPOLL_CTL_MOD, c->fd, &ev);
+                c->wantOut = want;
+            }
+        }
+    }
+    for (LbClient *c : clients) { close(c->fd); delete c; }
+    close(ep);
+    close(lfd);
+    close(sb.fileFd);
+    unlink(path.c_str());
+    return 0;
+}
+
+// ─── Daemon Benchmark ───────────────────────────────────────
+// Runs a daemon in-process on a scratch score file seeded with
+// `seedScores` lines, then measures: the file fallback (parse + sort
+// per loadScores), one-shot lbQuery as the game does it, and query
+// latency / submit throughput for C clients on persistent
+// connections, all hammering the daemon at once.
+static double percentile(std::vector<long long> &v, double q) {
+    if (v.empty()) return 0.0;
+    size_t i = std::min(v.size() - 1, (size_t)(q * (double)v.size()));
+    std::nth_element(v.begin(), v.begin() + i, v.end());
+    return v[i] / 1000.0;
+}
+
+void runDaemonBenchmark(const std::vector<int> &clientCounts, int ops, int seedScores) {
+    char dir[] = "/tmp/vsnaked-bench-XXXXXX";
+    if (!mkdtemp(dir)) { perror("vsnaked: mkdtemp"); return; }
+    setenv("XDG_DATA_HOME", dir, 1);
+    std::string sock = std::string(dir) + "/vsnaked.sock";
+    setenv("VSNAKED_SOCKET", sock.c_str(), 1);
+    {
+        Rng rng; rng.seed(99);
+        time_t t0 = time(nullptr) - seedScores;
+        for (int i = 0; i < seedScores; i++) appendScoreFile(formatTimestamp(t0 + i), rng.below(5000) * 10);
+    }
+
+    long long t = nowNanos();
+    int reps = 20;
+    for (int i = 0; i < reps; i++) loadScores();
+    printf("file fallback   loadScores with %d scores: %.1f us\n", seedScores, (nowNanos() - t) / 1000.0 / reps);
+
+    std::atomic<bool> stop(false);
+    std::thread daemon([&] { runLeaderboardDaemon(sock, &stop); });
+    int fd = -1;
+    for (int i = 0; i < 200 && (fd = lbConnect(sock)) < 0; i++) usleep(5000);
+    if (fd < 0) { fprintf(stderr, "vsnaked: daemon did not start\n"); stop = true; daemon.join(); return; }
+    close(fd);
+
+    std::vector<long long> one;
+    std::vector<ScoreEntry> top;
+    for (int i = 0; i < 1000; i++) {
+        long long s = nowNanos();
+        lbQuery(LEADERBOARD_TOP, top);
+        one.push_back(nowNanos() - s);
+    }
+    printf("daemon          lbQuery (connect + top %d): p50 %.1f us  p99 %.1f us\n\n",
+           LEADERBOARD_TOP, percentile(one, 0.5), percentile(one, 0.99));
+
+    printf("%8s %14s %14s %14s %16s\n", "clients", "query p50 us", "query p99 us", "queries/s", "submits/s");
+    for (int c : clientCounts) {
+        double rate[2];
+        std::vector<long long> lat;
+        for (int phase = 0; phase < 2; phase++) {
+            std::vector<std::vector<long long>> per(c);
+            std::vector<std::thread> threads;
+            long long start = nowNanos();
+            for (int i = 0; i < c; i++) {
+                threads.emplace_back([&, i] {
+                    int cfd = lbConnect(sock);
+                    if (cfd < 0) return;
+                    LbRequest req = phase == 0
+                        ? LbRequest{ LB_QUERY, LB_VERSION, (uint16_t)LEADERBOARD_TOP, 0, 0 }
+                        : LbRequest{ LB_SUBMIT, LB_VERSION, 0, (uint32_t)(i * 10), (int64_t)time(nullptr) };
+                    LbReply rep;
+                    std::vector<LbEntry> entries;
+                    per[i].reserve(ops);
+                    for (int k = 0; k < ops; k++) {
+                        long long s = nowNanos();
+                        if (!lbRoundTrip(cfd, req, rep, &entries)) break;
+                        per[i].push_back(nowNanos() - s);
+                    }
+                    close(cfd);
+                });
+            }
+            for (auto &th : threads) th.join();
+            double secs = (nowNanos() - start) / 1e9;
+            size_t done = 0;
+            for (auto &v : per) done += v.size();
+            rate[phase] = done / secs;
+            if (phase == 0) for (auto &v : per) lat.insert(lat.end(), v.begin(), v.end());
+        }
+        printf("%8d %14.1f %14.1f %14.0f %16.0f\n", c, percentile(lat, 0.5), percentile(lat, 0.99),
+               rate[0], rate[1]);
+        fflush(stdout);
+    }
+    stop = true;
+    daemon.join();
+    unlink(getScoreFilePath().c_str());
+    rmdir((std::string(dir) + "/" + APP_DIR_NAME).c_str());
+    rmdir(dir);
+}
+
+// ===== ENDLESS WORLD =======================================
+//
+//   vsnake --endless
+//
+// No walls: the world is the whole int range in both directions and
+// the view follows the head.  Occupancy lives in a ChunkedBoard --
+// 64x64 bit tiles in a hash map, allocated when the first segment
+// enters a tile and freed when the last one leaves -- so memory
+// follows the snake's length, never the area it has travelled.
+//
+// Food is not stored: each chunk has ENDLESS_FOOD_PER_CHUNK apples at
+// positions hashed from (seed, chunk), and the only state is the set
+// of cells already eaten (one per growth step, so it too scales with
+// length).  A test is a hash lookup plus a bit or a few hashes: O(1).
+//
+
+static const int ENDLESS_CHUNK_SHIFT    = 6;
+static const int ENDLESS_CHUNK          = 1 << ENDLESS_CHUNK_SHIFT;
+static const int ENDLESS_FOOD_PER_CHUNK = 4;
+
+struct BitChunk {
+    uint64_t rows[ENDLESS_CHUNK];       // bit x of rows[y]
+    int      count;
+};
+
+static inline uint64_t packXY(int x, int y) { return ((uint64_t)(uint32_t)x << 32) | (uint32_t)y; }
+
+struct Mix64Hash {
+    size_t operator()(uint64_t k) const { return (size_t)mix64(k); }
+};
+
+struct ChunkedBoard {
+    std::unordered_map<uint64_t, BitChunk*, Mix64Hash> chunks;
+    mutable uint64_t  lastKey = 0;         // one-entry cache: neighbours share a chunk
+    mutable BitChunk *last = nullptr;      // (every key is valid, so null = empty)
+
+    ChunkedBoard() = default;
+    ChunkedBoard(const ChunkedBoard&) = delete;
+    ChunkedBoard& operator=(const ChunkedBoard&) = delete;
+    ~ChunkedBoard() { reset(); }
+
+    void reset() {
+        for (auto &kv : chunks) delete kv.second;
+        chunks.clear();
+        last = nullptr;
+    }
+
+    BitChunk* find(uint64_t key) const {
+        if (last && key == lastKey) return last;
+        auto it = chunks.find(key);
+        if (it == chunks.end()) return nullptr;
+        lastKey = key; last = it->second;
+        return last;
+    }
+
+    bool test(Point p) const {
+        const BitChunk *c = find(packXY(p.x >> ENDLESS_CHUNK_SHIFT, p.y >> ENDLESS_CHUNK_SHIFT));
+        return c && ((c->rows[p.y & (ENDLESS_CHUNK - 1)] >> (p.x & (ENDLESS_CHUNK - 1))) & 1);
+    }
+
+    void set(Point p) {
+        uint64_t key = packXY(p.x >> ENDLESS_CHUNK_SHIFT, p.y >> ENDLESS_CHUNK_SHIFT);
+        BitChunk *c = find(key);
+        if (!c) {
+            c = new BitChunk();
+            chunks.emplace(key, c);
+            lastKey = key; last = c;
+        }
+        uint64_t &row = c->rows[p.y & (ENDLESS_CHUNK - 1)];
+        uint64_t bit = 1ULL << (p.x & (ENDLESS_CHUNK - 1));
+        if (!(row & bit)) { row |= bit; c->count++; }
+    }
+
+    void clear(Point p) {
+        uint64_t key = packXY(p.x >> ENDLESS_CHUNK_SHIFT, p.y >> ENDLESS_CHUNK_SHIFT);
+        BitChunk *c = find(key);
+        if (!c) return;
+        uint64_t &row = c->rows[p.y & (ENDLESS_CHUNK - 1)];
+        uint64_t bit = 1ULL << (p.x & (ENDLESS_CHUNK - 1));
+        if (!(row & bit)) return;
+        row &= ~bit;
+        if (--c->count == 0) {
+            chunks.erase(key);
+            delete c;
+            last = nullptr;
+        }
+    }
+
+    size_t bytes() const {
+        return chunks.size() * (sizeof(BitChunk) + sizeof(void*) * 3 + sizeof(uint64_t))
+             + chunks.bucket_count() * sizeof(void*);
+    }
+};
+
+struct EndlessGame {
+    std::deque<Point>  snake;
+    Direction          dir, nextDir, queuedDir;
+    bool               dirChangedThisTick, hasQueuedDir;
+    int                score;
+    bool               running, gameOver, paused, restartRequested;
+    long long          moveAccumulator;
+    unsigned long      frameCount;
+    uint64_t           seed;
+    ChunkedBoard       board;
+    std::unordered_set<uint64_t, Mix64Hash> eaten;
+    std::vector<uint8_t> view;              // CellGlyph per visible cell
+    std::string        renderBuf;
+};
+
+// i-th apple of chunk (cx, cy)
+static inline Point chunkFood(uint64_t seed, int cx, int cy, int i) {
+    uint64_t h = mix64(seed ^ mix64(packXY(cx, cy) + (uint64_t)i * 0x9E3779B97F4A7C15ULL));
+    return { cx * ENDLESS_CHUNK + (int)(h & (ENDLESS_CHUNK - 1)),
+             cy * ENDLESS_CHUNK + (int)((h >> 16) & (ENDLESS_CHUNK - 1)) };
+}
+
+static bool isEndlessFood(const EndlessGame &e, Point p) {
+    int cx = p.x >> ENDLESS_CHUNK_SHIFT, cy = p.y >> ENDLESS_CHUNK_SHIFT;
+    for (int i = 0; i < ENDLESS_FOOD_PER_CHUNK; i++)
+        if (chunkFood(e.seed, cx, cy, i) == p) return !e.eaten.count(packXY(p.x, p.y));
+    return false;
+}
+
+void initEndless(EndlessGame &e, uint64_t seed) {
+    e.board.reset();
+    e.eaten.clear();
+    e.snake.clear();
+    for (int i = 0; i < 3; i++) e.snake.push_back({ -i, 0 });
+    for (auto &s : e.snake) e.board.set(s);
+    e.dir = e.nextDir = e.queuedDir = RIGHT;
+    e.dirChangedThisTick = e.hasQueuedDir = false;
+    e.score = 0;
+    e.running = true; e.gameOver = false; e.paused = false; e.restartRequested = false;
+    e.moveAccumulator = 0; e.frameCount = 0;
+    e.seed = seed;
+}
+
+void updateEndless(EndlessGame &e) {
+    if (e.paused) return;
+    e.dir = e.nextDir;
+    Point nh = e.snake.front();
+    switch (e.dir) {
+        case UP: nh.y--; break; case DOWN: nh.y++; break;
+        case LEFT: nh.x--; break; case RIGHT: nh.x++; break;
+    }
+    bool growing = isEndlessFood(e, nh);
+    if (!growing) e.board.clear(e.snake.back());
+    if (e.board.test(nh)) {
+        if (!growing) e.board.set(e.snake.back());
+        e.gameOver = true; e.running = false; soundGameOver(); return;
+    }
+    e.snake.push_front(nh);
+    e.board.set(nh);
+    if (growing) {
+        e.eaten.insert(packXY(nh.x, nh.y));
+        e.score += 10;
+        soundEat();
+    } else {
+        e.snake.pop_back();
+    }
+}
+
+// View centred on the head; cells come from the board and the food
+// hashes of the visible chunks only
+void renderEndless(EndlessGame &e, int termW, int termH) {
+    int vw = std::max(1, (termW - 4) / 2), vh = std::max(1, termH - 4);
+    Point head = e.snake.front();
+    int x0 = head.x - vw / 2, y0 = head.y - vh / 2;
+    e.view.assign((size_t)vw * vh, CG_EMPTY);
+
+    int cx0 = x0 >> ENDLESS_CHUNK_SHIFT, cx1 = (x0 + vw - 1) >> ENDLESS_CHUNK_SHIFT;
+    int cy0 = y0 >> ENDLESS_CHUNK_SHIFT, cy1 = (y0 + vh - 1) >> ENDLESS_CHUNK_SHIFT;
+    uint8_t apple = appleGlyph(e.frameCount, 0);
+    for (int cy = cy0; cy <= cy1; cy++)
+        for (int cx = cx0; cx <= cx1; cx++)
+            for (int i = 0; i < ENDLESS_FOOD_PER_CHUNK; i++) {
+                Point f = chunkFood(e.seed, cx, cy, i);
+                int vx = f.x - x0, vy = f.y - y0;
+                if (vx < 0 || vy < 0 || vx >= vw || vy >= vh) continue;
+                if (!e.eaten.count(packXY(f.x, f.y))) e.view[(size_t)vy * vw + vx] = apple;
+            }
+    for (int vy = 0; vy < vh; vy++)
+        for (int vx = 0; vx < vw; vx++)
+            if (e.board.test({ x0 + vx, y0 + vy })) e.view[(size_t)vy * vw + vx] = CG_BODY_A;
+    int hx = head.x - x0, hy = head.y - y0;
+    e.view[(size_t)hy * vw + hx] = (uint8_t)(CG_HEAD_GREEN + (e.frameCount / HEAD_GLOW_PERIOD) % 3);
+    if (!e.paused) e.frameCount++;
+
+    std::string &buf = e.renderBuf;
+    buf.clear();
+    buf += "\033[1;1H";
+    char hdr[200];
+    snprintf(hdr, sizeof(hdr), BOLD BRIGHT_GREEN "ENDLESS" RESET "  " BOLD YELLOW "Score: %d" RESET
+             "  length %zu  at (%d,%d)  " DIM "chunks %zu, %.1f KiB" RESET,
+             e.score, e.snake.size(), head.x, head.y, e.board.chunks.size(), e.board.bytes() / 1024.0);
+    buf += hdr; buf += ERASE_LINE "\n";
+    buf += CYAN "+"; buf.append((size_t)vw * 2 + 2, '-'); buf += "+" RESET ERASE_LINE "\n";
+    for (int vy = 0; vy < vh; vy++) {
+        buf += CYAN "| " RESET;
+        int wy = y0 + vy;
+        for (int vx = 0; vx < vw; vx++) {
+            uint8_t gph = e.view[(size_t)vy * vw + vx];
+            int wx = x0 + vx;
+            // faint marks every 8 cells so straight runs still show motion
+            if (gph == CG_EMPTY && !(wx & 7) && !(wy & 7)) buf += DIM ". " RESET;
+            else buf += CELL_GLYPH[gph];
+        }
+        buf += CYAN " |" RESET ERASE_LINE "\n";
+    }
+    buf += CYAN "+"; buf.append((size_t)vw * 2 + 2, '-'); buf += "+" RESET ERASE_LINE "\n";
+    const char* footer = e.gameOver ? "GAME OVER -- R: play again | Q: quit"
+                       : e.paused   ? "PAUSED -- P: resume"
+                                    : "Move: WASD/HJKL/Arrows | P: Pause | R: Restart | Q: Quit";
+    buf += e.gameOver ? BOLD RED : CYAN;
+    buf += footer;
+    buf += RESET ERASE_LINE;
+    write(STDOUT_FILENO, buf.c_str(), buf.size());
+}
+
+int runEndless() {
+    enableRawMode();
+    hideCursor();
+    write(STDOUT_FILENO, "\033[?1049h", 8);
+    atexit(atexitCleanup);
+    initSound();
+    clearScreen();
+
+    EndlessGame e;
+    initEndless(e, freshSeed());
+    long long lastFrame = nowMicros();
+    while (!g_interrupted) {
+        long long fs = nowMicros();
+        long long dt = fs - lastFrame;
+        lastFrame = fs;
+
+        if (e.running) {
+            readInput(e);
+        } else {
+            char c;
+            while (readKeyByte(c)) {
+                if (c == 'r' || c == 'R') e.restartRequested = true;
+                if (c == 'q' || c == 'Q') { g_interrupted = 1; break; }
+            }
+        }
+        if (e.restartRequested) { initEndless(e, freshSeed()); clearScreen(); continue; }
+        if (!e.running && !e.gameOver) break;
+
+        if (e.running && !e.paused) {
+            e.moveAccumulator += dt;
+            long long mi = calcMoveInterval(e.score, e.nextDir);
+            if (e.moveAccumulator > mi * 3) e.moveAccumulator = mi;
+            while (e.moveAccumulator >= mi) {
+                updateEndless(e);
+                if (!e.running) { if (e.score > 0) saveScore(e.score); break; }
+                e.moveAccumulator -= mi;
+                applyQueuedDirection(e);
+                mi = calcMoveInterval(e.score, e.nextDir);
+            }
+        }
+
+        int tw, th; getTerminalSize(tw, th);
+        renderEndless(e, tw, th);
+
+        long long sl = RENDER_TICK_US - (nowMicros() - fs);
+        if (sl > 0) usleep(static_cast<useconds_t>(sl));
+    }
+    performCleanup();
+    return 0;
+}
+
+// ===== DIFFERENTIAL FUZZING ================================
+//
+// Every speedup to updateGame/spawnFood (bitmaps, batched respawns,
+// rank sampling) touches the code that decides deaths and scores.
+// The reference engine below is the plain version of the same rules:
+// a walk of the body deque for collisions, one food slot per cell, a
+// full-board scan for free cells.  A fuzz input runs through both
+// engines, and they are compared field by field after every tick.
+//
+// The reference draws random numbers exactly as placeFood does: the
+// same probe count, rank method and one gold roll per item in
+// placement order.  A seed therefore fixes the same game in both, and
+// only the data structures differ.  Changing the draw order changes
+// the rules, so it must be done in both engines.
+//
+// Input: a FUZZ_HEADER-byte header (width, height, food target, seed)
+// then one byte per tick:
+//   bits 0-1  direction (UP DOWN LEFT RIGHT)   bit 2  press it
+//   bits 3-4  a second direction               bit 5  press it
+//   bits 6-7  01 = toggle pause
+// When a game ends, both engines restart on the next byte.
+//
+//   vsnake --fuzz [--runs N] [--ticks N] [--seed S]   random driver
+//   vsnake --fuzz-corpus DIR          long games that fill the board
+//   vsnake --fuzz-replay PATH...      rerun input files or directories
+//
+// Built with -DVSNAKE_LIBFUZZER (and clang's -fsanitize=fuzzer) the
+// file drops main() and exports LLVMFuzzerTestOneInput instead; seed
+// it with the --fuzz-corpus output.
+//
+
+static const int FUZZ_HEADER = 11;
+
+struct RefGame {
+    int                 boardWidth = 0, boardHeight = 0, foodTarget = 1;
+    const Level        *level = nullptr;
+    std::deque<Point>   snake;
+    Direction           dir, nextDir, queuedDir;
+    bool                dirChangedThisTick, hasQueuedDir;
+    bool                running, gameOver, gameWon, paused, restartRequested;
+    int                 score, foodCount;
+    std::vector<int8_t> foodAt;         // per cell: -1 none, else the FoodKind
+    Rng                 rng;
+};
+
+static bool refMask(const uint64_t *m, int c) { return (m[c >> 6] >> (c & 63)) & 1; }
+
+// placeFood's draws over a snapshot list of free cells
+static int refPlace(RefGame &r, const uint64_t *allow, const uint64_t *deny, int k) {
+    int total = r.boardWidth * r.boardHeight, words = (total + 63) / 64;
+    std::vector<char> body(total, 0);
+    for (const Point &p : r.snake) body[p.y * r.boardWidth + p.x] = 1;
+    auto isFree = [&](int c) {
+        return (!allow || refMask(allow, c)) && !(deny && refMask(deny, c)) && !body[c] && r.foodAt[c] < 0;
+    };
+    auto add = [&](int c) {
+        r.foodAt[c] = FOOD_APPLE;
+        if (r.foodTarget > 1 && r.rng.below(FOOD_GOLD_ODDS) == 0) r.foodAt[c] = FOOD_GOLD;
+        r.foodCount++;
+    };
+
+    int placed = 0;
+    if (words > FOOD_SCAN_WORDS) {
+        for (int t = k * FOOD_SAMPLE_TRIES; placed < k && t > 0; t--) {
+            int c = r.rng.below(total);
+            if (isFree(c)) { add(c); placed++; }
+        }
+        if (placed == k) return placed;
+    }
+
+    std::vector<int> freeCells;
+    for (int c = 0; c < total; c++) if (isFree(c)) freeCells.push_back(c);
+    int n = (int)freeCells.size(), need = std::min(k - placed, n);
+    if (need <= 0) return placed;
+
+    std::vector<int> ranks;
+    if (need == 1) {
+        ranks.push_back(r.rng.below(n));
+    } else if (need * 4 > n) {
+        for (int i = 0, left = need; left > 0; i++)
+            if (r.rng.below(n - i) < left) { ranks.push_back(i); left--; }
+    } else {
+        std::set<int> drawn;
+        while ((int)drawn.size() < need) {
+            // a round draws the shortfall, then drops duplicates
+            for (int i = (int)drawn.size(); i < need; i++) ranks.push_back(r.rng.below(n));
+            drawn.insert(ranks.begin(), ranks.end());
+            ranks.assign(drawn.begin(), drawn.end());
+        }
+    }
+    for (int rank : ranks) add(freeCells[rank]);
+    return placed + need;
+}
+
+static bool refSpawn(RefGame &r) {
+    int want = r.foodTarget - r.foodCount;
+    if (want > 0) {
+        const Level *lv = r.level;
+        int placed = 0;
+        if (lv && lv->spawnCells) placed = refPlace(r, lv->spawn, nullptr, want);
+        if (placed < want) refPlace(r, nullptr, lv ? lv->noFood : nullptr, want - placed);
+    }
+    return r.foodCount > 0;
+}
+
+static void refReset(RefGame &r, uint64_t seed) {
+    r.snake.clear();
+    int cx = r.level ? r.level->start.x : r.boardWidth / 2;
+    int cy = r.level ? r.level->start.y : r.boardHeight / 2;
+    for (int i = 0; i < 3; i++) r.snake.push_back({cx - i, cy});
+    r.dir = r.nextDir = r.queuedDir = RIGHT;
+    r.dirChangedThisTick = r.hasQueuedDir = false;
+    r.running = true;
+    r.gameOver = r.gameWon = r.paused = r.restartRequested = false;
+    r.score = 0;
+    r.rng.seed(seed);
+    r.foodTarget = std::max(1, std::min(r.foodTarget, r.boardWidth * r.boardHeight / 4));
+    r.foodAt.assign((size_t)r.boardWidth * r.boardHeight, -1);
+    r.foodCount = 0;
+    refSpawn(r);
+}
+
+static void refUpdate(RefGame &r) {
+    if (r.paused) return;
+    r.dir = r.nextDir;
+    Point nh = r.snake.front();
+    switch (r.dir) {
+        case UP: nh.y--; break; case DOWN: nh.y++; break;
+        case LEFT: nh.x--; break; case RIGHT: nh.x++; break;
+    }
+    if (nh.x < 0 || nh.x >= r.boardWidth || nh.y < 0 || nh.y >= r.boardHeight) {
+        r.gameOver = true; r.running = false; return;
+    }
+    int cell = nh.y * r.boardWidth + nh.x;
+    if (const Level *lv = r.level) {
+        for (int k = 0; k < lv->numPortals; k++)
+            if (lv->portals[k].from == (uint32_t)cell) {
+                cell = (int)lv->portals[k].to;
+                nh = { cell % r.boardWidth, cell / r.boardWidth };
+                break;
+            }
+    }
+
+    // the tail moves away this tick unless the snake grows
+    bool growing = r.foodAt[cell] >= 0;
+    bool hit = r.level && refMask(r.level->wall, cell);
+    for (size_t i = 0; i + (growing ? 0 : 1) < r.snake.size(); i++) hit |= r.snake[i] == nh;
+    if (hit) { r.gameOver = true; r.running = false; return; }
+
+    r.snake.push_front(nh);
+    if (growing) {
+        r.score += FOOD_SCORE[r.foodAt[cell]];
+        r.foodAt[cell] = -1;
+        r.foodCount--;
+        if (r.foodTarget - r.foodCount >= std::max(1, r.foodTarget / FOOD_BATCH_DIV) && !refSpawn(r)) {
+            r.gameWon = true; r.running = false;
+        }
+    } else {
+        r.snake.pop_back();
+    }
+}
+
+// ─── Fuzz Driver ────────────────────────────────────────────
+struct DiffFuzzer {
+    BufferArena  arena;             // declared first: outlives the state
+    GameState    game;
+    RefGame      ref;
+    uint64_t     seed = 0;
+    long         ticks = 0, games = 0, won = 0;
+    int          lastScore = -1;
+    long         lastGames = -1;
+    char         why[160];
+
+    // Header -> both engines at tick 0; false if data is too short
+    bool begin(const uint8_t *data, size_t size, const Level *level = nullptr) {
+        if (size < (size_t)FUZZ_HEADER) return false;
+        auto dim = [](uint8_t b) { return b < 240 ? 4 + b % 28 : 64 + (b - 240) * 16; };
+        int w = level ? level->width : dim(data[0]), h = level ? level->height : dim(data[1]);
+        int food = data[2] < 128 ? 1 : data[2] - 126;
+        memcpy(&seed, data + 3, 8);
+        if (!arena.base && initBufferArena(arena, gameArenaBytes(w, h, std::min(food, w * h / 4)), HUGE_NONE))
+            game.attachArena(&arena);
+        game.boardWidth = w; game.boardHeight = h;
+        game.level = level; game.foodTarget = food;
+        ref.boardWidth = w; ref.boardHeight = h;
+        ref.level = level; ref.foodTarget = food;
+        restart();
+        return true;
+    }
+
+    void restart() {
+        uint64_t s = mix64(seed + (uint64_t)ticks);
+        resetGame(game, s);
+        refReset(ref, s);
+        games++;
+    }
+
+    // One tick through both engines; the first mismatch, or null
+    const char* step(uint8_t b) {
+        if (!game.running) restart();
+        if ((b & 0xC0) == 0x40) { handleGameKey(game, 'p'); handleGameKey(ref, 'p'); }
+        static const char KEY[4] = { 'w', 's', 'a', 'd' };
+        if (b & 0x04) { handleGameKey(game, KEY[b & 3]); handleGameKey(ref, KEY[b & 3]); }
+        if (b & 0x20) { handleGameKey(game, KEY[(b >> 3) & 3]); handleGameKey(ref, KEY[(b >> 3) & 3]); }
+        updateGame(game);
+        refUpdate(ref);
+        if (game.running) applyQueuedDirection(game);
+        if (ref.running) applyQueuedDirection(ref);
+        ticks++;
+        if (game.gameWon) won++;
+        return compare();
+    }
+
+    const char* compare() {
+        const GameState &g = game;
+        const RefGame &r = ref;
+#define FUZZ_FIELD(f) \
+        if (g.f != r.f) { snprintf(why, sizeof(why), #f ": %d vs reference %d", (int)g.f, (int)r.f); return why; }
+        FUZZ_FIELD(running) FUZZ_FIELD(gameOver) FUZZ_FIELD(gameWon) FUZZ_FIELD(paused)
+        FUZZ_FIELD(score) FUZZ_FIELD(foodCount) FUZZ_FIELD(foodTarget)
+        FUZZ_FIELD(dir) FUZZ_FIELD(nextDir) FUZZ_FIELD(dirChangedThisTick) FUZZ_FIELD(hasQueuedDir)
+#undef FUZZ_FIELD
+        if (g.snake != r.snake) return "snake body differs from reference";
+        if (g.rng.s != r.rng.s) return "rng state differs from reference (different draws)";
+
+        int total = g.boardWidth * g.boardHeight, occCount = 0, listed = 0;
+        std::vector<char> seen(total, 0);
+        for (const Point &p : g.snake)
+            if (!occTest(g, p)) { snprintf(why, sizeof(why), "body cell %d,%d missing from occ", p.x, p.y); return why; }
+        for (uint64_t w : g.occ) occCount += __builtin_popcountll(w);
+        if (occCount != (int)g.snake.size()) return "occ bit count differs from body length";
+        for (uint32_t c : g.food) {
+            if (!bitTest(g.foodMap, (int)c)) continue;
+            if (seen[c]++) { snprintf(why, sizeof(why), "food cell %u listed twice", c); return why; }
+            listed++;
+        }
+        if (listed != g.foodCount) return "food list differs from foodCount";
+        // food only moves on an eat (the score changes) or a restart
+        if (total > 4096 && g.score == lastScore && games == lastGames) return nullptr;
+        lastScore = g.score; lastGames = games;
+        for (int c = 0; c < total; c++) {
+            bool has = bitTest(g.foodMap, c), gold = bitTest(g.goldMap, c);
+            if (has != (r.foodAt[c] >= 0) || (has && gold != (r.foodAt[c] == FOOD_GOLD)) || (gold && !has)) {
+                snprintf(why, sizeof(why), "food at %d,%d: %s vs reference %d", c % g.boardWidth,
+                         c / g.boardWidth, !has ? "none" : gold ? "gold" : "apple", r.foodAt[c]);
+                return why;
+            }
+        }
+        return nullptr;
+    }
+};
+
+// Whole input; prints and returns false on the first mismatch
+static bool fuzzInput(const uint8_t *data, size_t size, const char* name, const Level *level = nullptr) {
+    DiffFuzzer f;
+    if (!f.begin(data, size, level)) return true;
+    for (size_t i = FUZZ_HEADER; i < size; i++) {
+        if (const char* d = f.step(data[i])) {
+            fprintf(stderr, "vsnake fuzz: %s: tick %ld (byte %zu, game %ld): %s\n", name, f.ticks, i, f.games, d);
+            return false;
+        }
+    }
+    return true;
+}
+
+#ifdef VSNAKE_LIBFUZZER
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    if (!fuzzInput(data, size, "input")) abort();
+    return 0;
+}
+#endif
+
+static bool saveFuzzInput(const std::string &path, const std::vector<uint8_t> &in) {
+    FILE* f = fopen(path.c_str(), "wb");
+    if (!f) { perror(path.c_str()); return false; }
+    fwrite(in.data(), 1, in.size(), f);
+    return fclose(f) == 0;
+}
+
+// Byte for a greedy player: toward the nearest food, never straight
+// into a wall or the body when a safe move exists
+static uint8_t fuzzGreedyByte(const GameState &g, Rng &rng) {
+    Point h = g.snake.front();
+    int best = -1, bestDist = INT32_MAX;
+    for (int d = 0; d < 4; d++) {
+        if (isOpposite((Direction)d, g.dir)) continue;
+        Point p = h;
+        switch (d) { case UP: p.y--; break; case DOWN: p.y++; break; case LEFT: p.x--; break; default: p.x++; }
+        if (p.x < 0 || p.x >= g.boardWidth || p.y < 0 || p.y >= g.boardHeight) continue;
+        if (blockedTest(g, p) && !(p == g.snake.back())) continue;
+        int dist = INT32_MAX - 1;
+        for (uint32_t c : g.food)
+            if (bitTest(g.foodMap, (int)c))
+                dist = std::min(dist, std::abs((int)(c % g.boardWidth) - p.x) + std::abs((int)(c / g.boardWidth) - p.y));
+        dist = dist * 4 + rng.below(4);
+        if (dist < bestDist) { bestDist = dist; best = d; }
+    }
+    return best < 0 ? 0 : (uint8_t)(0x04 | best);
+}
+
+static uint8_t fuzzRandomByte(Rng &rng) {
+    uint8_t b = 0;
+    if (rng.below(3) == 0)  b |= 0x04 | rng.below(4);
+    if (rng.below(10) == 0) b |= 0x20 | (rng.below(4) << 3);
+    if (rng.below(60) == 0) b |= 0x40;
+    return b;
+}
+
+// Random headers, then a random or greedy player per run
+static int runFuzz(int runs, int maxTicks, uint64_t seed, const Level *level) {
+    Rng rng;
+    rng.seed(seed);
+    long ticks = 0, games = 0, won = 0;
+    long long t0 = nowMicros();
+    for (int run = 0; run < runs && !g_interrupted; run++) {
+        std::vector<uint8_t> in(FUZZ_HEADER);
+        for (auto &b : in) b = (uint8_t)rng.next();
+        if (rng.below(4)) { in[0] = (uint8_t)rng.below(240); in[1] = (uint8_t)rng.below(240); }
+        bool greedy = rng.below(2) == 0;
+        DiffFuzzer f;
+        f.begin(in.data(), in.size(), level);
+        const char* diff = nullptr;
+        for (int t = 0; t < maxTicks && !diff; t++) {
+            if (!f.game.running) f.restart();
+            uint8_t b = greedy ? fuzzGreedyByte(f.game, rng) : fuzzRandomByte(rng);
+            in.push_back(b);
+            diff = f.step(b);
+        }
+        ticks += f.ticks; games += f.games; won += f.won;
+        if (diff) {
+            char path[64];
+            snprintf(path, sizeof(path), "fuzz-fail-%llu-%d.bin", (unsigned long long)seed, run);
+            fprintf(stderr, "vsnake fuzz: run %d tick %ld: %s\n", run, f.ticks, diff);
+            if (saveFuzzInput(path, in))
+                fprintf(stderr, "vsnake fuzz: input saved; replay with --fuzz-replay %s\n", path);
+            return 1;
+        }
+    }
+    double secs = (nowMicros() - t0) / 1e6;
+    printf("%d runs, %ld games (%ld won), %ld ticks, no differences  (%.0f ticks/s)\n",
+           runs, games, won, ticks, secs > 0 ? ticks / secs : 0.0);
+    return 0;
+}
+
+static int runFuzzReplay(const std::vector<std::string> &paths, const Level *level) {
+    std::vector<std::string> files;
+    for (const auto &p : paths) {
+        struct stat st;
+        if (stat(p.c_str(), &st) != 0) { perror(p.c_str()); return 1; }
+        if (!S_ISDIR(st.st_mode)) { files.push_back(p); continue; }
+        DIR* d = opendir(p.c_str());
+        if (!d) { perror(p.c_str()); return 1; }
+        while (struct dirent *e = readdir(d))
+            if (e->d_name[0] != '.') files.push_back(p + "/" + e->d_name);
+        closedir(d);
+        std::sort(files.begin(), files.end());
+    }
+    int bad = 0;
+    for (const auto &f : files) {
+        std::ifstream in(f.c_str(), std::ios::binary);
+        std::vector<uint8_t> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        if (!fuzzInput(data.data(), data.size(), f.c_str(), level)) bad++;
+    }
+    printf("%zu inputs, %d with differences\n", files.size(), bad);
+    return bad ? 1 : 0;
+}
+
+// Games that fill the whole board: the head follows a Hamiltonian
+// cycle (serpentine rows, column 0 as the way back), so it can never
+// trap itself.  h must be even and w at least 6.
+static std::vector<uint8_t> endgameInput(int w, int h, int food, uint64_t seed) {
+    std::vector<uint8_t> in(FUZZ_HEADER);
+    in[0] = (uint8_t)(w - 4); in[1] = (uint8_t)(h - 4);
+    in[2] = (uint8_t)(food <= 1 ? 0 : food + 126);
+    memcpy(&in[3], &seed, 8);
+
+    std::vector<int> order;
+    for (int y = 0; y < h; y++)
+        for (int i = 1; i < w; i++) order.push_back(y * w + ((y & 1) ? w - i : i));
+    for (int y = h - 1; y >= 0; y--) order.push_back(y * w);
+    std::vector<int> next(w * h);
+    int n = (int)order.size();
+    // the snake starts heading right along row h/2: orient the cycle to match
+    bool reverse = (h / 2) & 1;
+    for (int i = 0; i < n; i++) {
+        if (reverse) next[order[(i + 1) % n]] = order[i];
+        else         next[order[i]] = order[(i + 1) % n];
+    }
+
+    DiffFuzzer f;
+    f.begin(in.data(), in.size());
+    while (f.game.running && f.ticks < 4LL * w * h * w * h) {
+        Point hd = f.game.snake.front();
+        int to = next[hd.y * w + hd.x], dx = to % w - hd.x, dy = to / w - hd.y;
+        uint8_t b = 0x04 | (dy < 0 ? UP : dy > 0 ? DOWN : dx < 0 ? LEFT : RIGHT);
+        in.push_back(b);
+        if (f.step(b)) break;
+    }
+    return in;
+}
+
+static int writeFuzzCorpus(const std::string &dir) {
+    if (!mkdirRecursive(dir)) { perror(dir.c_str()); return 1; }
+    static const int SIZES[][2] = { {6, 4}, {8, 6}, {8, 8}, {10, 6}, {12, 10}, {16, 8} };
+    int files = 0;
+    size_t bytes = 0;
+    for (auto &s : SIZES) {
+        for (int food : { 1, 3, 8 }) {
+            uint64_t seed = mix64((uint64_t)(s[0] * 1000 + s[1] * 10 + food));
+            std::vector<uint8_t> in = endgameInput(s[0], s[1], food, seed);
+            char name[64];
+            snprintf(name, sizeof(name), "/endgame-%dx%d-f%d", s[0], s[1], food);
+            if (!saveFuzzInput(dir + name, in)) return 1;
+            files++;
+            bytes += in.size();
+        }
+    }
+    printf("%d inputs, %zu bytes in %s\n", files, bytes, dir.c_str());
+    return 0;
+}
+
+// ===== SELF-PLAY DATASETS ==================================
+//
+//   vsnake --selfplay DIR [--threads N] [--steps N] [--size WxH]
+//   vsnake --selfplay-info FILE
+//
+// Bots play headless games and every step becomes one row of
+// (state, action, reward).  Each thread owns one game and one file,
+// DIR/selfplay-<thread>.vst, so writers share nothing.
+//
+// File layout (little-endian, memory-mappable):
+//
+//   TrajFileHeader, then TrajColumn[numColumns]
+//   chunks      each starts on a TRAJ_ALIGN boundary and holds up to
+//               chunkRows rows column by column: column c sits at
+//               the sum of align64(rows * width) over columns < c
+//   index       TrajChunkIndex[numChunks]
+//   TrajTrailer (last 32 bytes): where the index starts
+//
+// Every column is fixed width.  The observation is bit-packed:
+// "body" is the occupancy bitmap and "food" the food bitmap, both
+// ceil(w*h/64) words with bit y*w+x.  Rows are plain memcpys of the
+// bitmaps and are written with one writev per chunk, so generation
+// costs far less than the I/O.  Rows hold the state before the action;
+// reward is the score gained, or TRAJ_DEATH_REWARD on the move that
+// kills.
+//
+
+static const char TRAJ_MAGIC[8]         = { 'V', 'S', 'N', 'T', 'R', 'A', 'J', 1 };
+static const int  TRAJ_ALIGN            = 4096;
+static const int  TRAJ_CHUNK_ROWS       = 4096;
+static const int  TRAJ_DEATH_REWARD     = -100;
+static const int  TRAJ_IDLE_LIMIT       = 8;     // x cells without eating: episode truncated
+static const int  SELFPLAY_EXPLORE      = 20;    // 1 in N moves is a random safe one
+
+enum TrajDone { TRAJ_RUNNING, TRAJ_DIED, TRAJ_WON, TRAJ_TRUNCATED };
+
+enum TrajColumnId {
+    TC_EPISODE, TC_STEP, TC_HEAD, TC_DIR, TC_ACTION, TC_REWARD, TC_DONE, TC_BODY, TC_FOOD,
+    TC_COUNT
+};
+
+static const char* TRAJ_COLUMN_NAME[TC_COUNT] = {
+    "episode", "step", "head", "dir", "action", "reward", "done", "body", "food"
+};
+
+struct TrajFileHeader {
+    char     magic[8];
+    uint32_t boardWidth, boardHeight;
+    uint32_t words;                 // per bitmap column
+    uint32_t numColumns;
+    uint32_t chunkRows;             // most rows in one chunk
+    uint32_t foodTarget;
+    uint64_t seed;
+};
+
+struct TrajColumn {
+    char     name[16];
+    uint32_t width;                 // bytes per row
+    uint32_t reserved;
+};
+
+struct TrajChunkIndex {
+    uint64_t offset;
+    uint32_t rows;
+    uint32_t firstEpisode;
+};
+
+struct TrajTrailer {
+    uint64_t indexOffset;
+    uint32_t numChunks;
+    uint32_t reserved;
+    uint64_t totalRows;
+    char     magic[8];
+};
+
+static size_t trajAlign(size_t n, size_t a) { return (n + a - 1) & ~(a - 1); }
+
+// Byte offset of each column inside a chunk of `rows` rows; returns the chunk size
+static size_t trajColumnOffsets(const uint32_t *width, int rows, size_t *off) {
+    size_t at = 0;
+    for (int c = 0; c < TC_COUNT; c++) {
+        off[c] = at;
+        at += trajAlign((size_t)rows * width[c], 64);
+    }
+    return at;
+}
+
+struct TrajWriter {
+    int                         fd = -1;
+    uint32_t                    width[TC_COUNT];
+    size_t                      off[TC_COUNT];      // for a full chunk
+    std::vector<uint8_t>        chunk;
+    int                         rows = 0;
+    uint32_t                    firstEpisode = 0;
+    uint64_t                    fileOff = 0, totalRows = 0;
+    std::vector<TrajChunkIndex> index;
+    long long                   writeUs = 0;
+    bool                        failed = false;
+
+    uint8_t *cell(int c) { return &chunk[off[c] + (size_t)rows * width[c]]; }
+};
+
+static bool trajWriteAll(TrajWriter &w, struct iovec *iov, int n, size_t total) {
+    long long t0 = nowMicros();
+    while (n > 0 && !w.failed) {
+        ssize_t r = writev(w.fd, iov, n);
+        if (r < 0) { if (errno == EINTR) continue; w.failed = true; break; }
+        size_t done = (size_t)r;
+        for (; n > 0 && done >= iov->iov_len; n--) done -= (iov++)->iov_len;
+        if (n > 0) { iov->iov_base = (char*)iov->iov_base + done; iov->iov_len -= done; }
+    }
+    w.writeUs += nowMicros() - t0;
+    if (!w.failed) w.fileOff += total;
+    return !w.failed;
+}
+
+static bool openTrajWriter(TrajWriter &w, const std::string &path, const GameState &g, uint64_t seed) {
+    w.fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (w.fd < 0) return false;
+    uint32_t words = (uint32_t)((g.boardWidth * g.boardHeight + 63) / 64);
+    const uint32_t widths[TC_COUNT] = { 4, 4, 4, 1, 1, 2, 1, words * 8, words * 8 };
+    memcpy(w.width, widths, sizeof(widths));
+    w.chunk.assign(trajColumnOffsets(w.width, TRAJ_CHUNK_ROWS, w.off), 0);
+
+    std::vector<uint8_t> head(TRAJ_ALIGN, 0);
+    TrajFileHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, TRAJ_MAGIC, 8);
+    h.boardWidth = (uint32_t)g.boardWidth; h.boardHeight = (uint32_t)g.boardHeight;
+    h.words = words; h.numColumns = TC_COUNT; h.chunkRows = TRAJ_CHUNK_ROWS;
+    h.foodTarget = (uint32_t)g.foodTarget; h.seed = seed;
+    memcpy(head.data(), &h, sizeof(h));
+    for (int c = 0; c < TC_COUNT; c++) {
+        TrajColumn col;
+        memset(&col, 0, sizeof(col));
+        snprintf(col.name, sizeof(col.name), "%s", TRAJ_COLUMN_NAME[c]);
+        col.width = w.width[c];
+        memcpy(head.data() + sizeof(h) + c * sizeof(col), &col, sizeof(col));
+    }
+    struct iovec iov = { head.data(), head.size() };
+    if (trajWriteAll(w, &iov, 1, head.size())) return true;
+    int e = errno;                  // for the caller's perror
+    close(w.fd);
+    w.fd = -1;
+    errno = e;
+    return false;
+}
+
+// Columns of the buffered rows, packed for their count, in one writev
+static bool flushTrajChunk(TrajWriter &w) {
+    if (w.rows == 0) return true;
+    static const uint8_t ZERO[TRAJ_ALIGN] = {};
+    size_t off[TC_COUNT];
+    size_t bytes = trajColumnOffsets(w.width, w.rows, off), padded = trajAlign(bytes, TRAJ_ALIGN);
+    struct iovec iov[TC_COUNT * 2 + 1];
+    int n = 0;
+    for (int c = 0; c < TC_COUNT; c++) {
+        size_t len = (size_t)w.rows * w.width[c];
+        iov[n++] = { &w.chunk[w.off[c]], len };
+        size_t pad = trajAlign(len, 64) - len;
+        if (pad) iov[n++] = { (void*)ZERO, pad };
+    }
+    if (padded > bytes) iov[n++] = { (void*)ZERO, padded - bytes };
+    w.index.push_back({ w.fileOff, (uint32_t)w.rows, w.firstEpisode });
+    w.totalRows += (uint64_t)w.rows;
+    w.rows = 0;
+    return trajWriteAll(w, iov, n, padded);
+}
+
+static bool closeTrajWriter(TrajWriter &w) {
+    bool ok = flushTrajChunk(w);
+    TrajTrailer t;
+    memset(&t, 0, sizeof(t));
+    t.indexOffset = w.fileOff;
+    t.numChunks = (uint32_t)w.index.size();
+    t.totalRows = w.totalRows;
+    memcpy(t.magic, TRAJ_MAGIC, 8);
+    struct iovec iov[2] = { { w.index.data(), w.index.size() * sizeof(TrajChunkIndex) }, { &t, sizeof(t) } };
+    ok = ok && trajWriteAll(w, iov, 2, iov[0].iov_len + iov[1].iov_len);
+    ok = close(w.fd) == 0 && ok;
+    w.fd = -1;
+    return ok;
+}
+
+// Greedy with a little exploration: the safe move toward the nearest
+// food, preferring cells with free neighbours
+static Direction selfPlayAction(const GameState &g, Rng &rng) {
+    static const Direction ALL[4] = { UP, DOWN, LEFT, RIGHT };
+    Point head = g.snake.front();
+    auto open = [&](Point p) {
+        return p.x >= 0 && p.x < g.boardWidth && p.y >= 0 && p.y < g.boardHeight &&
+               (!blockedTest(g, p) || p == g.snake.back());
+    };
+    int nearest = INT32_MAX;
+    Point target = head;
+    for (uint32_t c : g.food) {
+        if (!bitTest(g.foodMap, (int)c)) continue;
+        Point f = { (int)(c % g.boardWidth), (int)(c / g.boardWidth) };
+        int d = std::abs(f.x - head.x) + std::abs(f.y - head.y);
+        if (d < nearest) { nearest = d; target = f; }
+    }
+    bool explore = rng.below(SELFPLAY_EXPLORE) == 0;
+    int bestScore = INT32_MIN;
+    Direction best = g.dir;
+    for (Direction d : ALL) {
+        if (isOpposite(d, g.dir)) continue;
+        Point p = stepPoint(head, d);
+        int sc = 0;
+        if (!open(p)) sc -= 100000;
+        else {
+            for (Direction d2 : ALL) sc += open(stepPoint(p, d2)) ? 50 : 0;
+            sc -= (std::abs(p.x - target.x) + std::abs(p.y - target.y)) * 10;
+        }
+        sc += explore ? rng.below(1000) : rng.below(5);
+        if (sc > bestScore) { bestScore = sc; best = d; }
+    }
+    return best;
+}
+
+struct SelfPlayStats {
+    uint64_t  rows = 0, episodes = 0, bytes = 0;
+    long long busyUs = 0, writeUs = 0;
+    bool      ok = true;
+};
+
+static void runSelfPlayThread(const std::string &path, int w, int h, int foodTarget,
+                              uint64_t seed, uint64_t steps, SelfPlayStats &st) {
+    long long t0 = nowMicros();
+    BufferArena arena;              // declared first: outlives g's buffers
+    GameState g;
+    g.boardWidth = w; g.boardHeight = h; g.foodTarget = foodTarget;
+    if (initBufferArena(arena, gameArenaBytes(w, h, std::min(foodTarget, w * h / 4)), HUGE_NONE))
+        g.attachArena(&arena);
+    Rng rng;
+    rng.seed(seed);
+    resetGame(g, mix64(seed));
+
+    TrajWriter tw;
+    if (!openTrajWriter(tw, path, g, seed)) { perror(path.c_str()); st.ok = false; return; }
+    size_t mapBytes = tw.width[TC_BODY];
+    uint32_t episode = 0, step = 0, idle = 0;
+    for (uint64_t i = 0; i < steps && !tw.failed && !g_interrupted; i++) {
+        if (tw.rows == 0) tw.firstEpisode = episode;
+        Direction a = selfPlayAction(g, rng);
+        Point hd = g.snake.front();
+        uint32_t cell = (uint32_t)(hd.y * w + hd.x);
+        memcpy(tw.cell(TC_EPISODE), &episode, 4);
+        memcpy(tw.cell(TC_STEP), &step, 4);
+        memcpy(tw.cell(TC_HEAD), &cell, 4);
+        *tw.cell(TC_DIR) = (uint8_t)g.dir;
+        *tw.cell(TC_ACTION) = (uint8_t)a;
+        memcpy(tw.cell(TC_BODY), g.occ.data(), mapBytes);
+        memcpy(tw.cell(TC_FOOD), g.foodMap.data(), mapBytes);
+
+        int before = g.score;
+        tryChangeDirection(g, a);
+        updateGame(g);
+        applyQueuedDirection(g);
+        int16_t reward = (int16_t)(g.gameOver ? TRAJ_DEATH_REWARD : g.score - before);
+        idle = g.score != before ? 0 : idle + 1;
+        uint8_t done = g.gameOver ? TRAJ_DIED : g.gameWon ? TRAJ_WON
+                     : idle > (uint32_t)(TRAJ_IDLE_LIMIT * w * h) ? TRAJ_TRUNCATED : TRAJ_RUNNING;
+        memcpy(tw.cell(TC_REWARD), &reward, 2);
+        *tw.cell(TC_DONE) = done;
+        if (++tw.rows == TRAJ_CHUNK_ROWS) flushTrajChunk(tw);
+
+        step++;
+        if (done != TRAJ_RUNNING) {
+            episode++; step = 0; idle = 0;
+            resetGame(g, ((uint64_t)rng.next() << 32) | rng.next());
+        }
+    }
+    st.ok = closeTrajWriter(tw);
+    if (!st.ok) perror(path.c_str());
+    st.rows = tw.totalRows;
+    st.episodes = episode;
+    st.bytes = tw.fileOff;
+    st.writeUs = tw.writeUs;
+    st.busyUs = nowMicros() - t0;
+}
+
+static int runSelfPlay(const std::string &dir, int threads, uint64_t steps, int w, int h, int foodTarget) {
+    if (!mkdirRecursive(dir)) { perror(dir.c_str()); return 1; }
+    threads = std::max(1, threads);
+    std::vector<SelfPlayStats> stats(threads);
+    std::vector<std::thread> pool;
+    uint64_t seed = freshSeed();
+    long long t0 = nowMicros();
+    for (int t = 0; t < threads; t++) {
+        char name[64];
+        snprintf(name, sizeof(name), "/selfplay-%d.vst", t);
+        uint64_t n = steps / threads + ((uint64_t)t < steps % threads ? 1 : 0);
+        pool.emplace_back(runSelfPlayThread, dir + name, w, h, foodTarget, mix64(seed + t), n, std::ref(stats[t]));
+    }
+    for (auto &th : pool) th.join();
+    double secs = (nowMicros() - t0) / 1e6;
+
+    SelfPlayStats sum;
+    for (auto &s : stats) {
+        sum.rows += s.rows; sum.episodes += s.episodes; sum.bytes += s.bytes;
+        sum.busyUs += s.busyUs; sum.writeUs += s.writeUs; sum.ok = sum.ok && s.ok;
+    }
+    printf("%d files in %s: %llu rows, %llu episodes, %.1f MB\n", threads, dir.c_str(),
+           (unsigned long long)sum.rows, (unsigned long long)sum.episodes, sum.bytes / 1e6);
+    printf("%.2f s  %.0f rows/s  %.1f MB/s  %.0f%% of thread time in write\n", secs,
+           secs > 0 ? sum.rows / secs : 0.0, secs > 0 ? sum.bytes / 1e6 / secs : 0.0,
+           sum.busyUs ? 100.0 * sum.writeUs / sum.busyUs : 0.0);
+    return sum.ok ? 0 : 1;
+}
+
+// Maps a file read-only and checks it end to end through the index
+static int runSelfPlayInfo(const char* path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) { perror(path); return 1; }
+    size_t size = (size_t)st.st_size;
+    void* map = size ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (map == MAP_FAILED || size < TRAJ_ALIGN + sizeof(TrajTrailer)) {
+        if (map != MAP_FAILED) munmap(map, size);
+        fprintf(stderr, "vsnake: %s: not a trajectory file\n", path);
+        return 1;
+    }
+    const uint8_t *base = (const uint8_t*)map;
+    TrajFileHeader h;
+    TrajTrailer t;
+    memcpy(&h, base, sizeof(h));
+    memcpy(&t, base + size - sizeof(t), sizeof(t));
+    const char* err = nullptr;
+    if (memcmp(h.magic, TRAJ_MAGIC, 8) || memcmp(t.magic, TRAJ_MAGIC, 8) || h.numColumns != TC_COUNT)
+        err = "bad magic or column count";
+    else if (h.words != ((uint64_t)h.boardWidth * h.boardHeight + 63) / 64 || h.words == 0 ||
+             h.words > UINT32_MAX / 8 || (uint64_t)h.words * 8 > size)
+        err = "bitmap size does not match the board";
+    else if (t.indexOffset < TRAJ_ALIGN || t.indexOffset > size ||
+             t.numChunks > (size - t.indexOffset) / sizeof(TrajChunkIndex) ||
+             t.indexOffset + (uint64_t)t.numChunks * sizeof(TrajChunkIndex) + sizeof(t) != size)
+        err = "index does not end at the trailer";
+
+    // the reader below assumes the writer's widths (reward is 2 bytes,
+    // the bitmaps h.words words), so any other table is rejected
+    const uint32_t want[TC_COUNT] = { 4, 4, 4, 1, 1, 2, 1, h.words * 8, h.words * 8 };
+    uint32_t width[TC_COUNT];
+    uint64_t rowBytes = 0;
+    for (int c = 0; c < TC_COUNT && !err; c++) {
+        TrajColumn col;
+        memcpy(&col, base + sizeof(h) + c * sizeof(col), sizeof(col));
+        width[c] = col.width;
+        rowBytes += col.width;
+        if (col.width != want[c]) err = "unexpected column width";
+    }
+    uint64_t rows = 0, deaths = 0, wins = 0, eats = 0, bodyBits = 0;
+    for (uint32_t k = 0; k < t.numChunks && !err; k++) {
+        TrajChunkIndex ix;
+        memcpy(&ix, base + t.indexOffset + k * sizeof(ix), sizeof(ix));
+        size_t off[TC_COUNT];
+        if (ix.rows == 0 || ix.rows > h.chunkRows || ix.offset < TRAJ_ALIGN || ix.offset % TRAJ_ALIGN ||
+            ix.offset > t.indexOffset || ix.rows > (t.indexOffset - ix.offset) / rowBytes ||
+            ix.offset + trajColumnOffsets(width, (int)ix.rows, off) > t.indexOffset) {
+            err = "chunk outside the data area";
+            break;
+        }
+        const uint8_t *chunk = base + ix.offset;
+        for (uint32_t r = 0; r < ix.rows; r++) {
+            uint8_t done = chunk[off[TC_DONE] + r];
+            int16_t reward;
+            memcpy(&reward, chunk + off[TC_REWARD] + r * 2, 2);
+            deaths += done == TRAJ_DIED;
+            wins += done == TRAJ_WON;
+            eats += reward > 0;
+        }
+        const uint64_t *body = (const uint64_t*)(chunk + off[TC_BODY]);
+        for (size_t i = 0; i < (size_t)ix.rows * h.words; i++) bodyBits += __builtin_popcountll(body[i]);
+        rows += ix.rows;
+    }
+    if (!err && rows != t.totalRows) err = "row count differs from the trailer";
+    if (err) fprintf(stderr, "vsnake: %s: %s\n", path, err);
+    else
+        printf("%s: %ux%u board, %u chunks, %llu rows, %llu deaths, %llu wins, %llu eats, "
+               "mean length %.1f, %.1f MB\n", path, h.boardWidth, h.boardHeight, t.numChunks,
+               (unsigned long long)rows, (unsigned long long)deaths, (unsigned long long)wins,
+               (unsigned long long)eats, rows ? (double)bodyBits / rows : 0.0, size / 1e6);
+    munmap(map, size);
+    return err ? 1 : 0;
+}
+
+// ─── Command Line ───────────────────────────────────────────
+static bool hasArg(int argc, char** argv, const char* name) {
+    for (int i = 1; i < argc; i++) if (strcmp(argv[i], name) == 0) return true;
+    return false;
+}
+
+static const char* argValue(int argc, char** argv, const char* name) {
+    for (int i = 1; i + 1 < argc; i++) if (strcmp(argv[i], name) == 0) return argv[i + 1];
+    return nullptr;
+}
+
+static int argInt(int argc, char** argv, const char* name, int def) {
+    const char* v = argValue(argc, argv, name);
+    return v ? std::atoi(v) : def;
+}
+
+// "WxH" -> w, h (left untouched when malformed)
+static void argSize(int argc, char** argv, const char* name, int &w, int &h) {
+    const char* v = argValue(argc, argv, name);
+    int pw, ph;
+    if (v && sscanf(v, "%dx%d", &pw, &ph) == 2 && pw > 0 && ph > 0) { w = pw; h = ph; }
+}
+
+static OutputMode argOutputMode(int argc, char** argv, OutputMode def) {
+    const char* v = argValue(argc, argv, "--output");
+    if (!v) return def;
+    for (int m = OUT_WRITE; m <= OUT_URING; m++)
+        if (strcmp(v, OUTPUT_MODE_NAME[m]) == 0 || (m == OUT_URING && strcmp(v, "uring") == 0))
+            return (OutputMode)m;
+    fprintf(stderr, "vsnake: unknown --output %s, using %s\n", v, OUTPUT_MODE_NAME[def]);
+    return def;
+}
+
+static const char* programName(const char* argv0) {
+    const char* slash = strrchr(argv0, '/');
+    return slash ? slash + 1 : argv0;
+}
+
+static void printUsage() {
+    printf("usage: vsnake [mode]\n\n"
+           "  (no args)                  play\n"
+           "  --level FILE               play an obstacle level (also with --serve)\n"
+           "  --food N|P%%                food items on the board at once (1)\n"
+           "  --ghost [FILE]             race a recorded run (default: your best)\n"
+           "  --hugepages MODE           game buffers on 4k | thp | hugetlb pages (4k)\n"
+           "  --termcaps                 probe the terminal again and show what it takes\n"
+           "  --fuzz                     optimized vs reference engine, random games\n"
+           "      --runs N               games per run     (2000)\n"
+           "      --ticks N              ticks per game    (5000)\n"
+           "      --seed S               driver seed       (random)\n"
+           "  --fuzz-corpus DIR          write board-filling games as fuzz inputs\n"
+           "  --fuzz-replay PATH...      check saved fuzz inputs (files or dirs)\n"
+           "  --selfplay DIR             bot games as columnar trajectory files\n"
+           "      --threads N            writers, one file each (cores)\n"
+           "      --steps N              rows in total     (10000000)\n"
+           "      --size WxH             board size        (40x20)\n"
+           "  --selfplay-info FILE       check a trajectory file and summarise it\n"
+           "  --restart-bench            restart time and dTLB misses, heap vs arena\n"
+           "      --restarts N           games per buffer setup (10)\n"
+           "  --food-bench               tick cost vs food count on a big board\n"
+           "      --size WxH             board size        (4096x4096)\n"
+           "      --ticks N              ticks per run     (2000000)\n"
+           "  --endless                  play on an unbounded board\n"
+           "  --host ADDR                host a lockstep online game\n"
+           "  --join ADDR                join one (ADDR: host:port or socket path)\n"
+           "      --rollback             (host) rollback instead of input delay\n"
+           "      --delay N              (host) input delay in ticks (3, rollback 0)\n"
+           "  --lag-proxy LISTEN TARGET  relay with --lag MS (50) --jitter MS (20)\n"
+           "  --broadcast PATH           play, letting others watch on PATH\n"
+           "  --watch PATH               watch a broadcast game (q quits)\n"
+           "  --broadcast-bench          publish cost vs viewer count\n"
+           "  --serve ADDR               host many players in one process\n"
+           "  --connect ADDR             play on a --serve server\n"
+           "      --output MODE          write | writev | uring  (uring, else writev)\n"
+           "  --metrics FILE             keep a Prometheus textfile of server metrics\n"
+           "  --metrics-socket PATH      serve the same text on a UNIX socket\n"
+           "      --metrics-interval S   seconds between snapshots (10)\n"
+           "  --serve-bench              frame time vs session count and output mode\n"
+           "      --sessions N           session count     (100,250,500,1000)\n"
+           "      --frames N             frames per run    (300)\n"
+           "  --obs-bench                check and time the observation encoder\n"
+           "      --states N             random states per board (200)\n"
+           "  --attract-bench            CPU and output of the idle start menu\n"
+           "      --seconds N            seconds per run   (10)\n"
+           "  --session-mem-bench        bytes held per idle server session\n"
+           "      --sessions N           session count     (1000)\n"
+           "      --frames N             frames to run     (200)\n"
+           "  --daemon                   run the vsnaked leaderboard daemon\n"
+           "      --socket PATH          (default $XDG_RUNTIME_DIR/vsnaked.sock)\n"
+           "  --daemon-bench             leaderboard latency and throughput\n"
+           "      --clients N            concurrent clients (1,8,64)\n"
+           "      --ops N                requests per client (2000)\n"
+           "      --scores N             scores in the file (10000)\n"
+           "  --layout-bench             flood fill / scans per board layout\n"
+           "      --size WxH             board size        (4096x4096)\n"
+           "      --runs N               runs per layout   (3)\n"
+           "  --arena-bench              AI arena ticks/s table\n"
+           "  --arena                    watch the AI arena live\n"
+           "      --size WxH             board size        (2048x2048)\n"
+           "      --snakes N             snake count       (bench: 1000,4000,16000)\n"
+           "      --threads N            worker threads    (bench: 1,2,4,cores)\n"
+           "      --ticks N              ticks per run     (4000)\n"
+           "      --layout L             board storage     (bench: row,tiled)\n");
+}
+
+// ─── Main ───────────────────────────────────────────────────
+#ifndef VSNAKE_LIBFUZZER
+int main(int argc, char** argv) {
+    srand(static_cast<unsigned>(time(nullptr)));
+
+    if (hasArg(argc, argv, "--help") || hasArg(argc, argv, "-h")) { printUsage(); return 0; }
+
+    struct sigaction sa;
+    sa.sa_handler = signalHandler;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = 0;
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+
+        // Ignore SIGPIPE so broken audio pipes don't kill the game
+    struct sigaction spa;
+    spa.sa_handler = SIG_IGN;
+    sigemptyset(&spa.sa_mask);
+    spa.sa_flags = 0;
+    sigaction(SIGPIPE, &spa, nullptr);
+
+    {
+        const char* file = argValue(argc, argv, "--metrics");
+        const char* sock = argValue(argc, argv, "--metrics-socket");
+        if ((file || sock) && !startMetrics(file, sock, argInt(argc, argv, "--metrics-interval", 10))) {
+            perror("vsnake: metrics socket");
+            return 1;
+        }
+    }
+    {
+        bool rollback = hasArg(argc, argv, "--rollback");
+        int delay = argInt(argc, argv, "--delay", rollback ? 0 : NET_INPUT_DELAY);
+        delay = std::max(0, std::min(NET_MAX_ROLLBACK, delay));
+        if (const char* addr = argValue(argc, argv, "--host")) { initSound(); return runNetGame(addr, true, rollback, delay); }
+        if (const char* addr = argValue(argc, argv, "--join")) { initSound(); return runNetGame(addr, false, rollback, delay); }
+    }
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--lag-proxy") != 0) continue;
+        if (i + 2 >= argc) { printUsage(); return 1; }
+        return runLagProxy(argv[i + 1], argv[i + 2], argInt(argc, argv, "--lag", 50),
+                           argInt(argc, argv, "--jitter", 20));
+    }
+
+    if (hasArg(argc, argv, "--daemon") || strcmp(programName(argv[0]), "vsnaked") == 0) {
+        const char* arg = argValue(argc, argv, "--socket");
+        std::string path = arg ? arg : leaderboardSocketPath(true);
+        if (path.empty()) {
+            fprintf(stderr, "vsnaked: /tmp/vsnaked-%u is not a private directory of this user; use --socket\n",
+                    (unsigned)getuid());
+            return 1;
+        }
+        return runLeaderboardDaemon(path);
+    }
+    if (hasArg(argc, argv, "--daemon-bench")) {
+        std::vector<int> counts = { 1, 8, 64 };
+        if (argValue(argc, argv, "--clients")) counts = { argInt(argc, argv, "--clients", 8) };
+        runDaemonBenchmark(counts, argInt(argc, argv, "--ops", 2000), argInt(argc, argv, "--scores", 10000));
+        return 0;
+    }
+    if (hasArg(argc, argv, "--endless")) return runEndless();
+    if (const char* path = argValue(argc, argv, "--watch")) return runWatch(path);
+    if (const char* addr = argValue(argc, argv, "--connect")) return runConnect(addr);
+    if (const char* path = argValue(argc, argv, "--level")) {
+        std::string err;
+        g_playLevel = openLevel(path, err);
+        if (!g_playLevel) { fprintf(stderr, "vsnake: %s\n", err.c_str()); return 1; }
+    }
+    if (const char* v = argValue(argc, argv, "--food")) {
+        int cells = g_playLevel ? g_playLevel->width * g_playLevel->height : BOARD_WIDTH * BOARD_HEIGHT;
+        g_playFood = strchr(v, '%') ? (int)(cells * atof(v) / 100) : atoi(v);
+        g_playFood = std::max(1, g_playFood);
+    }
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--ghost") != 0) continue;
+        g_ghost = true;
+        if (i + 1 < argc && argv[i + 1][0] != '-') g_ghostPath = argv[i + 1];
+    }
+    if (const char* v = argValue(argc, argv, "--hugepages")) {
+        int m = HUGE_NONE;
+        while (m <= HUGE_TLB && strcmp(v, HUGE_MODE_NAME[m]) != 0) m++;
+        if (m > HUGE_TLB) {
+            fprintf(stderr, "vsnake: unknown --hugepages %s (4k, thp or hugetlb)\n", v);
+            printUsage();
+            return 1;
+        }
+        g_hugeMode = (HugeMode)m;
+    }
+    if (hasArg(argc, argv, "--fuzz")) {
+        const char* sv = argValue(argc, argv, "--seed");
+        uint64_t seed = sv ? strtoull(sv, nullptr, 0) : freshSeed();
+        printf("seed %llu\n", (unsigned long long)seed);
+        return runFuzz(argInt(argc, argv, "--runs", 2000), argInt(argc, argv, "--ticks", 5000), seed, g_playLevel);
+    }
+    if (const char* dir = argValue(argc, argv, "--fuzz-corpus")) return writeFuzzCorpus(dir);
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--fuzz-replay") != 0) continue;
+        std::vector<std::string> paths;
+        for (int j = i + 1; j < argc && strncmp(argv[j], "--", 2) != 0; j++) paths.push_back(argv[j]);
+        if (paths.empty()) { printUsage(); return 1; }
+        return runFuzzReplay(paths, g_playLevel);
+    }
+    if (const char* dir = argValue(argc, argv, "--selfplay")) {
+        int w = BOARD_WIDTH, h = BOARD_HEIGHT;
+        argSize(argc, argv, "--size", w, h);
+        int cores = std::max(1, (int)std::thread::hardware_concurrency());
+        const char* sv = argValue(argc, argv, "--steps");
+        return runSelfPlay(dir, argInt(argc, argv, "--threads", cores), sv ? strtoull(sv, nullptr, 0) : 10000000ULL,
+                           std::max(6, w), std::max(4, h), g_playFood);
+    }
+    if (const char* path = argValue(argc, argv, "--selfplay-info")) return runSelfPlayInfo(path);
+    if (hasArg(argc, argv, "--restart-bench")) {
+        int w = 4096, h = 4096;
+        argSize(argc, argv, "--size", w, h);
+        runRestartBenchmark(w, h, 1.0, std::max(2, argInt(argc, argv, "--restarts", 10)));
+        return 0;
+    }
+    if (hasArg(argc, argv, "--food-bench")) {
+        int w = 4096, h = 4096;
+        argSize(argc, argv, "--size", w, h);
+        runFoodBenchmark(w, h, { 0.01, 0.1, 1, 5 }, argInt(argc, argv, "--ticks", 2000000));
+        return 0;
+    }
+    if (const char* addr = argValue(argc, argv, "--serve")) {
+        int cores = std::max(1, (int)std::thread::hardware_concurrency());
+        return runServer(addr, argInt(argc, argv, "--threads", cores),
+                         argOutputMode(argc, argv, OUT_URING), g_playLevel, g_playFood);
+    }
+    if (hasArg(argc, argv, "--serve-bench")) {
+        int cores = std::max(1, (int)std::thread::hardware_concurrency());
+        std::vector<int> counts = { 100, 250, 500, 1000 };
+        if (argValue(argc, argv, "--sessions")) counts = { argInt(argc, argv, "--sessions", 100) };
+        std::vector<OutputMode> modes = { OUT_WRITE, OUT_WRITEV, OUT_URING };
+        if (argValue(argc, argv, "--output")) modes = { argOutputMode(argc, argv, OUT_URING) };
+        runServerBenchmark(counts, modes, argInt(argc, argv, "--threads", cores),
+                           argInt(argc, argv, "--frames", 300));
+        return 0;
+    }
+    if (hasArg(argc, argv, "--obs-bench")) {
+        return runObsBenchmark(argInt(argc, argv, "--states", 200)) ? 0 : 1;
+    }
+    if (hasArg(argc, argv, "--attract-bench")) {
+        runAttractBenchmark(argInt(argc, argv, "--seconds", 10));
+        return 0;
+    }
+    if (hasArg(argc, argv, "--session-mem-bench")) {
+        runSessionMemoryBenchmark(argInt(argc, argv, "--sessions", 1000), argInt(argc, argv, "--frames", 200));
+        return 0;
+    }
+    if (hasArg(argc, argv, "--broadcast-bench")) {
+        runBroadcastBenchmark({ 0, 10, 100, 500 }, argInt(argc, argv, "--frames", 1000));
+        return 0;
+    }
+    if (hasArg(argc, argv, "--layout-bench")) {
+        int w = 4096, h = 4096;
+        argSize(argc, argv, "--size", w, h);
+        runLayoutBenchmark(w, h, argInt(argc, argv, "--runs", 3));
+        return 0;
+    }
+    if (hasArg(argc, argv, "--arena-bench") || hasArg(argc, argv, "--arena")) {
+        int w = 2048, h = 2048;
+        argSize(argc, argv, "--size", w, h);
+        int cores = std::max(1, (int)std::thread::hardware_concurrency());
+        if (hasArg(argc, argv, "--arena")) {
+            runArenaWatch(w, h, argInt(argc, argv, "--snakes", 4000),
+                          argInt(argc, argv, "--threads", cores));
+            return 0;
+        }
+        std::vector<int> snakes = { 1000, 4000, 16000 };
+        std::vector<int> threads = { 1, 2, 4 };
+        if (cores > 4) threads.push_back(cores);
+        if (argValue(argc, argv, "--snakes"))  snakes  = { argInt(argc, argv, "--snakes", 1000) };
+        if (argValue(argc, argv, "--threads")) threads = { argInt(argc, argv, "--threads", 1) };
+        std::vector<std::string> layouts = { "row", "tiled" };
+        if (const char *l = argValue(argc, argv, "--layout")) {
+            if (strcmp(l, "row") && strcmp(l, "tiled")) {
+                fprintf(stderr, "vsnake: unknown --layout %s (row or tiled)\n", l);
+                printUsage();
+                return 1;
+            }
+            layouts = { l };
+        }
+        runArenaBenchmark(w, h, snakes, threads, layouts, argInt(argc, argv, "--ticks", 4000));
+        return 0;
+    }
+
+    if (hasArg(argc, argv, "--termcaps")) {
+        const char* term = getenv("TERM");
+        TermCaps c = detectTermCaps(true);
+        printf("TERM=%s  rep=%d ech=%d cuf=%d sync=%d truecolor=%d\n", term ? term : "",
+               c.rep, c.ech, c.cuf, c.sync, c.truecolor);
+        if (term && term[0]) printf("cached in %s\n", termCapsPath(term).c_str());
+        return 0;
+    }
+    if (const char* path = argValue(argc, argv, "--broadcast")) {
+        g_broadcast = startBroadcast(path);
+        if (!g_broadcast) { perror("vsnake: broadcast"); return 1; }
+    }
+
+    enableRawMode();
+    g_termCaps = detectTermCaps(false);
+    hideCursor();
+    write(STDOUT_FILENO, "\033[?1049h", 8);
+    atexit(atexitCleanup);
+    initSound();
+
+    AppState state = STATE_MENU;
+    int lastScore = 0;
+    bool lastWon = false;
+    MultiConfig multiCfg = { 2, 1 };
+    MultiResult multiResult = {};
+    BufferArena playArena;          // every game's buffers, reused across restarts
+
+    while (state != STATE_EXIT) {
+        if (g_interrupted) break;
+
+        switch (state) {
+
+        case STATE_MENU:
+            state = showStartMenu();
+            break;
+
+        case STATE_LEADERBOARD:
+            state = showLeaderboardScreen();
+            break;
+
+        case STATE_PLAYING: {
+            if (!playArena.base) {
+                int w = g_playLevel ? g_playLevel->width  : BOARD_WIDTH;
+                int h = g_playLevel ? g_playLevel->height : BOARD_HEIGHT;
+                initBufferArena(playArena, gameArenaBytes(w, h, std::min(g_playFood, w * h / 4)), g_hugeMode);
+            }
+            GameState game;
+            game.attachArena(&playArena);
+            game.level = g_playLevel;
+            game.foodTarget = g_playFood;
+            game.caps = &g_termCaps;
+            game.diffRender = true;
+            initGame(game);
+
+            if (game.termTooSmall) { state = STATE_TOO_SMALL; break; }
+
+            GhostRecorder rec;
+            startGhostRecording(rec, game);
+            Ghost ghost;
+            if (g_ghost && openGhost(ghost, g_ghostPath.empty() ? ghostBestPath(game) : g_ghostPath, game))
+                game.ghost = &ghost;
+
+            clearScreen();
+            long long lastFrame = nowMicros(), nextFrame = 0;
+            TurnTimer turn;
+
+            while (game.running) {
+                long long fs = nowMicros();
+                long long dt = fs - lastFrame;
+                lastFrame = fs;
+                // A key that wakes the loop mid-frame is drawn at once,
+                // but the animation only steps on the frame schedule
+                game.holdAnim = fs < nextFrame;
+                if (!game.holdAnim) nextFrame = fs + RENDER_TICK_US;
+
+                if (g_interrupted) { game.running = false; state = STATE_EXIT; break; }
+                if (checkTerminalResize(game)) break;
+
+                Direction wanted = game.nextDir;
+                readInput(game);
+                if (!game.running) break;
+                if (game.nextDir != wanted) metricTurnPressed(turn, game.nextDir, fs);
+
+                if (!game.paused) {
+                    game.moveAccumulator += dt;
+                    long long mi = calcMoveInterval(game.score, game.nextDir);
+                    if (game.moveAccumulator > mi * 3) game.moveAccumulator = mi;
+                    while (game.moveAccumulator >= mi) {
+                        updateGame(game);
+                        if (recordGhostMove(rec, game) && game.ghost) stepGhost(ghost);
+                        if (!game.running) break;
+                        game.moveAccumulator -= mi;
+                        applyQueuedDirection(game);
+                        mi = calcMoveInterval(game.score, game.nextDir);
+                    }
+                }
+                if (!game.running) break;
+
+                render(game);
+                metricTurnFrame(turn, game.dir);
+                publishFrame(g_broadcast, game, game.paused ? "PAUSED" : "");
+
+                // Sleep out the frame, but wake for a key so a turn is
+                // drawn now rather than up to a frame later
+                long long sl = nextFrame - nowMicros();
+                if (sl > 0) waitForInput(sl);
+            }
+
+            publishFrame(g_broadcast, game, game.gameWon ? "YOU WIN" :
+                                            game.gameOver ? "GAME OVER" : "");
+            finishGhostRecording(rec, game);
+            if (state == STATE_EXIT) break;
+            if (game.restartRequested) { state = STATE_PLAYING; }
+            else if (game.termResized) { state = STATE_RESIZED; }
+            else if (game.gameOver || game.gameWon) {
+                lastScore = game.score; lastWon = game.gameWon;
+                state = STATE_GAMEOVER;
+            } else { state = STATE_MENU; }
+            break;
+        }
+
+        case STATE_GAMEOVER:
+            showEndScreen(lastScore, lastWon);
+            state = waitForMenuOrExit();
+            break;
+
+        case STATE_MULTI_SETUP:
+            state = showMultiSetupScreen(multiCfg);
+            break;
+
+        case STATE_MULTI_PLAYING: {
+            MultiGame game;
+            initMultiGame(game, multiCfg, freshSeed());
+
+            if (game.termTooSmall) { state = STATE_TOO_SMALL; break; }
+
+            clearScreen();
+            long long lastFrame = nowMicros();
+
+            while (game.running) {
+                long long fs = nowMicros();
+                long long dt = fs - lastFrame;
+                lastFrame = fs;
+
+                if (g_interrupted) { game.running = false; state = STATE_EXIT; break; }
+                if (checkMultiResize(game)) break;
+
+                readMultiInput(game);
+                if (!game.running) break;
+
+                // Shared tick paced by the leader's score; vertical
+                // moves are not slowed since everyone moves together
+                if (!game.paused) {
+                    game.moveAccumulator += dt;
+                    long long mi = calcBaseInterval(leaderScore(game));
+                    if (game.moveAccumulator > mi * 3) game.moveAccumulator = mi;
+                    while (game.moveAccumulator >= mi) {
+                        updateMulti(game);
+                        if (!game.running) break;
+                        game.moveAccumulator -= mi;
+                        for (int i = 0; i < game.numSnakes; i++)
+                            applyQueuedDirection(game.snakes[i]);
+                        mi = calcBaseInterval(leaderScore(game));
+                    }
+                }
+                if (!game.running) break;
+
+                renderMulti(game);
+
+                long long el = nowMicros() - fs;
+                long long sl = RENDER_TICK_US - el;
+                if (sl > 0) usleep(static_cast<useconds_t>(sl));
+            }
+
+            if (state == STATE_EXIT) break;
+            if (game.restartRequested) { state = STATE_MULTI_PLAYING; }
+            else if (game.termResized) { state = STATE_RESIZED; }
+            else if (game.over) {
+                multiResult = collectMultiResult(game);
+                state = STATE_MULTI_GAMEOVER;
+            } else { state = STATE_MENU; }
+            break;
+        }
+
+        case STATE_MULTI_GAMEOVER:
+            showMultiEndScreen(multiResult);
             state = waitForMenuOrExit();
             break;
 
@@ -1148,5 +8590,7 @@ int main() {
         }
     }
 
+    stopBroadcast(g_broadcast);
     return 0;
 }
+#endif